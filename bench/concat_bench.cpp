@@ -0,0 +1,94 @@
+// String concatenation benchmark.
+//
+//   concat_bench [iterations]
+//
+// Evaluates left-associative chains "s0" + "s1" + ... of 10k to 80k terms
+// with the tree walker and the VM, and reports the best time per chain and
+// per term. Each result is flattened once, as printing it would. With
+// rope-backed + the time per term stays flat as the chains grow; copying
+// both sides at every step would make it grow linearly.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "compiler.h"
+#include "parser.h"
+#include "tokenize.h"
+#include "vm.h"
+
+static std::string chainSource(int terms)
+{
+    std::string out;
+    for(int i = 0; i < terms; ++i)
+    {
+        if(i > 0)
+        {
+            out += " + ";
+        }
+        out += "\"term_" + std::to_string(i % 100) + "\"";
+    }
+    return out;
+}
+
+template <typename F>
+static double bestOf(int iterations, F&& body)
+{
+    double best = 1e30;
+    for(int i = 0; i < iterations; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        body();
+        auto t1 = std::chrono::steady_clock::now();
+        best    = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 5;
+
+    std::printf("%8s %6s %12s %12s %10s\n", "terms", "engine", "best ms", "ns/term", "length");
+    for(int terms: {10000, 20000, 40000, 80000})
+    {
+        std::string        source = chainSource(terms);
+        std::vector<Token> tokens;
+        int                ret = 0;
+        Tokenizer          tokenizer;
+        tokenizer.tokenize(source, ret, tokens);
+
+        Arena       arena;
+        Parser      parser(tokens, source, arena);
+        Expression* expr = parser.parse();
+        if(!expr)
+        {
+            std::fprintf(stderr, "failed to parse the generated chain\n");
+            return 1;
+        }
+
+        // Print into a stream without a buffer: the value is flattened, the
+        // characters go nowhere.
+        std::ostream sink(nullptr);
+        GlobalNames  globals;
+        Environment  env(sink, globals);
+        std::size_t length = 0;
+        double      tree   = bestOf(iterations, [&] {
+            Value result = expr->evaluate(env);
+            length       = result.asString()->length;
+        });
+        std::printf("%8d %6s %12.3f %12.1f %10zu\n", terms, "tree", tree * 1e3, tree * 1e9 / terms, length);
+
+        Chunk    chunk;
+        Compiler compiler(chunk);
+        compiler.expressionStatement(expr, true);
+        compiler.finish();
+        VM vm(env);
+        double bytecode = bestOf(iterations, [&] { vm.run(chunk); });
+        std::printf("%8d %6s %12.3f %12.1f %10zu\n", terms, "vm", bytecode * 1e3, bytecode * 1e9 / terms, length);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Function call benchmark.
+//
+//   fib_bench [n] [iterations]
+//
+// Runs the naive recursive fib(n) (default 30) with the tree walker, the
+// closure engine and the VM and reports the best time and the time per call. fib(n) makes
+// 2 * fib(n + 1) - 1 calls, so the per-call figure is dominated by frame
+// setup, argument passing and returning.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "closure_compiler.h"
+#include "compiler.h"
+#include "intern.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "tokenize.h"
+#include "vm.h"
+
+template <typename F>
+static double bestOf(int iterations, F&& body)
+{
+    double best = 1e30;
+    for(int i = 0; i < iterations; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        body();
+        auto t1 = std::chrono::steady_clock::now();
+        best    = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    int n          = argc > 1 ? std::atoi(argv[1]) : 30;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    std::string source = "fun fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+                         "print fib(" +
+                         std::to_string(n) + ");\n";
+    std::vector<Token> tokens;
+    int                ret = 0;
+    Tokenizer          tokenizer;
+    tokenizer.internSymbols(StringTable::current());
+    tokenizer.tokenize(source, ret, tokens);
+
+    Arena                   arena;
+    Parser                  parser(tokens, source, arena);
+    std::vector<Statement*> program;
+    if(ret || !parser.parseProgram(program))
+    {
+        std::fprintf(stderr, "failed to parse the benchmark program\n");
+        return 1;
+    }
+    GlobalNames globals;
+    int         frame_size = Resolver(arena, globals).resolve(program);
+    Optimizer optimizer(arena);
+    for(Statement* stmt: program)
+    {
+        optimizer.optimize(stmt);
+    }
+
+    // fib(n + 1) by iteration, for the call count.
+    double a = 0, b = 1;
+    for(int i = 0; i <= n; ++i)
+    {
+        double next = a + b;
+        a           = b;
+        b           = next;
+    }
+    double calls = 2 * a - 1;
+
+    // The printed result goes nowhere.
+    std::ostream sink(nullptr);
+    Environment  env(sink, globals);
+
+    std::printf("%7s %12s %12s\n", "engine", "best ms", "ns/call");
+    double tree = bestOf(iterations, [&] {
+        env.enterFrame(frame_size);
+        for(Statement* stmt: program)
+        {
+            stmt->execute(env);
+        }
+    });
+    std::printf("%7s %12.3f %12.1f\n", "tree", tree * 1e3, tree * 1e9 / calls);
+
+    // From here on calls run fib's compiled body, even from the tree.
+    ClosureCompiler                 closure_compiler(arena);
+    std::vector<CompiledStatement*> compiled;
+    for(Statement* stmt: program)
+    {
+        compiled.push_back(closure_compiler.compile(stmt));
+    }
+    double closure = bestOf(iterations, [&] {
+        env.enterFrame(frame_size);
+        for(CompiledStatement* stmt: compiled)
+        {
+            (*stmt)(env);
+        }
+    });
+    std::printf("%7s %12.3f %12.1f\n", "closure", closure * 1e3, closure * 1e9 / calls);
+
+    Chunk    chunk;
+    Compiler compiler(chunk);
+    for(Statement* stmt: program)
+    {
+        compiler.statement(stmt);
+    }
+    compiler.finish();
+    VM     vm(env);
+    double bytecode = bestOf(iterations, [&] { vm.run(chunk); });
+    std::printf("%7s %12.3f %12.1f\n", "vm", bytecode * 1e3, bytecode * 1e9 / calls);
+    return 0;
+}
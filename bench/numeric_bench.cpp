@@ -0,0 +1,161 @@
+// Numeric kernel benchmark.
+//
+//   numeric_bench [n] [iterations]
+//
+// Runs a loop of n (default 2000000) floating-point updates with the tree
+// walker, the tree walker with the JIT tier, the closure engine and the VM,
+// next to the same loop in C++. Reports the best time and the time per iteration.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "closure_compiler.h"
+#include "compiler.h"
+#include "intern.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "tokenize.h"
+#include "vm.h"
+
+template <typename F>
+static double bestOf(int iterations, F&& body)
+{
+    double best = 1e30;
+    for(int i = 0; i < iterations; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        body();
+        auto t1 = std::chrono::steady_clock::now();
+        best    = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+// The kernel the scripts run, for the native baseline. volatile keeps the
+// compiler from folding the loop away.
+static double kernel(int n)
+{
+    volatile double x   = 0.5;
+    double          acc = 0;
+    for(int k = 0; k < n; ++k)
+    {
+        double v = x;
+        acc      = acc + v * v - (v + 1) / (v + 2);
+        x        = -v + 1.25;
+    }
+    return acc;
+}
+
+// Parses, resolves and optimizes the benchmark program into arena, with
+// globals numbered in globals.
+static std::vector<Statement*> load(const std::string& source, Arena& arena, GlobalNames& globals, int& frame_size)
+{
+    std::vector<Token> tokens;
+    int                ret = 0;
+    Tokenizer          tokenizer;
+    tokenizer.internSymbols(StringTable::current());
+    tokenizer.tokenize(source, ret, tokens);
+
+    Parser                  parser(tokens, source, arena);
+    std::vector<Statement*> program;
+    if(ret || !parser.parseProgram(program))
+    {
+        std::fprintf(stderr, "failed to parse the benchmark program\n");
+        std::exit(1);
+    }
+    frame_size = Resolver(arena, globals).resolve(program);
+    Optimizer optimizer(arena);
+    for(Statement* stmt: program)
+    {
+        optimizer.optimize(stmt);
+    }
+    return program;
+}
+
+int main(int argc, char* argv[])
+{
+    int n          = argc > 1 ? std::atoi(argv[1]) : 2000000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    // The tokens are parsed into trees that point back into source.
+    std::string source = "fun kernel(n) {\n"
+                         "  var acc = 0; var x = 0.5;\n"
+                         "  for (var k = 0; k < n; k = k + 1) {\n"
+                         "    acc = acc + x * x - (x + 1) / (x + 2);\n"
+                         "    x = -x + 1.25;\n"
+                         "  }\n"
+                         "  return acc;\n"
+                         "}\n"
+                         "print kernel(" +
+                         std::to_string(n) + ");\n";
+
+    // The printed result goes nowhere.
+    std::ostream sink(nullptr);
+    GlobalNames  globals;
+    Environment  env(sink, globals);
+
+    std::printf("%7s %12s %12s\n", "engine", "best ms", "ns/iter");
+    double native = bestOf(iterations, [&] { kernel(n); });
+    std::printf("%7s %12.3f %12.2f\n", "c++", native * 1e3, native * 1e9 / n);
+
+    Arena                   tree_arena;
+    int                     frame_size = 0;
+    std::vector<Statement*> program    = load(source, tree_arena, globals, frame_size);
+    auto                    walk       = [&](const std::vector<Statement*>& statements) {
+        env.enterFrame(frame_size);
+        for(Statement* stmt: statements)
+        {
+            stmt->execute(env);
+        }
+    };
+    double tree = bestOf(iterations, [&] { walk(program); });
+    std::printf("%7s %12.3f %12.2f\n", "tree", tree * 1e3, tree * 1e9 / n);
+
+    if(jit_supported)
+    {
+        Arena                   jit_arena;
+        std::vector<Statement*> jit_program = load(source, jit_arena, globals, frame_size);
+        JitPlanner              planner(jit_arena);
+        for(Statement* stmt: jit_program)
+        {
+            planner.plan(stmt);
+        }
+        double jit = bestOf(iterations, [&] { walk(jit_program); });
+        std::printf("%7s %12.3f %12.2f\n", "jit", jit * 1e3, jit * 1e9 / n);
+    }
+
+    Arena                           closure_arena;
+    std::vector<Statement*>         closure_program = load(source, closure_arena, globals, frame_size);
+    ClosureCompiler                 closure_compiler(closure_arena);
+    std::vector<CompiledStatement*> compiled;
+    for(Statement* stmt: closure_program)
+    {
+        compiled.push_back(closure_compiler.compile(stmt));
+    }
+    double closure = bestOf(iterations, [&] {
+        env.enterFrame(frame_size);
+        for(CompiledStatement* stmt: compiled)
+        {
+            (*stmt)(env);
+        }
+    });
+    std::printf("%7s %12.3f %12.2f\n", "closure", closure * 1e3, closure * 1e9 / n);
+
+    Chunk    chunk;
+    Compiler compiler(chunk);
+    for(Statement* stmt: program)
+    {
+        compiler.statement(stmt);
+    }
+    compiler.finish();
+    VM     vm(env);
+    double bytecode = bestOf(iterations, [&] { vm.run(chunk); });
+    std::printf("%7s %12.3f %12.2f\n", "vm", bytecode * 1e3, bytecode * 1e9 / n);
+    return 0;
+}
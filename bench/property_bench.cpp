@@ -0,0 +1,122 @@
+// Property access benchmark.
+//
+//   property_bench [passes] [iterations]
+//
+// Runs a loop of passes (default 1000000) that each read and write fields
+// and call a method, once on instances of one shape and once alternating
+// between two shapes, with the tree walker and the VM. Reports the best time
+// and the time per property operation (four per pass: two reads, a write
+// and an invoke).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "compiler.h"
+#include "intern.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "tokenize.h"
+#include "vm.h"
+
+template <typename F>
+static double bestOf(int iterations, F&& body)
+{
+    double best = 1e30;
+    for(int i = 0; i < iterations; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        body();
+        auto t1 = std::chrono::steady_clock::now();
+        best    = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+// Declares the classes, then loops n times over a (and b, when
+// polymorphic). XY and YX hold the same fields added in opposite orders, so
+// they have different shapes.
+static std::string program(int n, bool polymorphic)
+{
+    return "class XY { init() { this.x = 0; this.y = 1; } step() { return this.y; } }\n"
+           "class YX { init() { this.y = 1; this.x = 0; } step() { return this.y; } }\n"
+           "fun run() {\n"
+           "  var a = XY(); var b = " +
+           std::string(polymorphic ? "YX()" : "XY()") +
+           ";\n"
+           "  for (var i = 0; i < " +
+           std::to_string(n) +
+           "; i = i + 1) {\n"
+           "    var p = a; a = b; b = p;\n"
+           "    p.x = p.x + p.y + p.step();\n"
+           "  }\n"
+           "  return a.x + b.x;\n"
+           "}\n"
+           "print run();\n";
+}
+
+static void measure(const char* label, int n, bool polymorphic, int iterations)
+{
+    std::string        source = program(n, polymorphic);
+    std::vector<Token> tokens;
+    int                ret = 0;
+    Tokenizer          tokenizer;
+    tokenizer.internSymbols(StringTable::current());
+    tokenizer.tokenize(source, ret, tokens);
+
+    Arena                   arena;
+    Parser                  parser(tokens, source, arena);
+    std::vector<Statement*> statements;
+    if(ret || !parser.parseProgram(statements))
+    {
+        std::fprintf(stderr, "failed to parse the benchmark program\n");
+        std::exit(1);
+    }
+    GlobalNames globals;
+    int         frame_size = Resolver(arena, globals).resolve(statements);
+    Optimizer optimizer(arena);
+    for(Statement* stmt: statements)
+    {
+        optimizer.optimize(stmt);
+    }
+
+    // The printed result goes nowhere.
+    std::ostream sink(nullptr);
+    Environment  env(sink, globals);
+    double       operations = 4.0 * n;
+
+    double tree = bestOf(iterations, [&] {
+        env.enterFrame(frame_size);
+        for(Statement* stmt: statements)
+        {
+            stmt->execute(env);
+        }
+    });
+    std::printf("%-12s %6s %12.3f %12.1f\n", label, "tree", tree * 1e3, tree * 1e9 / operations);
+
+    Chunk    chunk;
+    Compiler compiler(chunk);
+    for(Statement* stmt: statements)
+    {
+        compiler.statement(stmt);
+    }
+    compiler.finish();
+    VM     vm(env);
+    double bytecode = bestOf(iterations, [&] { vm.run(chunk); });
+    std::printf("%-12s %6s %12.3f %12.1f\n", label, "vm", bytecode * 1e3, bytecode * 1e9 / operations);
+}
+
+int main(int argc, char* argv[])
+{
+    int n          = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    std::printf("%-12s %6s %12s %12s\n", "sites", "engine", "best ms", "ns/op");
+    measure("monomorphic", n, false, iterations);
+    measure("polymorphic", n, true, iterations);
+    return 0;
+}
@@ -0,0 +1,203 @@
+// Load test for the serve command.
+//
+//   serve_bench <interpreter> <file.lox> [requests] [clients] [server options...]
+//
+// Starts `interpreter serve` on a private socket with one worker per client
+// and the given options (--cache=0, say, to see what the cache saves),
+// then has each client send its share of `run file.lox` requests over one
+// connection, back to back. Reports throughput and latency percentiles,
+// along with the first request (a cache miss), and compares with starting
+// `interpreter run file.lox` as a process per request. The program's output
+// is discarded.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <ostream>
+#include <spawn.h>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "serve.h"
+
+extern char** environ;
+
+using Clock = std::chrono::steady_clock;
+
+class NullBuffer : public std::streambuf
+{
+protected:
+    int_type overflow(int_type ch) override
+    {
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize size) override
+    {
+        return size;
+    }
+};
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Starts the interpreter with args, output to /dev/null unless keep_stderr.
+static pid_t spawn(const std::vector<std::string>& args, bool keep_stderr)
+{
+    std::vector<char*> argv;
+    for(const std::string& arg: args)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    if(!keep_stderr)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    pid_t pid = -1;
+    if(posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ) != 0)
+    {
+        pid = -1;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+
+static double percentile(std::vector<double>& sorted, double p)
+{
+    std::size_t index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        std::fprintf(stderr, "usage: serve_bench <interpreter> <file.lox> [requests] [clients] [server options...]\n");
+        return 64;
+    }
+    std::string interpreter = std::filesystem::absolute(argv[1]).string();
+    std::string script      = std::filesystem::absolute(argv[2]).string();
+    int         requests    = argc > 3 ? std::atoi(argv[3]) : 2000;
+    int         clients     = argc > 4 ? std::atoi(argv[4]) : 4;
+    if(requests < 1 || clients < 1)
+    {
+        std::fprintf(stderr, "requests and clients must be positive\n");
+        return 64;
+    }
+    std::string socket = "/tmp/serve_bench." + std::to_string(getpid()) + ".sock";
+
+    std::vector<std::string> server_args = {interpreter, "serve", "--socket", socket, "--jobs=" + std::to_string(clients)};
+    server_args.insert(server_args.end(), argv + std::min(argc, 5), argv + argc);
+    pid_t server = spawn(server_args, true);
+    if(server < 0)
+    {
+        std::fprintf(stderr, "cannot start %s\n", interpreter.c_str());
+        return 1;
+    }
+    int probe = -1;
+    for(int attempt = 0; attempt < 500 && probe < 0; ++attempt)
+    {
+        probe = connectToServer(socket);
+        if(probe < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    if(probe < 0)
+    {
+        std::fprintf(stderr, "server did not come up on %s\n", socket.c_str());
+        kill(server, SIGTERM);
+        waitpid(server, nullptr, 0);
+        return 1;
+    }
+
+    NullBuffer   null_buffer;
+    std::ostream sink(&null_buffer);
+    ServeRequest request;
+    request.command = "run";
+    request.file    = script;
+
+    auto   start    = Clock::now();
+    int    expected = sendRequest(probe, request, sink, sink);
+    double first    = millisecondsSince(start);
+    close(probe);
+
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<int>                 mismatches(clients, 0);
+    std::vector<std::thread>         threads;
+    start = Clock::now();
+    for(int c = 0; c < clients; ++c)
+    {
+        threads.emplace_back([&, c] {
+            NullBuffer   buffer;
+            std::ostream discard(&buffer);
+            int          fd    = connectToServer(socket);
+            int          count = requests / clients + (c < requests % clients ? 1 : 0);
+            for(int i = 0; i < count; ++i)
+            {
+                auto sent   = Clock::now();
+                int  status = fd < 0 ? -1 : sendRequest(fd, request, discard, discard);
+                latencies[c].push_back(millisecondsSince(sent));
+                mismatches[c] += status != expected;
+            }
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+        });
+    }
+    for(std::thread& thread: threads)
+    {
+        thread.join();
+    }
+    double elapsed = millisecondsSince(start);
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+
+    std::vector<double> all;
+    int                 failed = 0;
+    for(int c = 0; c < clients; ++c)
+    {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        failed += mismatches[c];
+    }
+    std::sort(all.begin(), all.end());
+    std::printf("serve: %d requests from %d clients, exit %d: %.0f req/s, p50 %.3f ms, p99 %.3f ms, max %.3f ms"
+                " (first request %.3f ms)\n",
+                requests, clients, expected, requests / (elapsed / 1e3), percentile(all, 0.5),
+                percentile(all, 0.99), all.back(), first);
+    if(failed)
+    {
+        std::printf("serve: %d requests did not exit %d\n", failed, expected);
+    }
+
+    // A fresh process per request, as without the server.
+    int runs = std::min(requests, 200);
+    start    = Clock::now();
+    for(int i = 0; i < runs; ++i)
+    {
+        pid_t pid = spawn({interpreter, "run", script}, false);
+        if(pid < 0 || waitpid(pid, nullptr, 0) < 0)
+        {
+            std::fprintf(stderr, "cannot run %s\n", interpreter.c_str());
+            return 1;
+        }
+    }
+    elapsed = millisecondsSince(start);
+    std::printf("spawn: %d runs, one at a time: %.0f runs/s, mean %.3f ms\n", runs, runs / (elapsed / 1e3),
+                elapsed / runs);
+    return failed ? 1 : 0;
+}
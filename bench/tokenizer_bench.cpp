@@ -0,0 +1,193 @@
+// Tokenizer throughput benchmark.
+//
+//   tokenizer_bench [file.lox] [iterations]
+//
+// Without a file (or with an empty file argument) a synthetic ~64 MB script
+// is generated. The best time to lex it is reported, followed by the
+// throughput of the scanning kernels against their scalar versions, on long
+// runs and on runs as short as tokens, and the scaling of the parallel lexer.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "parallel_lex.h"
+#include "scan.h"
+#include "source.h"
+#include "tokenize.h"
+
+static std::string syntheticSource(std::size_t target_size)
+{
+    static const char* const lines[] = {
+        "var accumulated_total_value = (12345.678 + other_identifier) * 3;\n",
+        "print \"a moderately long string literal that spans a few words\";\n",
+        "        // an indented comment line explaining the next statement\n",
+        "if (counter_variable_name >= 1000000 and !finished) { counter = counter - 1; }\n",
+        "fun compute_something(alpha, beta, gamma) { return alpha * beta / gamma; }\n",
+        "\n",
+        "while (index_into_array < limit_value) print index_into_array == 42;\n",
+    };
+    std::string out;
+    out.reserve(target_size + 128);
+    for(std::size_t i = 0; out.size() < target_size; ++i)
+    {
+        out += lines[i % (sizeof(lines) / sizeof(lines[0]))];
+    }
+    return out;
+}
+
+template <typename F>
+static double bestOf(int iterations, F&& body)
+{
+    double best = 1e30;
+    for(int i = 0; i < iterations; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        body();
+        auto t1 = std::chrono::steady_clock::now();
+        best    = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+// Input for the kernels: whitespace, identifier characters and string
+// contents, each broken by a byte that ends the run after every `run` bytes
+// or, with run 0, after 1 to 16 bytes at random, as in code.
+struct KernelTexts
+{
+    std::string blanks; // every 80th byte a newline
+    std::string ident;
+    std::string body; // every 80th byte a newline
+};
+
+static KernelTexts kernelTexts(std::size_t size, std::size_t run)
+{
+    KernelTexts texts{std::string(size, ' '), std::string(size, 'x'), std::string(size, 'a')};
+    for(std::size_t i = 0; i < size; i += 80)
+    {
+        texts.blanks[i] = '\n';
+        texts.body[i]   = '\n';
+    }
+    std::minstd_rand random(1);
+    auto             length = [&] { return run ? run : 1 + random() % 16; };
+    for(std::size_t i = length(); i < size; i += 1 + length())
+    {
+        texts.blanks[i] = 'x';
+        texts.ident[i]  = ' ';
+        texts.body[i]   = '"';
+    }
+    return texts;
+}
+
+// Scans each text from start to end, one run after another, as the tokenizer
+// does, stepping over the byte that stopped each run.
+template <typename Kernels>
+static void kernelBench(const char* name, const KernelTexts& texts, int iterations)
+{
+    std::size_t size  = texts.ident.size();
+    std::size_t sink  = 0;
+    int         lines = 0;
+    double      ws    = bestOf(iterations, [&] {
+        for(std::size_t pos = 0; pos < size; ++pos)
+        {
+            pos = Kernels::skipWhitespace(texts.blanks.data(), pos, size, lines);
+        }
+    });
+    double      id    = bestOf(iterations, [&] {
+        for(std::size_t pos = 0; pos < size; ++pos)
+        {
+            pos = Kernels::skipIdentifier(texts.ident.data(), pos, size);
+            sink += pos;
+        }
+    });
+    double      str   = bestOf(iterations, [&] {
+        for(std::size_t pos = 0; pos < size; ++pos)
+        {
+            pos = Kernels::findQuote(texts.body.data(), pos, size, lines);
+        }
+    });
+    std::printf("  %-8s whitespace %6.2f GB/s  identifier %6.2f GB/s  string %6.2f GB/s  (%zu)\n",
+                name,
+                size / ws / 1e9,
+                size / id / 1e9,
+                size / str / 1e9,
+                (sink + lines) % 10);
+}
+
+// The kernels are free functions; these let kernelBench take either set.
+struct ScalarKernels
+{
+    static constexpr auto skipWhitespace = scan::scalar::skipWhitespace;
+    static constexpr auto skipIdentifier = scan::scalar::skipIdentifier;
+    static constexpr auto findQuote      = scan::scalar::findQuote;
+};
+
+struct SelectedKernels
+{
+    static constexpr auto skipWhitespace = scan::skipWhitespace;
+    static constexpr auto skipIdentifier = scan::skipIdentifier;
+    static constexpr auto findQuote      = scan::findQuote;
+};
+
+int main(int argc, char* argv[])
+{
+    SourceBuffer file;
+    std::string  generated;
+    std::string_view source;
+    if(argc > 1 && argv[1][0] != '\0')
+    {
+        if(!file.open(argv[1]))
+        {
+            std::fprintf(stderr, "Error reading file: %s\n", argv[1]);
+            return 1;
+        }
+        source = file.text();
+    }
+    else
+    {
+        generated = syntheticSource(64u << 20);
+        source    = generated;
+    }
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::printf("input: %.1f MB, %d iterations\n", source.size() / 1e6, iterations);
+    std::size_t ntoks = 0;
+    double      best  = bestOf(iterations, [&] {
+        std::vector<Token> tokens;
+        int                ret = 0;
+        Tokenizer          tokenizer;
+        tokenizer.tokenize(source, ret, tokens);
+        ntoks = tokens.size();
+    });
+    std::printf("%-8s %8.1f ms  %8.1f MB/s  %zu tokens\n",
+                scan::implementation_name,
+                best * 1e3,
+                source.size() / best / 1e6,
+                ntoks);
+
+    for(std::size_t run: {std::size_t{64u << 20}, std::size_t{0}})
+    {
+        KernelTexts texts = kernelTexts(64u << 20, run);
+        std::printf("kernels on %s runs:\n", run ? "long" : "token-length");
+        kernelBench<ScalarKernels>("scalar", texts, iterations);
+        if(std::string_view(scan::implementation_name) != "scalar")
+        {
+            kernelBench<SelectedKernels>(scan::implementation_name, texts, iterations);
+        }
+    }
+
+    for(unsigned jobs: {1u, 2u, 4u, 8u})
+    {
+        double best = bestOf(iterations, [&] {
+            std::vector<Token> tokens;
+            int                ret = 0;
+            tokenizeParallel(source, jobs, ret, tokens);
+        });
+        std::printf("parallel %2u jobs %8.1f ms  %8.1f MB/s\n", jobs, best * 1e3, source.size() / best / 1e6);
+    }
+    return 0;
+}
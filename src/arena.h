@@ -0,0 +1,113 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that share one lifetime, such as the nodes of a
+// syntax tree. Allocation is a pointer increment inside the current block;
+// everything is released at once by reset() or when the arena is destroyed.
+// Objects with non-trivial destructors are recorded and destroyed in reverse
+// order of creation.
+class Arena
+{
+public:
+    explicit Arena(std::size_t first_block = 16 * 1024) : next_block_size(first_block) {}
+    ~Arena()
+    {
+        reset();
+    }
+
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T*    object = new(memory) T(std::forward<Args>(args)...);
+        if constexpr(!std::is_trivially_destructible_v<T>)
+        {
+            Finalizer* fin = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+            fin->destroy   = [](void* p) { static_cast<T*>(p)->~T(); };
+            fin->object    = object;
+            fin->next      = finalizers;
+            finalizers     = fin;
+        }
+        return object;
+    }
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        std::size_t offset = (used + align - 1) & ~(align - 1);
+        if(blocks.empty() || offset + size > capacity)
+        {
+            grow(size + align);
+            offset = (used + align - 1) & ~(align - 1);
+        }
+        used = offset + size;
+        return blocks.back().get() + offset;
+    }
+
+    // Destroys every object and releases all blocks but the first, which is
+    // kept for reuse.
+    void reset()
+    {
+        for(Finalizer* fin = finalizers; fin; fin = fin->next)
+        {
+            fin->destroy(fin->object);
+        }
+        finalizers = nullptr;
+        if(blocks.size() > 1)
+        {
+            blocks.erase(blocks.begin() + 1, blocks.end());
+            capacity        = first_capacity;
+            total_capacity  = first_capacity;
+            next_block_size = first_capacity * 2;
+        }
+        used = 0;
+    }
+
+    // Total size of the blocks currently held.
+    std::size_t bytesReserved() const
+    {
+        return total_capacity;
+    }
+
+private:
+    struct Finalizer
+    {
+        void (*destroy)(void*);
+        void*      object;
+        Finalizer* next;
+    };
+
+    void grow(std::size_t min_size)
+    {
+        std::size_t size = std::max(next_block_size, min_size);
+        blocks.emplace_back(new std::byte[size]);
+        if(blocks.size() == 1)
+        {
+            first_capacity = size;
+        }
+        capacity = size;
+        total_capacity += size;
+        used            = 0;
+        next_block_size = size * 2;
+    }
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::size_t                               used            = 0;
+    std::size_t                               capacity        = 0;
+    std::size_t                               first_capacity  = 0;
+    std::size_t                               total_capacity  = 0;
+    std::size_t                               next_block_size;
+    Finalizer*                                finalizers = nullptr;
+};
+
+#endif // ARENA_H
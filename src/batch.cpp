@@ -0,0 +1,226 @@
+#include "batch.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+namespace
+{
+// One thread's share of the indices.
+struct WorkQueue
+{
+    std::mutex              lock;
+    std::deque<std::size_t> tasks;
+};
+
+bool takeOwn(WorkQueue& queue, std::size_t& task)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if(queue.tasks.empty())
+    {
+        return false;
+    }
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool steal(WorkQueue& queue, std::size_t& task)
+{
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if(queue.tasks.empty())
+    {
+        return false;
+    }
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+void work(std::vector<WorkQueue>& queues, std::size_t self, const std::function<void(std::size_t)>& task)
+{
+    std::size_t next;
+    for(;;)
+    {
+        if(takeOwn(queues[self], next))
+        {
+            task(next);
+            continue;
+        }
+        // Tasks never create tasks, so once every queue is empty the work
+        // is done.
+        bool stolen = false;
+        for(std::size_t k = 1; k < queues.size() && !stolen; ++k)
+        {
+            stolen = steal(queues[(self + k) % queues.size()], next);
+        }
+        if(!stolen)
+        {
+            return;
+        }
+        task(next);
+    }
+}
+
+void addLoxFiles(const std::filesystem::path& directory, std::vector<std::string>& files)
+{
+    std::vector<std::string> found;
+    for(const auto& entry: std::filesystem::recursive_directory_iterator(directory))
+    {
+        if(entry.is_regular_file() && entry.path().extension() == ".lox")
+        {
+            found.push_back(entry.path().string());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+void addListed(const std::string& list, std::vector<std::string>& files)
+{
+    std::ifstream in(list);
+    if(!in)
+    {
+        throw std::runtime_error("Error reading file: " + list);
+    }
+    std::filesystem::path base = std::filesystem::path(list).parent_path();
+    std::string           line;
+    while(std::getline(in, line))
+    {
+        if(!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if(line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        files.push_back((base / line).string());
+    }
+}
+
+// Writes text with every line prefixed, ending it with a newline if needed.
+void writePrefixed(std::ostream& out, std::string_view prefix, std::string_view text)
+{
+    while(!text.empty())
+    {
+        std::size_t end  = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        out << prefix << line << '\n';
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    }
+}
+} // namespace
+
+void runWorkStealing(std::size_t count, unsigned threads, const std::function<void(std::size_t)>& task)
+{
+    threads = static_cast<unsigned>(std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(count, 1)));
+    std::vector<WorkQueue> queues(threads);
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        queues[i * threads / count].tasks.push_back(i);
+    }
+
+    std::vector<std::thread> workers;
+    for(unsigned t = 1; t < threads; ++t)
+    {
+        workers.emplace_back([&, t] { work(queues, t, task); });
+    }
+    work(queues, 0, task);
+    for(std::thread& worker: workers)
+    {
+        worker.join();
+    }
+}
+
+std::vector<std::string> expandBatchInputs(const std::vector<std::string>& inputs)
+{
+    std::vector<std::string> files;
+    for(const std::string& input: inputs)
+    {
+        std::error_code error;
+        if(input.size() > 1 && input[0] == '@')
+        {
+            addListed(input.substr(1), files);
+        }
+        else if(std::filesystem::is_directory(input, error))
+        {
+            addLoxFiles(input, files);
+        }
+        else
+        {
+            files.push_back(input);
+        }
+    }
+    return files;
+}
+
+int runBatch(const std::vector<std::string>& files, unsigned threads, const BatchJob& job, std::ostream& out,
+             std::ostream& err)
+{
+    struct Result
+    {
+        std::string out;
+        std::string err;
+        int         status = 0;
+    };
+    std::vector<Result> results(files.size());
+
+    auto start = std::chrono::steady_clock::now();
+    runWorkStealing(files.size(), threads, [&](std::size_t i) {
+        std::ostringstream job_out;
+        std::ostringstream job_err;
+        try
+        {
+            results[i].status = job(files[i], job_out, job_err);
+        }
+        catch(const std::exception& e)
+        {
+            job_err << e.what() << '\n';
+            results[i].status = 1;
+        }
+        results[i].out = std::move(job_out).str();
+        results[i].err = std::move(job_err).str();
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int         first_failure = 0;
+    std::size_t failed        = 0;
+    for(std::size_t i = 0; i < files.size(); ++i)
+    {
+        const Result& result = results[i];
+        out << "==> " << files[i] << " <==\n" << result.out;
+        if(!result.out.empty() && result.out.back() != '\n')
+        {
+            out << '\n';
+        }
+        if(!result.err.empty())
+        {
+            out.flush();
+            writePrefixed(err, files[i] + ": ", result.err);
+        }
+        if(result.status != 0)
+        {
+            ++failed;
+            first_failure = first_failure ? first_failure : result.status;
+        }
+    }
+    out.flush();
+
+    for(std::size_t i = 0; i < files.size(); ++i)
+    {
+        if(results[i].status != 0)
+        {
+            err << "[batch] " << files[i] << ": exit " << results[i].status << '\n';
+        }
+    }
+    err << "[batch] " << files.size() << " files, " << files.size() - failed << " passed, " << failed
+        << " failed, " << seconds * 1e3 << " ms\n";
+    return first_failure;
+}
@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs task(i) for every i below count on the given number of threads, the
+// calling thread included, and returns once all have finished. Each thread
+// starts with an equal run of indices in its own deque and takes them from
+// the front; a thread that runs out steals from the back of another's, so a
+// few slow tasks do not leave the other threads idle. task must not throw.
+void runWorkStealing(std::size_t count, unsigned threads, const std::function<void(std::size_t)>& task);
+
+// The files a batch runs, in order. A directory stands for the .lox files
+// under it, sorted by path; "@list" for the files named in list, one per
+// line, relative to the list's directory (blank lines and lines starting
+// with # are skipped). Anything else is taken as a file name as it is.
+// Throws std::runtime_error for a directory or list that cannot be read.
+std::vector<std::string> expandBatchInputs(const std::vector<std::string>& inputs);
+
+// Runs one file, writing what it prints to out and its errors to err, and
+// returns its exit status.
+using BatchJob = std::function<int(const std::string& file, std::ostream& out, std::ostream& err)>;
+
+// Runs job for every file on a pool of threads. Each job has its own
+// buffers; once all have finished the results are written in file order:
+// the output under a "==> file <==" header to out, the errors, each line
+// prefixed with "file: ", to err. A summary with every failing file's
+// status follows on err. Returns 0 if every job did, else the status of the
+// first failing file.
+int runBatch(const std::vector<std::string>& files, unsigned threads, const BatchJob& job, std::ostream& out,
+             std::ostream& err);
+
+#endif // BATCH_H
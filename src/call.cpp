@@ -0,0 +1,129 @@
+#include "parser.h"
+#include "closure_compiler.h"
+#include "intern.h"
+#include <stdexcept>
+
+// Function calls and class declarations in the tree walker. A call's frame
+// is the run of stack slots starting at the callee; nothing is allocated per
+// call unless the body creates a closure.
+
+ObjClosure* FunctionStatement::makeClosure(Environment& env)
+{
+    if(!function)
+    {
+        Value function_name = Value::share(StringTable::current().symbolString(name.symbol));
+        function            = ObjFunction::create(std::move(function_name), static_cast<int>(params.size()),
+                                                  frame_size, static_cast<int>(upvalues.size()));
+        function->initializer = kind == FunctionKind::INITIALIZER;
+        function->declaration = this;
+    }
+
+    ObjClosure* closure = ObjClosure::create(function);
+    for(std::size_t i = 0; i < upvalues.size(); ++i)
+    {
+        const UpvalueRef& ref = upvalues[i];
+        ObjUpvalue* upvalue = ref.is_local ? env.captureUpvalue(env.frame + ref.index) : env.closure->upvalues()[ref.index];
+        ++upvalue->refcount;
+        closure->upvalues()[i] = upvalue;
+    }
+    return closure;
+}
+
+Flow FunctionStatement::execute(Environment& env)
+{
+    Value value = Value::adoptObject(makeClosure(env));
+    if(name.depth < 0)
+    {
+        env.defineGlobal(name.slot, std::move(value));
+    }
+    else
+    {
+        env.local(name.slot) = std::move(value);
+    }
+    return Flow::NEXT;
+}
+
+Flow ClassStatement::execute(Environment& env)
+{
+    Value     class_name = Value::share(StringTable::current().symbolString(name.symbol));
+    ObjClass* klass      = ObjClass::create(std::move(class_name));
+    Value     value      = Value::adoptObject(klass);
+    if(superclass)
+    {
+        Value parent = superclass->evaluate(env);
+        inherit(klass, parent);
+        env.local(super_variable.slot) = std::move(parent);
+    }
+    for(FunctionStatement* method: methods)
+    {
+        klass->defineMethod(method->name.symbol, Value::adoptObject(method->makeClosure(env)));
+    }
+    if(name.depth < 0)
+    {
+        env.defineGlobal(name.slot, std::move(value));
+    }
+    else
+    {
+        env.local(name.slot) = std::move(value);
+    }
+    if(close_slot >= 0)
+    {
+        env.closeUpvalues(env.frame + close_slot);
+    }
+    return Flow::NEXT;
+}
+
+Value completeCall(Environment& env, ObjClosure* closure, Value* base)
+{
+    if(!closure)
+    {
+        Value result = std::move(*base);
+        env.top      = base;
+        return result;
+    }
+
+    ObjFunction* function = closure->function;
+    if(env.depth == Environment::max_frames || env.stackEnd() - base < function->frame_size)
+    {
+        Environment::stackOverflow();
+    }
+    env.checkInterrupt();
+
+    Value*      caller_frame   = env.frame;
+    ObjClosure* caller_closure = env.closure;
+    env.frame                  = base;
+    env.closure                = closure;
+    env.top                    = base + function->frame_size;
+    ++env.depth;
+
+    Value result;
+    if(CompiledStatement* body = function->declaration->compiled)
+    {
+        if((*body)(env) == Flow::RETURN)
+        {
+            result = std::move(env.returned);
+        }
+    }
+    else
+    {
+        for(Statement* stmt: function->declaration->body)
+        {
+            if(stmt->execute(env) == Flow::RETURN)
+            {
+                result = std::move(env.returned);
+                break;
+            }
+        }
+    }
+    if(function->initializer)
+    {
+        result = base[0];
+    }
+
+    env.closeUpvalues(base);
+    env.frame   = caller_frame;
+    env.closure = caller_closure;
+    env.top = base;
+    --env.depth;
+    return result;
+}
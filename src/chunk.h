@@ -0,0 +1,80 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <cstdint>
+#include <vector>
+#include "shape.h"
+#include "value.h"
+
+enum class OpCode : std::uint8_t
+{
+    CONSTANT,      // u8 index: push constants[index]
+    CONSTANT_LONG, // u24 index, little endian
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    NEGATE,
+    NOT,
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    PRINT, // pop and print
+    POP,
+    NIL,
+    DEFINE_GLOBAL,     // u24 slot: pop into the global
+    GET_GLOBAL,        // u24 slot
+    SET_GLOBAL,        // u24 slot: store the top of the stack, keeping it
+    DEFINE_LOCAL,      // u8 slot: pop into the local
+    GET_LOCAL,         // u8 slot
+    SET_LOCAL,         // u8 slot: store the top of the stack, keeping it
+    GET_UPVALUE,       // u8 index into the running closure's upvalues
+    SET_UPVALUE,       // u8 index: store the top of the stack, keeping it
+    CLOSE_UPVALUES,    // u8 slot: close the upvalues at or above the slot
+    JUMP,              // u16 forward offset, from the end of the operand
+    JUMP_IF_FALSE,     // u16: jump if the top of the stack is falsey, keeping it
+    JUMP_IF_TRUE,      // u16: jump if the top of the stack is truthy, keeping it
+    POP_JUMP_IF_FALSE, // u16: pop, and jump if the value was falsey
+    LOOP,              // u16 backward offset, from the end of the operand
+    CALL,              // u8 argc: call the value below the arguments
+    // u24 constant index of an ObjFunction, then a u8 is_local and a u8
+    // index for each of its upvalues: push a new closure over them
+    CLOSURE,
+    CLASS,        // u24 constant index of the name: push a new class
+    INHERIT,      // pop a superclass into the class below it
+    METHOD,       // u24 symbol: pop a closure into the class below it
+    GET_PROPERTY, // u24 symbol, u16 cache: replace an instance by its property
+    SET_PROPERTY, // u24 symbol, u16 cache: pop a value into the instance below, leaving the value
+    INVOKE,       // u24 symbol, u8 argc, u16 cache: call a method of the value below the arguments
+    GET_SUPER,    // u24 symbol: pop a receiver, and replace the superclass below by its bound method
+    RETURN        // return the top of the stack from a function; ends top-level code
+};
+
+// A compiled unit of bytecode together with its constant pool.
+struct Chunk
+{
+    std::vector<std::uint8_t> code;
+    std::vector<Value>   constants;
+    // Deepest the value stack gets while running code, so the VM can check
+    // for room once per call instead of on every push.
+    int max_stack = 0;
+    // Slots for locals, which sit below the values the code pushes.
+    int frame_size = 0;
+    // One per property site, indexed by the instruction's cache operand.
+    // Filled in as the code runs.
+    mutable std::vector<InlineCache> caches;
+
+    void write(OpCode op)
+    {
+        code.push_back(static_cast<std::uint8_t>(op));
+    }
+    void write(std::uint8_t byte)
+    {
+        code.push_back(byte);
+    }
+};
+
+#endif // CHUNK_H
@@ -0,0 +1,204 @@
+#include "class.h"
+#include "intern.h"
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+[[noreturn]] void undefinedProperty(std::uint32_t symbol)
+{
+    std::string name(StringTable::current().symbolString(symbol)->view());
+    throw std::runtime_error("Undefined property '" + name + "'.");
+}
+
+ObjClosure* findMethod(const ObjClass* klass, std::uint32_t symbol)
+{
+    auto method = klass->methods.find(symbol);
+    return method == klass->methods.end() ? nullptr : static_cast<ObjClosure*>(method->second.asObject());
+}
+} // namespace
+
+ObjClass* ObjClass::create(Value name)
+{
+    auto* klass = new ObjClass{{{1, ObjType::CLASS}}, std::move(name), {}, nullptr, {}};
+    Heap::current().track(klass, sizeof(ObjClass));
+    return klass;
+}
+
+void ObjClass::defineMethod(std::uint32_t symbol, Value method)
+{
+    if(symbol == StringTable::current().symbol("init"))
+    {
+        initializer = static_cast<ObjClosure*>(method.asObject());
+    }
+    methods[symbol] = std::move(method);
+}
+
+ObjInstance* ObjInstance::create(ObjClass* klass)
+{
+    auto* instance = new ObjInstance{{{1, ObjType::INSTANCE}}, klass, &klass->root, {}};
+    ++klass->refcount;
+    Heap::current().track(instance, sizeof(ObjInstance));
+    return instance;
+}
+
+ObjBoundMethod* ObjBoundMethod::create(Value receiver, ObjClosure* method)
+{
+    auto* bound = new ObjBoundMethod{{{1, ObjType::BOUND_METHOD}}, std::move(receiver), method};
+    ++method->refcount;
+    Heap::current().track(bound, sizeof(ObjBoundMethod));
+    return bound;
+}
+
+Value getPropertyMiss(const Value& object, std::uint32_t symbol, InlineCache& cache)
+{
+    if(!object.isObject(ObjType::INSTANCE))
+    {
+        throw std::runtime_error("Only instances have properties.");
+    }
+    auto* instance = static_cast<ObjInstance*>(object.asObject());
+    Shape* shape   = instance->shape;
+    int    slot    = shape->find(symbol);
+    if(slot >= 0)
+    {
+        cache.add({shape->id, slot, nullptr, shape});
+        return instance->fields[slot];
+    }
+    // Methods never change once the class is declared, so the shape, which
+    // belongs to one class, also pins down the method.
+    if(ObjClosure* method = findMethod(instance->klass, symbol))
+    {
+        cache.add({shape->id, -1, method, shape});
+        return Value::adoptObject(ObjBoundMethod::create(object, method));
+    }
+    undefinedProperty(symbol);
+}
+
+void setPropertyMiss(const Value& object, std::uint32_t symbol, Value value, InlineCache& cache)
+{
+    if(!object.isObject(ObjType::INSTANCE))
+    {
+        throw std::runtime_error("Only instances have fields.");
+    }
+    auto* instance = static_cast<ObjInstance*>(object.asObject());
+    Shape* shape   = instance->shape;
+    int    slot    = shape->find(symbol);
+    if(slot >= 0)
+    {
+        cache.add({shape->id, slot, nullptr, shape});
+        instance->fields[slot] = std::move(value);
+        return;
+    }
+    Shape* next = shape->add(symbol);
+    cache.add({shape->id, static_cast<std::int32_t>(shape->count), nullptr, next});
+    instance->fields.push_back(std::move(value));
+    instance->shape = next;
+}
+
+ObjClosure* prepareInvokeMiss(Value* base, int argc, std::uint32_t symbol, InlineCache& cache)
+{
+    if(!base->isObject(ObjType::INSTANCE))
+    {
+        throw std::runtime_error("Only instances have properties.");
+    }
+    auto* instance = static_cast<ObjInstance*>(base->asObject());
+    Shape* shape   = instance->shape;
+    int    slot    = shape->find(symbol);
+    if(slot >= 0)
+    {
+        // A field holding something callable: call that instead. Not cached,
+        // since the fast path only handles methods.
+        *base = instance->fields[slot];
+        return prepareCall(base, argc);
+    }
+    ObjClosure* method = findMethod(instance->klass, symbol);
+    if(!method)
+    {
+        undefinedProperty(symbol);
+    }
+    cache.add({shape->id, -1, method, shape});
+    if(argc != method->function->arity)
+    {
+        arityError(method->function->arity, argc);
+    }
+    return method;
+}
+
+ObjClosure* prepareCall(Value* base, int argc)
+{
+    if(base->isObject())
+    {
+        switch(base->asObject()->type)
+        {
+            case ObjType::CLOSURE:
+            {
+                auto* closure = static_cast<ObjClosure*>(base->asObject());
+                if(argc != closure->function->arity)
+                {
+                    arityError(closure->function->arity, argc);
+                }
+                return closure;
+            }
+            case ObjType::BOUND_METHOD:
+            {
+                // The method stays alive once the bound method is gone: it is
+                // held by the receiver's class, or for super.name by the
+                // superclass the calling method captured.
+                auto*       bound  = static_cast<ObjBoundMethod*>(base->asObject());
+                ObjClosure* method = bound->method;
+                if(argc != method->function->arity)
+                {
+                    arityError(method->function->arity, argc);
+                }
+                *base = Value(bound->receiver);
+                return method;
+            }
+            case ObjType::CLASS:
+            {
+                auto*       klass       = static_cast<ObjClass*>(base->asObject());
+                ObjClosure* initializer = klass->initializer;
+                int         arity       = initializer ? initializer->function->arity : 0;
+                if(argc != arity)
+                {
+                    arityError(arity, argc);
+                }
+                // The instance holds the class, and with it the initializer.
+                *base = Value::adoptObject(ObjInstance::create(klass));
+                return initializer;
+            }
+            case ObjType::NATIVE:
+            {
+                auto* native = static_cast<ObjNative*>(base->asObject());
+                if(argc != native->arity)
+                {
+                    arityError(native->arity, argc);
+                }
+                *base = native->function(base + 1, argc);
+                return nullptr;
+            }
+            default: break;
+        }
+    }
+    throw std::runtime_error("Can only call functions and classes.");
+}
+
+Value getSuperMethod(const Value& receiver, const Value& superclass, std::uint32_t symbol)
+{
+    ObjClosure* method = findMethod(static_cast<const ObjClass*>(superclass.asObject()), symbol);
+    if(!method)
+    {
+        undefinedProperty(symbol);
+    }
+    return Value::adoptObject(ObjBoundMethod::create(receiver, method));
+}
+
+void inherit(ObjClass* klass, const Value& superclass)
+{
+    if(!superclass.isObject(ObjType::CLASS))
+    {
+        throw std::runtime_error("Superclass must be a class.");
+    }
+    auto* parent       = static_cast<const ObjClass*>(superclass.asObject());
+    klass->methods     = parent->methods;
+    klass->initializer = parent->initializer;
+}
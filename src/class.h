@@ -0,0 +1,126 @@
+#ifndef CLASS_H
+#define CLASS_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "function.h"
+#include "heap.h"
+#include "shape.h"
+#include "value.h"
+
+struct ObjClass : GcObject
+{
+    Value name; // a string
+    // Methods by symbol id, including inherited ones, which are copied in
+    // when the class is declared.
+    std::unordered_map<std::uint32_t, Value> methods;
+    ObjClosure*                              initializer = nullptr; // methods["init"], if any
+    Shape                                    root;
+
+    // Returns a class holding one reference.
+    static ObjClass* create(Value name);
+
+    void defineMethod(std::uint32_t symbol, Value method);
+};
+
+struct ObjInstance : GcObject
+{
+    ObjClass*          klass; // holds a reference
+    Shape*             shape;
+    std::vector<Value> fields; // by shape slot
+
+    // Returns an instance holding one reference.
+    static ObjInstance* create(ObjClass* klass);
+};
+
+// A method read as a property, remembering the instance it was read from.
+struct ObjBoundMethod : GcObject
+{
+    Value       receiver;
+    ObjClosure* method; // holds a reference
+
+    // Returns a bound method holding one reference, and adds one to method.
+    static ObjBoundMethod* create(Value receiver, ObjClosure* method);
+};
+
+// The slow paths of the property operations, which also fill the caches.
+Value       getPropertyMiss(const Value& object, std::uint32_t symbol, InlineCache& cache);
+void        setPropertyMiss(const Value& object, std::uint32_t symbol, Value value, InlineCache& cache);
+ObjClosure* prepareInvokeMiss(Value* base, int argc, std::uint32_t symbol, InlineCache& cache);
+
+// object.name. Throws std::runtime_error if object is not an instance or
+// has no such field or method.
+inline Value getProperty(const Value& object, std::uint32_t symbol, InlineCache& cache)
+{
+    if(object.isObject(ObjType::INSTANCE))
+    {
+        auto* instance = static_cast<ObjInstance*>(object.asObject());
+        if(const InlineCache::Entry* entry = cache.find(instance->shape->id))
+        {
+            if(entry->slot >= 0)
+            {
+                return instance->fields[entry->slot];
+            }
+            return Value::adoptObject(ObjBoundMethod::create(object, entry->method));
+        }
+    }
+    return getPropertyMiss(object, symbol, cache);
+}
+
+// object.name = value. Throws std::runtime_error if object is not an
+// instance.
+inline void setProperty(const Value& object, std::uint32_t symbol, Value value, InlineCache& cache)
+{
+    if(object.isObject(ObjType::INSTANCE))
+    {
+        auto* instance = static_cast<ObjInstance*>(object.asObject());
+        if(const InlineCache::Entry* entry = cache.find(instance->shape->id))
+        {
+            if(static_cast<std::size_t>(entry->slot) < instance->fields.size())
+            {
+                instance->fields[entry->slot] = std::move(value);
+            }
+            else
+            {
+                instance->fields.push_back(std::move(value));
+                instance->shape = entry->next;
+            }
+            return;
+        }
+    }
+    setPropertyMiss(object, symbol, std::move(value), cache);
+}
+
+// Prepares receiver.name(args) for base[0] = receiver followed by argc
+// arguments, without creating a bound method. Returns the method to run
+// with base as its frame; or, when name is a field, replaces base[0] with
+// the field's value and calls that as prepareCall does.
+inline ObjClosure* prepareInvoke(Value* base, int argc, std::uint32_t symbol, InlineCache& cache)
+{
+    if(base->isObject(ObjType::INSTANCE))
+    {
+        auto* instance = static_cast<ObjInstance*>(base->asObject());
+        const InlineCache::Entry* entry = cache.find(instance->shape->id);
+        if(entry && entry->slot < 0)
+        {
+            if(argc != entry->method->function->arity)
+            {
+                arityError(entry->method->function->arity, argc);
+            }
+            return entry->method;
+        }
+    }
+    return prepareInvokeMiss(base, argc, symbol, cache);
+}
+
+// super.name, bound to receiver. Throws std::runtime_error if superclass
+// has no such method.
+Value getSuperMethod(const Value& receiver, const Value& superclass, std::uint32_t symbol);
+
+// Copies superclass's methods into klass, after checking that superclass
+// is a class.
+void inherit(ObjClass* klass, const Value& superclass);
+
+#endif // CLASS_H
@@ -0,0 +1,628 @@
+#include "closure_compiler.h"
+
+namespace
+{
+// The node types. Each run function knows which type its node is, so it
+// casts self back; most are captureless lambdas written where the node is
+// made, chosen there by operator, operand kinds and where variables live.
+
+struct Constant : CompiledExpression
+{
+    Value value;
+};
+
+// A local slot, an upvalue index or a global slot.
+struct VariableNode : CompiledExpression
+{
+    int slot;
+};
+
+struct AssignNode : VariableNode
+{
+    CompiledExpression* value;
+};
+
+struct BinaryNode : CompiledExpression
+{
+    CompiledExpression* left;
+    CompiledExpression* right;
+};
+
+// A binary operation whose right operand is a number literal, as in i + 1
+// or i < n.
+struct ConstantRightNode : CompiledExpression
+{
+    CompiledExpression* left;
+    double              right;
+};
+
+struct UnaryNode : CompiledExpression
+{
+    CompiledExpression* right;
+};
+
+struct CallNode : CompiledExpression
+{
+    CompiledExpression*            callee; // the receiver for an invoke
+    std::span<CompiledExpression*> arguments;
+    std::uint32_t                  symbol = 0;
+    InlineCache                    cache  = {};
+};
+
+struct PropertyNode : CompiledExpression
+{
+    CompiledExpression* object;
+    CompiledExpression* value; // for a set
+    std::uint32_t       symbol;
+    InlineCache         cache = {};
+};
+
+struct SuperNode : CompiledExpression
+{
+    VariableRef   superclass;
+    VariableRef   receiver;
+    std::uint32_t symbol;
+};
+
+struct ExpressionStatementNode : CompiledStatement
+{
+    CompiledExpression* expression; // nullptr for a var without initializer
+    int                 slot;
+};
+
+struct SequenceNode : CompiledStatement
+{
+    std::span<CompiledStatement*> statements;
+    int                           close_slot;
+};
+
+struct BranchNode : CompiledStatement
+{
+    CompiledExpression* condition;
+    CompiledStatement*  then_branch; // the body of a while
+    CompiledStatement*  else_branch;
+};
+
+// Function and class declarations, which run as in the tree walker.
+template <typename Declaration>
+struct DeclarationNode : CompiledStatement
+{
+    Declaration* declaration;
+};
+
+template <BinaryOp op>
+Value numberOperation(double a, double b)
+{
+    switch(op)
+    {
+        case BinaryOp::ADD: return Value::number(a + b);
+        case BinaryOp::SUBTRACT: return Value::number(a - b);
+        case BinaryOp::MULTIPLY: return Value::number(a * b);
+        case BinaryOp::DIVIDE: return Value::number(a / b);
+        case BinaryOp::EQUAL: return Value::boolean(a == b);
+        case BinaryOp::NOT_EQUAL: return Value::boolean(a != b);
+        case BinaryOp::GREATER: return Value::boolean(a > b);
+        case BinaryOp::GREATER_EQUAL: return Value::boolean(a >= b);
+        case BinaryOp::LESS: return Value::boolean(a < b);
+        case BinaryOp::LESS_EQUAL: return Value::boolean(a <= b);
+    }
+    return Value::nil();
+}
+
+// Both operands are known to produce numbers.
+template <BinaryOp op>
+struct NumberBinary
+{
+    static Value run(CompiledExpression* self, Environment& env)
+    {
+        auto*  node = static_cast<BinaryNode*>(self);
+        double a    = (*node->left)(env).asNumber();
+        double b    = (*node->right)(env).asNumber();
+        return numberOperation<op>(a, b);
+    }
+};
+
+// Numbers are checked for inline; anything else goes to the shared
+// semantics.
+template <BinaryOp op>
+struct AnyBinary
+{
+    static Value run(CompiledExpression* self, Environment& env)
+    {
+        auto* node  = static_cast<BinaryNode*>(self);
+        Value left  = (*node->left)(env);
+        Value right = (*node->right)(env);
+        if(left.isNumber() && right.isNumber())
+        {
+            return numberOperation<op>(left.asNumber(), right.asNumber());
+        }
+        return binaryOperation(op, left, right);
+    }
+};
+
+template <BinaryOp op>
+struct ConstantRightBinary
+{
+    static Value run(CompiledExpression* self, Environment& env)
+    {
+        auto* node = static_cast<ConstantRightNode*>(self);
+        Value left = (*node->left)(env);
+        if(left.isNumber())
+        {
+            return numberOperation<op>(left.asNumber(), node->right);
+        }
+        return binaryOperation(op, left, Value::number(node->right));
+    }
+};
+
+template <template <BinaryOp> typename Kind>
+CompiledExpression::Run binaryRun(BinaryOp op)
+{
+    switch(op)
+    {
+        case BinaryOp::ADD: return Kind<BinaryOp::ADD>::run;
+        case BinaryOp::SUBTRACT: return Kind<BinaryOp::SUBTRACT>::run;
+        case BinaryOp::MULTIPLY: return Kind<BinaryOp::MULTIPLY>::run;
+        case BinaryOp::DIVIDE: return Kind<BinaryOp::DIVIDE>::run;
+        case BinaryOp::EQUAL: return Kind<BinaryOp::EQUAL>::run;
+        case BinaryOp::NOT_EQUAL: return Kind<BinaryOp::NOT_EQUAL>::run;
+        case BinaryOp::GREATER: return Kind<BinaryOp::GREATER>::run;
+        case BinaryOp::GREATER_EQUAL: return Kind<BinaryOp::GREATER_EQUAL>::run;
+        case BinaryOp::LESS: return Kind<BinaryOp::LESS>::run;
+        case BinaryOp::LESS_EQUAL: return Kind<BinaryOp::LESS_EQUAL>::run;
+    }
+    return nullptr;
+}
+
+// Pushes the callee (or receiver) and arguments as the tree walker does,
+// returning the base of the new frame.
+Value* pushCall(CallNode* node, Environment& env)
+{
+    Value* base = env.top;
+    if(env.stackEnd() - base <= static_cast<std::ptrdiff_t>(node->arguments.size()))
+    {
+        Environment::stackOverflow();
+    }
+    Value callee = (*node->callee)(env);
+    *env.top++   = std::move(callee);
+    for(CompiledExpression* argument: node->arguments)
+    {
+        Value value = (*argument)(env);
+        *env.top++  = std::move(value);
+    }
+    return base;
+}
+
+Flow runSequence(SequenceNode* node, Environment& env)
+{
+    for(CompiledStatement* stmt: node->statements)
+    {
+        if((*stmt)(env) == Flow::RETURN)
+        {
+            return Flow::RETURN;
+        }
+    }
+    return Flow::NEXT;
+}
+} // namespace
+
+CompiledExpression* ClosureCompiler::compile(Expression* expr)
+{
+    Produces ignored;
+    return compile(expr, ignored);
+}
+
+CompiledExpression* ClosureCompiler::compile(Expression* expr, Produces& kind)
+{
+    expr->accept(*this);
+    kind = produces;
+    return expression;
+}
+
+CompiledStatement* ClosureCompiler::compile(Statement* stmt)
+{
+    stmt->accept(*this);
+    return statement;
+}
+
+std::span<CompiledExpression*> ClosureCompiler::compileAll(std::span<Expression*> exprs)
+{
+    auto* compiled = static_cast<CompiledExpression**>(
+        arena.allocate(exprs.size() * sizeof(CompiledExpression*), alignof(CompiledExpression*)));
+    for(std::size_t i = 0; i < exprs.size(); ++i)
+    {
+        compiled[i] = compile(exprs[i]);
+    }
+    return {compiled, exprs.size()};
+}
+
+CompiledStatement* ClosureCompiler::compileBody(std::span<Statement* const> body)
+{
+    auto* compiled = static_cast<CompiledStatement**>(
+        arena.allocate(body.size() * sizeof(CompiledStatement*), alignof(CompiledStatement*)));
+    for(std::size_t i = 0; i < body.size(); ++i)
+    {
+        compiled[i] = compile(body[i]);
+    }
+    auto run = [](CompiledStatement* self, Environment& env)
+    { return runSequence(static_cast<SequenceNode*>(self), env); };
+    return arena.make<SequenceNode>(CompiledStatement{run}, std::span(compiled, body.size()), -1);
+}
+
+void ClosureCompiler::visitBinary(Binary& expr)
+{
+    Produces left_kind;
+    Produces right_kind;
+    CompiledExpression* left  = compile(expr.left, left_kind);
+    CompiledExpression* right = compile(expr.right, right_kind);
+    bool arithmetic = expr.operation == BinaryOp::ADD || expr.operation == BinaryOp::SUBTRACT ||
+                      expr.operation == BinaryOp::MULTIPLY || expr.operation == BinaryOp::DIVIDE;
+    bool numbers = left_kind == Produces::NUMBER && right_kind == Produces::NUMBER;
+
+    // Anything but + either gives a number or fails; + gives one when both
+    // operands do.
+    produces = !arithmetic ? Produces::BOOL
+               : expr.operation != BinaryOp::ADD || numbers ? Produces::NUMBER
+                                                            : Produces::ANY;
+    auto* literal = dynamic_cast<NumberLiteral*>(expr.right);
+    if(numbers)
+    {
+        expression = arena.make<BinaryNode>(CompiledExpression{binaryRun<NumberBinary>(expr.operation)}, left, right);
+    }
+    else if(literal)
+    {
+        expression = arena.make<ConstantRightNode>(CompiledExpression{binaryRun<ConstantRightBinary>(expr.operation)},
+                                                   left, literal->number);
+    }
+    else
+    {
+        expression = arena.make<BinaryNode>(CompiledExpression{binaryRun<AnyBinary>(expr.operation)}, left, right);
+    }
+}
+
+void ClosureCompiler::visitUnary(Unary& expr)
+{
+    Produces            kind;
+    CompiledExpression* right = compile(expr.right, kind);
+    CompiledExpression::Run run;
+    if(expr.op.token_type == TokenType::BANG)
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        { return Value::boolean(!(*static_cast<UnaryNode*>(self)->right)(env).isTruthy()); };
+        produces = Produces::BOOL;
+    }
+    else
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        {
+            Value value = (*static_cast<UnaryNode*>(self)->right)(env);
+            if(value.isNumber())
+            {
+                return Value::number(-value.asNumber());
+            }
+            return unaryOperation(TokenType::MINUS, value);
+        };
+        produces = Produces::NUMBER;
+    }
+    expression = arena.make<UnaryNode>(CompiledExpression{run}, right);
+}
+
+void ClosureCompiler::visitLiteral(Literal& expr)
+{
+    Value value = expr.constant();
+    produces    = value.isNumber() ? Produces::NUMBER : value.isBool() ? Produces::BOOL : Produces::ANY;
+    auto run    = [](CompiledExpression* self, Environment&) { return static_cast<Constant*>(self)->value; };
+    expression  = arena.make<Constant>(CompiledExpression{run}, std::move(value));
+}
+
+void ClosureCompiler::visitGrouping(Grouping& expr)
+{
+    expression = compile(expr.expression, produces);
+}
+
+void ClosureCompiler::visitVariable(Variable& expr)
+{
+    compileVariable(expr.variable);
+}
+
+void ClosureCompiler::compileVariable(const VariableRef& variable)
+{
+    CompiledExpression::Run run;
+    if(variable.depth < 0)
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        { return env.global(static_cast<VariableNode*>(self)->slot); };
+    }
+    else if(variable.depth == 0)
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        { return env.local(static_cast<VariableNode*>(self)->slot); };
+    }
+    else
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        { return env.upvalue(static_cast<VariableNode*>(self)->slot); };
+    }
+    produces   = Produces::ANY;
+    expression = arena.make<VariableNode>(CompiledExpression{run}, variable.slot);
+}
+
+void ClosureCompiler::visitAssign(Assign& expr)
+{
+    const VariableRef&  variable = expr.variable;
+    CompiledExpression* value    = compile(expr.value, produces);
+    CompiledExpression::Run run;
+    if(variable.depth < 0)
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        {
+            auto* node   = static_cast<AssignNode*>(self);
+            Value result = (*node->value)(env);
+            env.assignGlobal(node->slot, result);
+            return result;
+        };
+    }
+    else if(variable.depth == 0)
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        {
+            auto* node   = static_cast<AssignNode*>(self);
+            Value result = (*node->value)(env);
+            env.local(node->slot) = result;
+            return result;
+        };
+    }
+    else
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        {
+            auto* node   = static_cast<AssignNode*>(self);
+            Value result = (*node->value)(env);
+            env.upvalue(node->slot) = result;
+            return result;
+        };
+    }
+    expression = arena.make<AssignNode>(VariableNode{{run}, variable.slot}, value);
+}
+
+void ClosureCompiler::visitLogical(Logical& expr)
+{
+    Produces            left_kind;
+    Produces            right_kind;
+    CompiledExpression* left  = compile(expr.left, left_kind);
+    CompiledExpression* right = compile(expr.right, right_kind);
+    CompiledExpression::Run run;
+    if(expr.op == TokenType::AND)
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        {
+            auto* node   = static_cast<BinaryNode*>(self);
+            Value result = (*node->left)(env);
+            return result.isTruthy() ? (*node->right)(env) : result;
+        };
+    }
+    else
+    {
+        run = [](CompiledExpression* self, Environment& env)
+        {
+            auto* node   = static_cast<BinaryNode*>(self);
+            Value result = (*node->left)(env);
+            return result.isTruthy() ? result : (*node->right)(env);
+        };
+    }
+    produces   = left_kind == right_kind ? left_kind : Produces::ANY;
+    expression = arena.make<BinaryNode>(CompiledExpression{run}, left, right);
+}
+
+void ClosureCompiler::visitCall(Call& expr)
+{
+    CompiledExpression* callee    = compile(expr.callee);
+    auto                arguments = compileAll(expr.arguments);
+    auto run = [](CompiledExpression* self, Environment& env)
+    {
+        auto*  node = static_cast<CallNode*>(self);
+        Value* base = pushCall(node, env);
+        int    argc = static_cast<int>(node->arguments.size());
+        return completeCall(env, prepareCall(base, argc), base);
+    };
+    produces   = Produces::ANY;
+    expression = arena.make<CallNode>(CompiledExpression{run}, callee, arguments);
+}
+
+void ClosureCompiler::visitGet(Get& expr)
+{
+    CompiledExpression* object = compile(expr.object);
+    auto run = [](CompiledExpression* self, Environment& env)
+    {
+        auto* node = static_cast<PropertyNode*>(self);
+        return getProperty((*node->object)(env), node->symbol, node->cache);
+    };
+    produces   = Produces::ANY;
+    expression = arena.make<PropertyNode>(CompiledExpression{run}, object, nullptr, expr.symbol);
+}
+
+void ClosureCompiler::visitSet(Set& expr)
+{
+    CompiledExpression* object = compile(expr.object);
+    CompiledExpression* value  = compile(expr.value, produces);
+    auto run = [](CompiledExpression* self, Environment& env)
+    {
+        auto* node   = static_cast<PropertyNode*>(self);
+        Value target = (*node->object)(env);
+        Value result = (*node->value)(env);
+        setProperty(target, node->symbol, result, node->cache);
+        return result;
+    };
+    expression = arena.make<PropertyNode>(CompiledExpression{run}, object, value, expr.symbol);
+}
+
+void ClosureCompiler::visitThis(This& expr)
+{
+    compileVariable(expr.variable);
+}
+
+void ClosureCompiler::visitSuper(Super& expr)
+{
+    auto run = [](CompiledExpression* self, Environment& env)
+    {
+        auto* node = static_cast<SuperNode*>(self);
+        Value methods = variableValue(env, node->superclass);
+        return getSuperMethod(variableValue(env, node->receiver), methods, node->symbol);
+    };
+    produces   = Produces::ANY;
+    expression = arena.make<SuperNode>(CompiledExpression{run}, expr.superclass, expr.receiver, expr.symbol);
+}
+
+void ClosureCompiler::visitInvoke(Invoke& expr)
+{
+    CompiledExpression* object    = compile(expr.object);
+    auto                arguments = compileAll(expr.arguments);
+    auto run = [](CompiledExpression* self, Environment& env)
+    {
+        auto*  node = static_cast<CallNode*>(self);
+        Value* base = pushCall(node, env);
+        int    argc = static_cast<int>(node->arguments.size());
+        return completeCall(env, prepareInvoke(base, argc, node->symbol, node->cache), base);
+    };
+    produces   = Produces::ANY;
+    expression = arena.make<CallNode>(CompiledExpression{run}, object, arguments, expr.symbol);
+}
+
+void ClosureCompiler::visitPrint(PrintStatement& stmt)
+{
+    auto run = [](CompiledStatement* self, Environment& env)
+    {
+        printValue(env.out, (*static_cast<ExpressionStatementNode*>(self)->expression)(env));
+        env.out << '\n';
+        return Flow::NEXT;
+    };
+    statement = arena.make<ExpressionStatementNode>(CompiledStatement{run}, compile(stmt.expression), 0);
+}
+
+void ClosureCompiler::visitExpression(ExpressionStatement& stmt)
+{
+    auto run = [](CompiledStatement* self, Environment& env)
+    {
+        (*static_cast<ExpressionStatementNode*>(self)->expression)(env);
+        return Flow::NEXT;
+    };
+    statement = arena.make<ExpressionStatementNode>(CompiledStatement{run}, compile(stmt.expression), 0);
+}
+
+void ClosureCompiler::visitVar(VarStatement& stmt)
+{
+    CompiledExpression* initializer = stmt.initializer ? compile(stmt.initializer) : nullptr;
+    CompiledStatement::Run run;
+    if(stmt.variable.depth < 0)
+    {
+        run = [](CompiledStatement* self, Environment& env)
+        {
+            auto* node = static_cast<ExpressionStatementNode*>(self);
+            env.defineGlobal(node->slot, node->expression ? (*node->expression)(env) : Value::nil());
+            return Flow::NEXT;
+        };
+    }
+    else
+    {
+        run = [](CompiledStatement* self, Environment& env)
+        {
+            auto* node = static_cast<ExpressionStatementNode*>(self);
+            env.local(node->slot) = node->expression ? (*node->expression)(env) : Value::nil();
+            return Flow::NEXT;
+        };
+    }
+    statement = arena.make<ExpressionStatementNode>(CompiledStatement{run}, initializer, stmt.variable.slot);
+}
+
+void ClosureCompiler::visitBlock(BlockStatement& stmt)
+{
+    auto* block = static_cast<SequenceNode*>(compileBody(stmt.statements));
+    if(stmt.close_slot >= 0)
+    {
+        block->close_slot = stmt.close_slot;
+        block->run        = [](CompiledStatement* self, Environment& env)
+        {
+            auto* node = static_cast<SequenceNode*>(self);
+            Flow  flow = runSequence(node, env);
+            env.closeUpvalues(env.frame + node->close_slot);
+            return flow;
+        };
+    }
+    statement = block;
+}
+
+void ClosureCompiler::visitIf(IfStatement& stmt)
+{
+    CompiledExpression* condition   = compile(stmt.condition);
+    CompiledStatement*  then_branch = compile(stmt.then_branch);
+    CompiledStatement*  else_branch = stmt.else_branch ? compile(stmt.else_branch) : nullptr;
+    CompiledStatement::Run run;
+    if(else_branch)
+    {
+        run = [](CompiledStatement* self, Environment& env)
+        {
+            auto* node = static_cast<BranchNode*>(self);
+            return (*node->condition)(env).isTruthy() ? (*node->then_branch)(env) : (*node->else_branch)(env);
+        };
+    }
+    else
+    {
+        run = [](CompiledStatement* self, Environment& env)
+        {
+            auto* node = static_cast<BranchNode*>(self);
+            return (*node->condition)(env).isTruthy() ? (*node->then_branch)(env) : Flow::NEXT;
+        };
+    }
+    statement = arena.make<BranchNode>(CompiledStatement{run}, condition, then_branch, else_branch);
+}
+
+void ClosureCompiler::visitWhile(WhileStatement& stmt)
+{
+    CompiledExpression* condition = compile(stmt.condition);
+    CompiledStatement*  body      = compile(stmt.body);
+    auto run = [](CompiledStatement* self, Environment& env)
+    {
+        auto* node = static_cast<BranchNode*>(self);
+        while((*node->condition)(env).isTruthy())
+        {
+            if((*node->then_branch)(env) == Flow::RETURN)
+            {
+                return Flow::RETURN;
+            }
+            env.checkInterrupt();
+        }
+        return Flow::NEXT;
+    };
+    statement = arena.make<BranchNode>(CompiledStatement{run}, condition, body, nullptr);
+}
+
+void ClosureCompiler::visitFunction(FunctionStatement& stmt)
+{
+    stmt.compiled = compileBody(stmt.body);
+    auto run      = [](CompiledStatement* self, Environment& env)
+    { return static_cast<DeclarationNode<FunctionStatement>*>(self)->declaration->execute(env); };
+    statement = arena.make<DeclarationNode<FunctionStatement>>(CompiledStatement{run}, &stmt);
+}
+
+void ClosureCompiler::visitReturn(ReturnStatement& stmt)
+{
+    auto run = [](CompiledStatement* self, Environment& env)
+    {
+        auto* node   = static_cast<ExpressionStatementNode*>(self);
+        env.returned = node->expression ? (*node->expression)(env) : Value::nil();
+        return Flow::RETURN;
+    };
+    CompiledExpression* value = stmt.value ? compile(stmt.value) : nullptr;
+    statement = arena.make<ExpressionStatementNode>(CompiledStatement{run}, value, 0);
+}
+
+void ClosureCompiler::visitClass(ClassStatement& stmt)
+{
+    for(FunctionStatement* method: stmt.methods)
+    {
+        method->compiled = compileBody(method->body);
+    }
+    auto run = [](CompiledStatement* self, Environment& env)
+    { return static_cast<DeclarationNode<ClassStatement>*>(self)->declaration->execute(env); };
+    statement = arena.make<DeclarationNode<ClassStatement>>(CompiledStatement{run}, &stmt);
+}
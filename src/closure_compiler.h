@@ -0,0 +1,90 @@
+#ifndef CLOSURE_COMPILER_H
+#define CLOSURE_COMPILER_H
+
+#include "arena.h"
+#include "parser.h"
+
+// The closure engine: a middle tier between the tree walker and the VM. The
+// tree is compiled once into nodes that each pair a function with operands
+// that are already resolved: which operator, which kinds of operand, which
+// slot or constant. Running a node is one indirect call that re-examines
+// none of that. The nodes live in the arena of the tree they came from.
+struct CompiledExpression
+{
+    using Run = Value (*)(CompiledExpression* self, Environment& env);
+    Run run;
+
+    Value operator()(Environment& env)
+    {
+        return run(this, env);
+    }
+};
+
+struct CompiledStatement
+{
+    using Run = Flow (*)(CompiledStatement* self, Environment& env);
+    Run run;
+
+    Flow operator()(Environment& env)
+    {
+        return run(this, env);
+    }
+};
+
+// Compiles a resolved (and possibly optimized) tree. Function and method
+// bodies are compiled along with their declarations and stored in
+// FunctionStatement::compiled, where calls find them.
+class ClosureCompiler : private ExpressionVisitor, private StatementVisitor
+{
+public:
+    explicit ClosureCompiler(Arena& arena) : arena(arena) {}
+
+    CompiledExpression* compile(Expression* expr);
+    CompiledStatement*  compile(Statement* stmt);
+
+private:
+    // How an expression's kind is known at compile time.
+    enum class Produces : std::uint8_t
+    {
+        ANY,
+        NUMBER,
+        BOOL
+    };
+
+    CompiledExpression* compile(Expression* expr, Produces& produces);
+    std::span<CompiledExpression*> compileAll(std::span<Expression*> exprs);
+    CompiledStatement* compileBody(std::span<Statement* const> body);
+    // Reads of variables and of this.
+    void compileVariable(const VariableRef& variable);
+
+    void visitBinary(Binary& expr) override;
+    void visitUnary(Unary& expr) override;
+    void visitLiteral(Literal& expr) override;
+    void visitGrouping(Grouping& expr) override;
+    void visitVariable(Variable& expr) override;
+    void visitAssign(Assign& expr) override;
+    void visitLogical(Logical& expr) override;
+    void visitCall(Call& expr) override;
+    void visitGet(Get& expr) override;
+    void visitSet(Set& expr) override;
+    void visitThis(This& expr) override;
+    void visitSuper(Super& expr) override;
+    void visitInvoke(Invoke& expr) override;
+
+    void visitPrint(PrintStatement& stmt) override;
+    void visitExpression(ExpressionStatement& stmt) override;
+    void visitVar(VarStatement& stmt) override;
+    void visitBlock(BlockStatement& stmt) override;
+    void visitIf(IfStatement& stmt) override;
+    void visitWhile(WhileStatement& stmt) override;
+    void visitFunction(FunctionStatement& stmt) override;
+    void visitReturn(ReturnStatement& stmt) override;
+    void visitClass(ClassStatement& stmt) override;
+
+    Arena&              arena;
+    CompiledExpression* expression = nullptr;
+    Produces            produces   = Produces::ANY;
+    CompiledStatement*  statement  = nullptr;
+};
+
+#endif // CLOSURE_COMPILER_H
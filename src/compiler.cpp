@@ -0,0 +1,395 @@
+#include "compiler.h"
+#include "function.h"
+#include "intern.h"
+#include <algorithm>
+#include <stdexcept>
+
+void Compiler::expressionStatement(Expression* expr, bool print)
+{
+    expr->accept(*this);
+    emit(print ? OpCode::PRINT : OpCode::POP, -1);
+}
+
+void Compiler::statement(Statement* stmt)
+{
+    stmt->accept(*this);
+}
+
+void Compiler::finish()
+{
+    emit(OpCode::RETURN, 0);
+}
+
+void Compiler::visitBinary(Binary& expr)
+{
+    expr.left->accept(*this);
+    expr.right->accept(*this);
+    switch(expr.operation)
+    {
+        case BinaryOp::ADD: emit(OpCode::ADD, -1); break;
+        case BinaryOp::SUBTRACT: emit(OpCode::SUBTRACT, -1); break;
+        case BinaryOp::MULTIPLY: emit(OpCode::MULTIPLY, -1); break;
+        case BinaryOp::DIVIDE: emit(OpCode::DIVIDE, -1); break;
+        case BinaryOp::EQUAL: emit(OpCode::EQUAL, -1); break;
+        case BinaryOp::NOT_EQUAL: emit(OpCode::NOT_EQUAL, -1); break;
+        case BinaryOp::GREATER: emit(OpCode::GREATER, -1); break;
+        case BinaryOp::GREATER_EQUAL: emit(OpCode::GREATER_EQUAL, -1); break;
+        case BinaryOp::LESS: emit(OpCode::LESS, -1); break;
+        case BinaryOp::LESS_EQUAL: emit(OpCode::LESS_EQUAL, -1); break;
+    }
+}
+
+void Compiler::visitUnary(Unary& expr)
+{
+    expr.right->accept(*this);
+    emit(expr.op.token_type == TokenType::MINUS ? OpCode::NEGATE : OpCode::NOT, 0);
+}
+
+void Compiler::visitLiteral(Literal& expr)
+{
+    emitConstant(expr.constant());
+}
+
+void Compiler::visitGrouping(Grouping& expr)
+{
+    expr.expression->accept(*this);
+}
+
+void Compiler::visitVariable(Variable& expr)
+{
+    emitVariable(expr.variable, Access::GET);
+}
+
+void Compiler::visitAssign(Assign& expr)
+{
+    expr.value->accept(*this);
+    emitVariable(expr.variable, Access::SET);
+}
+
+// The left operand stays on the stack as the result if it decides it.
+void Compiler::visitLogical(Logical& expr)
+{
+    expr.left->accept(*this);
+    std::size_t end = emitJump(expr.op == TokenType::AND ? OpCode::JUMP_IF_FALSE : OpCode::JUMP_IF_TRUE, 0);
+    emit(OpCode::POP, -1);
+    expr.right->accept(*this);
+    patchJump(end);
+}
+
+void Compiler::visitCall(Call& expr)
+{
+    expr.callee->accept(*this);
+    for(Expression* argument: expr.arguments)
+    {
+        argument->accept(*this);
+    }
+    int argc = static_cast<int>(expr.arguments.size());
+    emit(OpCode::CALL, -argc);
+    chunk.write(static_cast<std::uint8_t>(argc));
+}
+
+void Compiler::visitGet(Get& expr)
+{
+    expr.object->accept(*this);
+    emit(OpCode::GET_PROPERTY, 0);
+    emitU24(expr.symbol);
+    emitCache();
+}
+
+void Compiler::visitSet(Set& expr)
+{
+    expr.object->accept(*this);
+    expr.value->accept(*this);
+    emit(OpCode::SET_PROPERTY, -1);
+    emitU24(expr.symbol);
+    emitCache();
+}
+
+void Compiler::visitThis(This& expr)
+{
+    emitVariable(expr.variable, Access::GET);
+}
+
+void Compiler::visitSuper(Super& expr)
+{
+    // 'super' before 'this', as the other engines look them up.
+    emitVariable(expr.superclass, Access::GET);
+    emitVariable(expr.receiver, Access::GET);
+    emit(OpCode::GET_SUPER, -1);
+    emitU24(expr.symbol);
+}
+
+void Compiler::visitInvoke(Invoke& expr)
+{
+    expr.object->accept(*this);
+    for(Expression* argument: expr.arguments)
+    {
+        argument->accept(*this);
+    }
+    int argc = static_cast<int>(expr.arguments.size());
+    emit(OpCode::INVOKE, -argc);
+    emitU24(expr.symbol);
+    chunk.write(static_cast<std::uint8_t>(argc));
+    emitCache();
+}
+
+void Compiler::visitPrint(PrintStatement& stmt)
+{
+    expressionStatement(stmt.expression, true);
+}
+
+void Compiler::visitExpression(ExpressionStatement& stmt)
+{
+    expressionStatement(stmt.expression, false);
+}
+
+void Compiler::visitVar(VarStatement& stmt)
+{
+    if(stmt.initializer)
+    {
+        stmt.initializer->accept(*this);
+    }
+    else
+    {
+        emit(OpCode::NIL, 1);
+    }
+    emitVariable(stmt.variable, Access::DEFINE);
+}
+
+void Compiler::visitBlock(BlockStatement& stmt)
+{
+    for(Statement* inner: stmt.statements)
+    {
+        inner->accept(*this);
+    }
+    if(stmt.close_slot >= 0)
+    {
+        emit(OpCode::CLOSE_UPVALUES, 0);
+        chunk.write(static_cast<std::uint8_t>(stmt.close_slot));
+    }
+}
+
+void Compiler::visitIf(IfStatement& stmt)
+{
+    stmt.condition->accept(*this);
+    std::size_t skip_then = emitJump(OpCode::POP_JUMP_IF_FALSE, -1);
+    stmt.then_branch->accept(*this);
+    if(!stmt.else_branch)
+    {
+        patchJump(skip_then);
+        return;
+    }
+    std::size_t skip_else = emitJump(OpCode::JUMP, 0);
+    patchJump(skip_then);
+    stmt.else_branch->accept(*this);
+    patchJump(skip_else);
+}
+
+void Compiler::visitWhile(WhileStatement& stmt)
+{
+    std::size_t start = chunk.code.size();
+    stmt.condition->accept(*this);
+    std::size_t exit = emitJump(OpCode::POP_JUMP_IF_FALSE, -1);
+    stmt.body->accept(*this);
+    emitLoop(start);
+    patchJump(exit);
+}
+
+void Compiler::visitFunction(FunctionStatement& stmt)
+{
+    emitClosure(stmt);
+    emitVariable(stmt.name, Access::DEFINE);
+}
+
+void Compiler::visitReturn(ReturnStatement& stmt)
+{
+    if(stmt.value)
+    {
+        stmt.value->accept(*this);
+    }
+    else
+    {
+        emitDefaultReturn();
+    }
+    emit(OpCode::RETURN, -1);
+}
+
+// The superclass is stored in the hidden super local first, so the methods
+// can capture it.
+void Compiler::visitClass(ClassStatement& stmt)
+{
+    if(stmt.superclass)
+    {
+        stmt.superclass->accept(*this);
+        emitVariable(stmt.super_variable, Access::DEFINE);
+    }
+    emit(OpCode::CLASS, 1);
+    emitU24(addConstant(Value::share(StringTable::current().symbolString(stmt.name.symbol))));
+    if(stmt.superclass)
+    {
+        emitVariable(stmt.super_variable, Access::GET);
+        emit(OpCode::INHERIT, -1);
+    }
+    for(FunctionStatement* method: stmt.methods)
+    {
+        emitClosure(*method);
+        emit(OpCode::METHOD, -1);
+        emitU24(method->name.symbol);
+    }
+    emitVariable(stmt.name, Access::DEFINE);
+    if(stmt.close_slot >= 0)
+    {
+        emit(OpCode::CLOSE_UPVALUES, 0);
+        chunk.write(static_cast<std::uint8_t>(stmt.close_slot));
+    }
+}
+
+void Compiler::emit(OpCode op, int stack_effect)
+{
+    chunk.write(op);
+    depth += stack_effect;
+    chunk.max_stack = std::max(chunk.max_stack, depth);
+}
+
+void Compiler::emitConstant(Value value)
+{
+    std::size_t index = addConstant(std::move(value));
+    if(index <= UINT8_MAX)
+    {
+        emit(OpCode::CONSTANT, 1);
+        chunk.write(static_cast<std::uint8_t>(index));
+    }
+    else
+    {
+        emit(OpCode::CONSTANT_LONG, 1);
+        emitU24(index);
+    }
+}
+
+std::size_t Compiler::addConstant(Value value)
+{
+    std::size_t index = chunk.constants.size();
+    if(index > 0xFFFFFF)
+    {
+        throw std::runtime_error("Too many constants in one chunk.");
+    }
+    chunk.constants.push_back(std::move(value));
+    return index;
+}
+
+void Compiler::emitU24(std::size_t operand)
+{
+    chunk.write(static_cast<std::uint8_t>(operand));
+    chunk.write(static_cast<std::uint8_t>(operand >> 8));
+    chunk.write(static_cast<std::uint8_t>(operand >> 16));
+}
+
+void Compiler::emitVariable(const VariableRef& variable, Access access)
+{
+    // Defining pops the value; setting leaves it as the assignment's result.
+    int stack_effect = access == Access::GET ? 1 : access == Access::SET ? 0 : -1;
+    if(variable.depth < 0)
+    {
+        if(variable.slot > 0xFFFFFF)
+        {
+            throw std::runtime_error("Too many global variable names.");
+        }
+        constexpr OpCode ops[] = {OpCode::GET_GLOBAL, OpCode::SET_GLOBAL, OpCode::DEFINE_GLOBAL};
+        emit(ops[static_cast<int>(access)], stack_effect);
+        emitU24(variable.slot);
+        return;
+    }
+    if(variable.depth > 0)
+    {
+        emit(access == Access::GET ? OpCode::GET_UPVALUE : OpCode::SET_UPVALUE, stack_effect);
+        chunk.write(static_cast<std::uint8_t>(variable.slot));
+        return;
+    }
+    constexpr OpCode ops[] = {OpCode::GET_LOCAL, OpCode::SET_LOCAL, OpCode::DEFINE_LOCAL};
+    emit(ops[static_cast<int>(access)], stack_effect);
+    chunk.write(static_cast<std::uint8_t>(variable.slot));
+    chunk.frame_size = std::max(chunk.frame_size, variable.slot + 1);
+}
+
+void Compiler::emitCache()
+{
+    std::size_t cache = chunk.caches.size();
+    if(cache > UINT16_MAX)
+    {
+        throw std::runtime_error("Too many property accesses in one chunk.");
+    }
+    chunk.caches.emplace_back();
+    chunk.write(static_cast<std::uint8_t>(cache));
+    chunk.write(static_cast<std::uint8_t>(cache >> 8));
+}
+
+void Compiler::emitClosure(FunctionStatement& stmt)
+{
+    Value        name     = Value::share(StringTable::current().symbolString(stmt.name.symbol));
+    ObjFunction* function = ObjFunction::create(std::move(name), static_cast<int>(stmt.params.size()),
+                                                stmt.frame_size, static_cast<int>(stmt.upvalues.size()));
+    std::size_t  index    = addConstant(Value::adoptObject(function));
+
+    function->initializer      = stmt.kind == FunctionKind::INITIALIZER;
+    function->chunk.frame_size = stmt.frame_size;
+    Compiler body(function->chunk);
+    body.initializer = function->initializer;
+    for(Statement* inner: stmt.body)
+    {
+        body.statement(inner);
+    }
+    body.emitDefaultReturn();
+    body.emit(OpCode::RETURN, -1);
+
+    emit(OpCode::CLOSURE, 1);
+    emitU24(index);
+    for(const UpvalueRef& upvalue: stmt.upvalues)
+    {
+        chunk.write(static_cast<std::uint8_t>(upvalue.is_local));
+        chunk.write(static_cast<std::uint8_t>(upvalue.index));
+    }
+}
+
+void Compiler::emitDefaultReturn()
+{
+    if(initializer)
+    {
+        emit(OpCode::GET_LOCAL, 1);
+        chunk.write(std::uint8_t{0});
+    }
+    else
+    {
+        emit(OpCode::NIL, 1);
+    }
+}
+
+std::size_t Compiler::emitJump(OpCode op, int stack_effect)
+{
+    emit(op, stack_effect);
+    chunk.write(std::uint8_t{0});
+    chunk.write(std::uint8_t{0});
+    return chunk.code.size() - 2;
+}
+
+void Compiler::patchJump(std::size_t operand)
+{
+    std::size_t offset = chunk.code.size() - (operand + 2);
+    if(offset > UINT16_MAX)
+    {
+        throw std::runtime_error("Too much code to jump over.");
+    }
+    chunk.code[operand]     = static_cast<std::uint8_t>(offset);
+    chunk.code[operand + 1] = static_cast<std::uint8_t>(offset >> 8);
+}
+
+void Compiler::emitLoop(std::size_t start)
+{
+    emit(OpCode::LOOP, 0);
+    std::size_t offset = chunk.code.size() + 2 - start;
+    if(offset > UINT16_MAX)
+    {
+        throw std::runtime_error("Loop body too large.");
+    }
+    chunk.write(static_cast<std::uint8_t>(offset));
+    chunk.write(static_cast<std::uint8_t>(offset >> 8));
+}
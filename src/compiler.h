@@ -0,0 +1,80 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <cstddef>
+#include "chunk.h"
+#include "parser.h"
+
+// Translates a syntax tree into bytecode for the VM. Operand order matches
+// the tree walker: the left operand is evaluated before the right. Each
+// function declaration is compiled by a nested Compiler into the chunk of
+// its own ObjFunction.
+class Compiler : private ExpressionVisitor, private StatementVisitor
+{
+public:
+    explicit Compiler(Chunk& chunk) : chunk(chunk) {}
+
+    // Appends code that evaluates expr and then prints the result
+    // (print == true) or discards it.
+    void expressionStatement(Expression* expr, bool print);
+
+    // Appends the code for one statement of a program.
+    void statement(Statement* stmt);
+
+    // Terminates the chunk.
+    void finish();
+
+private:
+    enum class Access
+    {
+        GET,
+        SET,
+        DEFINE
+    };
+
+    void visitBinary(Binary& expr) override;
+    void visitUnary(Unary& expr) override;
+    void visitLiteral(Literal& expr) override;
+    void visitGrouping(Grouping& expr) override;
+    void visitVariable(Variable& expr) override;
+    void visitAssign(Assign& expr) override;
+    void visitLogical(Logical& expr) override;
+    void visitCall(Call& expr) override;
+    void visitGet(Get& expr) override;
+    void visitSet(Set& expr) override;
+    void visitThis(This& expr) override;
+    void visitSuper(Super& expr) override;
+    void visitInvoke(Invoke& expr) override;
+
+    void visitPrint(PrintStatement& stmt) override;
+    void visitExpression(ExpressionStatement& stmt) override;
+    void visitVar(VarStatement& stmt) override;
+    void visitBlock(BlockStatement& stmt) override;
+    void visitIf(IfStatement& stmt) override;
+    void visitWhile(WhileStatement& stmt) override;
+    void visitFunction(FunctionStatement& stmt) override;
+    void visitReturn(ReturnStatement& stmt) override;
+    void visitClass(ClassStatement& stmt) override;
+
+    void        emit(OpCode op, int stack_effect);
+    void        emitConstant(Value value);
+    std::size_t addConstant(Value value);
+    void        emitU24(std::size_t operand);
+    void        emitVariable(const VariableRef& variable, Access access);
+    // Emits the u16 index of a new inline cache.
+    void        emitCache();
+    // Compiles stmt into its own function and pushes a closure of it.
+    void        emitClosure(FunctionStatement& stmt);
+    // Pushes the value a return without one produces.
+    void        emitDefaultReturn();
+    // Emits a forward jump and returns where its operand is, for patchJump.
+    std::size_t emitJump(OpCode op, int stack_effect);
+    void        patchJump(std::size_t operand);
+    void        emitLoop(std::size_t start);
+
+    Chunk& chunk;
+    int    depth       = 0;
+    bool   initializer = false; // returns give slot 0, the new instance
+};
+
+#endif // COMPILER_H
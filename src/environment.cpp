@@ -0,0 +1,111 @@
+#include "environment.h"
+#include "intern.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+std::uint32_t GlobalNames::slot(std::uint32_t symbol)
+{
+    if(symbol >= slots.size())
+    {
+        slots.resize(std::max<std::size_t>(symbol + 1, slots.size() * 2));
+    }
+    if(slots[symbol] == 0)
+    {
+        symbols.push_back(symbol);
+        slots[symbol] = static_cast<std::uint32_t>(symbols.size());
+    }
+    return slots[symbol] - 1;
+}
+
+Environment::Environment(std::ostream& out, GlobalNames& names) :
+    out(out), names(names), globals(names.size()), stack(new Value[stack_slots])
+{
+    frame = top = stack.get();
+    Heap::current().attach(*this);
+    defineNatives(*this);
+}
+
+Environment::~Environment()
+{
+    Heap& heap = Heap::current();
+    heap.detach(*this);
+    closeUpvalues(stack.get());
+
+    // Drop every value now, so that the cycles they held can be collected
+    // before the program's tree and chunks go too.
+    globals.clear();
+    returned = Value();
+    stack.reset();
+    heap.collect(true);
+}
+
+void Environment::defineGlobal(std::uint32_t slot, Value value)
+{
+    if(slot >= globals.size())
+    {
+        // Names given slots since, as when a stream declares more.
+        globals.resize(names.size());
+    }
+    globals[slot].value   = std::move(value);
+    globals[slot].defined = true;
+}
+
+void Environment::enterFrame(std::size_t size)
+{
+    if(size > stack_slots)
+    {
+        stackOverflow();
+    }
+    frame   = stack.get();
+    top     = frame + size;
+    closure = nullptr;
+    depth   = 0;
+}
+
+ObjUpvalue* Environment::captureUpvalue(Value* slot)
+{
+    ObjUpvalue** link = &open_upvalues;
+    while(*link && (*link)->location > slot)
+    {
+        link = &(*link)->next_open;
+    }
+    if(*link && (*link)->location == slot)
+    {
+        return *link;
+    }
+    // The open list holds a reference until the upvalue is closed.
+    auto* upvalue = new ObjUpvalue{{{1, ObjType::UPVALUE}}, slot, Value(), *link};
+    *link         = upvalue;
+    Heap::current().track(upvalue, sizeof(ObjUpvalue));
+    return upvalue;
+}
+
+void Environment::closeUpvalue()
+{
+    ObjUpvalue* upvalue = open_upvalues;
+    open_upvalues       = upvalue->next_open;
+    upvalue->closed     = std::move(*upvalue->location);
+    upvalue->location   = &upvalue->closed;
+    upvalue->next_open  = nullptr;
+    if(--upvalue->refcount == 0)
+    {
+        destroyHeapObject(upvalue);
+    }
+}
+
+void Environment::stackOverflow()
+{
+    throw std::runtime_error("Stack overflow.");
+}
+
+void Environment::interrupted()
+{
+    throw std::runtime_error("Timed out.");
+}
+
+void Environment::undefined(std::uint32_t slot) const
+{
+    std::string name(StringTable::current().symbolString(names.symbol(slot))->view());
+    throw std::runtime_error("Undefined variable '" + name + "'.");
+}
@@ -0,0 +1,205 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <vector>
+#include "function.h"
+#include "value.h"
+
+// Numbers the globals of one program densely from 0, so that its globals
+// array is as long as the program has global names, not as the thread has
+// symbols. The Resolver hands out slots as it meets names; the natives get
+// theirs when an Environment is created.
+class GlobalNames
+{
+public:
+    // Slot of the global named by symbol, adding it on first use.
+    std::uint32_t slot(std::uint32_t symbol);
+
+    std::uint32_t symbol(std::uint32_t slot) const
+    {
+        return symbols[slot];
+    }
+    std::size_t size() const
+    {
+        return symbols.size();
+    }
+
+private:
+    std::vector<std::uint32_t> slots;   // by symbol: slot + 1, or 0 for none
+    std::vector<std::uint32_t> symbols; // by slot
+};
+
+// The state of a running program. Globals are a dense array indexed by the
+// slot names gives them, so reading one is an index and a check that it has
+// been defined. Locals are slots in a flat frame
+// numbered by the Resolver. Frames are carved out of one value stack that is
+// allocated up front and shared by both engines: the tree walker tracks its
+// current frame here, the VM in its own call frames.
+class Environment
+{
+public:
+    struct Global
+    {
+        Value value;
+        bool  defined = false;
+    };
+
+    // Calls nest at most this deep, in either engine.
+    static constexpr int max_frames = 1024;
+    // Size of the value stack. It never moves, so open upvalues can point
+    // into it.
+    static constexpr std::size_t stack_slots = 1 << 16;
+
+    // Program output goes to out, and globals are laid out by names, which
+    // must outlive the environment. The natives are defined as globals.
+    Environment(std::ostream& out, GlobalNames& names);
+    ~Environment();
+
+    Environment(const Environment&)            = delete;
+    Environment& operator=(const Environment&) = delete;
+
+    // Throws std::runtime_error if the global has not been defined.
+    const Value& global(std::uint32_t slot) const
+    {
+        if(slot >= globals.size() || !globals[slot].defined)
+        {
+            undefined(slot);
+        }
+        return globals[slot].value;
+    }
+
+    // Every global slot, defined or not, for code that reads them directly.
+    // Invalidated when a new global is defined.
+    std::span<const Global> globalSlots() const
+    {
+        return globals;
+    }
+
+    // Defines or redefines a global.
+    void defineGlobal(std::uint32_t slot, Value value);
+
+    // Throws std::runtime_error if the global has not been defined.
+    void assignGlobal(std::uint32_t slot, Value value)
+    {
+        if(slot >= globals.size() || !globals[slot].defined)
+        {
+            undefined(slot);
+        }
+        globals[slot].value = std::move(value);
+    }
+
+    GlobalNames& globalNames()
+    {
+        return names;
+    }
+
+    Value* stackBase()
+    {
+        return stack.get();
+    }
+    Value* stackEnd()
+    {
+        return stack.get() + stack_slots;
+    }
+
+    // Starts the tree walker on top-level code whose frame is size slots.
+    void enterFrame(std::size_t size);
+
+    Value& local(int slot)
+    {
+        return frame[slot];
+    }
+    Value& upvalue(int index)
+    {
+        return *closure->upvalues()[index]->location;
+    }
+
+    // The upvalue for slot, shared with any closure that captured it before.
+    ObjUpvalue* captureUpvalue(Value* slot);
+
+    // Closes the open upvalues at or above from, as their slots go out of
+    // scope.
+    void closeUpvalues(Value* from)
+    {
+        while(open_upvalues && open_upvalues->location >= from)
+        {
+            closeUpvalue();
+        }
+    }
+
+    [[noreturn]] static void stackOverflow();
+
+    // Throws std::runtime_error once interrupt is set. The engines call it
+    // as loops go round and functions are entered.
+    void checkInterrupt() const
+    {
+        if(interrupt->load(std::memory_order_relaxed))
+        {
+            interrupted();
+        }
+    }
+    [[noreturn]] static void interrupted();
+
+    // Calls visit with each tracked object the environment holds a
+    // reference to: from the stack below top, the globals, the pending
+    // return value and the list of open upvalues. These are the heap's
+    // roots.
+    template <typename Visit>
+    void forEachRoot(Visit&& visit)
+    {
+        auto value = [&](const Value& held)
+        {
+            if(held.isObject())
+            {
+                visit(static_cast<GcObject*>(held.asObject()));
+            }
+        };
+        for(const Value* slot = stack.get(); slot < top; ++slot)
+        {
+            value(*slot);
+        }
+        for(const Global& global: globals)
+        {
+            value(global.value);
+        }
+        value(returned);
+        for(ObjUpvalue* upvalue = open_upvalues; upvalue; upvalue = upvalue->next_open)
+        {
+            visit(upvalue);
+        }
+    }
+
+    std::ostream& out;
+
+    // Set from another thread to stop the program, as a server does when a
+    // request runs past its time limit.
+    const std::atomic<bool>* interrupt = &never_interrupted;
+
+    // Tree walker state: the running frame and closure (nullptr at top
+    // level), the first free stack slot, how deep calls are nested, and the
+    // value of the last return statement.
+    Value*      frame   = nullptr;
+    Value*      top     = nullptr;
+    ObjClosure* closure = nullptr;
+    int         depth   = 0;
+    Value       returned;
+
+private:
+    static constinit inline const std::atomic<bool> never_interrupted{false};
+
+    [[noreturn]] void undefined(std::uint32_t slot) const;
+    void closeUpvalue();
+
+    GlobalNames&             names;
+    std::vector<Global>      globals;
+    std::unique_ptr<Value[]> stack;
+    ObjUpvalue*              open_upvalues = nullptr;
+};
+
+#endif // ENVIRONMENT_H
@@ -0,0 +1,59 @@
+#include "function.h"
+#include "environment.h"
+#include "intern.h"
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace
+{
+Value clockNative(Value*, int)
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return Value::number(std::chrono::duration<double>(now).count());
+}
+} // namespace
+
+ObjFunction* ObjFunction::create(Value name, int arity, int frame_size, int upvalue_count)
+{
+    auto* function = new ObjFunction{
+        {{1, ObjType::FUNCTION}}, std::move(name), arity, frame_size, upvalue_count, false, nullptr, {}};
+    Heap::current().track(function, sizeof(ObjFunction));
+    return function;
+}
+
+ObjClosure* ObjClosure::create(ObjFunction* function)
+{
+    std::size_t size    = sizeof(ObjClosure) + sizeof(ObjUpvalue*) * function->upvalue_count;
+    auto*       closure = new(::operator new(size)) ObjClosure{{{1, ObjType::CLOSURE}}, function};
+    ++function->refcount;
+    std::fill_n(closure->upvalues(), function->upvalue_count, nullptr);
+    Heap::current().track(closure, size);
+    return closure;
+}
+
+void arityError(int arity, int argc)
+{
+    throw std::runtime_error("Expected " + std::to_string(arity) + " arguments but got " + std::to_string(argc) + ".");
+}
+
+void defineNatives(Environment& env)
+{
+    struct Native
+    {
+        const char*    name;
+        NativeFunction function;
+        int            arity;
+    };
+    for(const Native& native: {Native{"clock", clockNative, 0}})
+    {
+        auto* object = new ObjNative{{{1, ObjType::NATIVE}}, native.function, native.arity};
+        Heap::current().track(object, sizeof(ObjNative));
+        std::uint32_t slot = env.globalNames().slot(StringTable::current().symbol(native.name));
+        env.defineGlobal(slot, Value::adoptObject(object));
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <cstdint>
+#include "chunk.h"
+#include "heap.h"
+#include "value.h"
+
+class FunctionStatement;
+
+// The code of a function declaration, shared by every closure made from it.
+// The tree walker runs declaration; the VM runs chunk.
+struct ObjFunction : GcObject
+{
+    Value                    name; // a string
+    int                      arity         = 0;
+    int                      frame_size    = 0; // slots for the callee, parameters and locals
+    int                      upvalue_count = 0;
+    bool                     initializer   = false; // an init method, which returns this
+    const FunctionStatement* declaration   = nullptr; // must outlive the function
+    Chunk                    chunk;
+
+    // Returns a function holding one reference.
+    static ObjFunction* create(Value name, int arity, int frame_size, int upvalue_count);
+};
+
+// A variable captured by a closure. While the variable's frame is live the
+// upvalue is open and points at its stack slot; when the slot goes out of
+// scope the value moves into closed and location follows it, so closures
+// share the variable without any other local ever leaving the stack.
+struct ObjUpvalue : GcObject
+{
+    Value*      location;
+    Value       closed;
+    ObjUpvalue* next_open; // open upvalues are listed by descending location
+};
+
+// A function together with the variables it captured. The upvalue pointers
+// follow the header in the same allocation; each holds a reference.
+struct ObjClosure : GcObject
+{
+    ObjFunction* function; // holds a reference; nullptr once cleared
+
+    ObjUpvalue** upvalues()
+    {
+        return reinterpret_cast<ObjUpvalue**>(this + 1);
+    }
+
+    // Returns a closure holding one reference, with function's upvalue_count
+    // upvalue slots left for the caller to fill.
+    static ObjClosure* create(ObjFunction* function);
+};
+
+// A function implemented in C++. args points at argc values on the stack.
+using NativeFunction = Value (*)(Value* args, int argc);
+
+struct ObjNative : GcObject
+{
+    NativeFunction function;
+    int            arity;
+};
+
+class Environment;
+
+// Prepares a call of base[0] with the argc arguments that follow it, for
+// either engine. When the callee is a closure to run (given directly, as a
+// bound method or as a class's initializer), returns it with base[0] set to
+// what the closure's slot 0 holds: itself, or the receiver. Otherwise the
+// call is complete and the result is in base[0]. Throws std::runtime_error
+// for a value that cannot be called or a wrong argument count.
+ObjClosure* prepareCall(Value* base, int argc);
+
+// Throws the runtime error for calling a function of arity with argc
+// arguments; shared by both engines.
+[[noreturn]] void arityError(int arity, int argc);
+
+// Defines the built-in functions as globals of env.
+void defineNatives(Environment& env);
+
+#endif // FUNCTION_H
@@ -0,0 +1,283 @@
+#include "heap.h"
+#include "class.h"
+#include "environment.h"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+// Calls visit with every tracked object that object holds a reference to.
+template <typename Visit>
+void forEachReference(GcObject* object, Visit&& visit)
+{
+    auto value = [&](const Value& held)
+    {
+        if(held.isObject())
+        {
+            visit(static_cast<GcObject*>(held.asObject()));
+        }
+    };
+    switch(object->type)
+    {
+        case ObjType::FUNCTION:
+            for(const Value& constant: static_cast<ObjFunction*>(object)->chunk.constants)
+            {
+                value(constant);
+            }
+            break;
+        case ObjType::CLOSURE:
+        {
+            auto* closure = static_cast<ObjClosure*>(object);
+            visit(closure->function);
+            for(int i = 0; i < closure->function->upvalue_count; ++i)
+            {
+                // Null while the closure is being filled in.
+                if(ObjUpvalue* upvalue = closure->upvalues()[i])
+                {
+                    visit(upvalue);
+                }
+            }
+            break;
+        }
+        case ObjType::UPVALUE:
+        {
+            auto* upvalue = static_cast<ObjUpvalue*>(object);
+            // An open upvalue's slot belongs to the stack.
+            if(upvalue->location == &upvalue->closed)
+            {
+                value(upvalue->closed);
+            }
+            break;
+        }
+        case ObjType::CLASS:
+            for(const auto& [symbol, method]: static_cast<ObjClass*>(object)->methods)
+            {
+                value(method);
+            }
+            break;
+        case ObjType::INSTANCE:
+        {
+            auto* instance = static_cast<ObjInstance*>(object);
+            visit(instance->klass);
+            for(const Value& field: instance->fields)
+            {
+                value(field);
+            }
+            break;
+        }
+        case ObjType::BOUND_METHOD:
+        {
+            auto* bound = static_cast<ObjBoundMethod*>(object);
+            value(bound->receiver);
+            visit(bound->method);
+            break;
+        }
+        default: break;
+    }
+}
+} // namespace
+
+Heap& Heap::current()
+{
+    thread_local Heap heap;
+    return heap;
+}
+
+Heap::~Heap()
+{
+    // Whatever is still tracked belongs to a program that exited without
+    // unwinding; it is left to the operating system.
+    if(report)
+    {
+        printStats(*report);
+    }
+}
+
+void Heap::track(GcObject* object, std::size_t size)
+{
+    object->gc_size = static_cast<std::uint32_t>(size);
+    addTo(0, object);
+    statistics.bytes_allocated += size;
+    statistics.peak_bytes = std::max(statistics.peak_bytes, liveBytes());
+    if(bytes[0] >= nursery_bytes)
+    {
+        collect(bytes[1] >= old_limit);
+    }
+}
+
+void Heap::untrack(GcObject* object)
+{
+    removeFrom(object);
+}
+
+void Heap::attach(Environment& env)
+{
+    roots.push_back(&env);
+}
+
+void Heap::detach(Environment& env)
+{
+    roots.erase(std::find(roots.begin(), roots.end(), &env));
+}
+
+void Heap::addTo(int generation, GcObject* object)
+{
+    object->generation = static_cast<std::uint8_t>(generation);
+    object->gc_index   = static_cast<std::uint32_t>(objects[generation].size());
+    objects[generation].push_back(object);
+    bytes[generation] += object->gc_size;
+}
+
+void Heap::removeFrom(GcObject* object)
+{
+    std::vector<GcObject*>& list = objects[object->generation];
+    GcObject*               last = list.back();
+    list[object->gc_index]       = last;
+    last->gc_index               = object->gc_index;
+    list.pop_back();
+    bytes[object->generation] -= object->gc_size;
+}
+
+void Heap::collect(bool full)
+{
+    // Freeing garbage drops references but never allocates; this only
+    // guards against a collection starting from inside another.
+    if(collecting)
+    {
+        return;
+    }
+    collecting = true;
+    auto start = std::chrono::steady_clock::now();
+
+    int  oldest  = full ? 1 : 0;
+    auto inScope = [oldest](const GcObject* object) { return object->generation <= oldest; };
+
+    // Count the references to each object from outside the objects being
+    // collected: its refcount less those held by other such objects and by
+    // the scanned roots. What is left is held by the C++ side.
+    for(int generation = 0; generation <= oldest; ++generation)
+    {
+        for(GcObject* object: objects[generation])
+        {
+            object->gc_refs = static_cast<std::int32_t>(object->refcount);
+            object->marked  = false;
+        }
+    }
+    for(int generation = 0; generation <= oldest; ++generation)
+    {
+        for(GcObject* object: objects[generation])
+        {
+            forEachReference(object, [&](GcObject* child) {
+                if(inScope(child))
+                {
+                    --child->gc_refs;
+                }
+            });
+        }
+    }
+    work.clear();
+    for(Environment* env: roots)
+    {
+        env->forEachRoot([&](GcObject* object) {
+            if(inScope(object))
+            {
+                --object->gc_refs;
+                work.push_back(object);
+            }
+        });
+    }
+    for(int generation = 0; generation <= oldest; ++generation)
+    {
+        for(GcObject* object: objects[generation])
+        {
+            if(object->gc_refs > 0)
+            {
+                work.push_back(object);
+            }
+        }
+    }
+
+    // Mark everything reachable from those.
+    while(!work.empty())
+    {
+        GcObject* object = work.back();
+        work.pop_back();
+        if(object->marked)
+        {
+            continue;
+        }
+        object->marked = true;
+        forEachReference(object, [&](GcObject* child) {
+            if(inScope(child) && !child->marked)
+            {
+                work.push_back(child);
+            }
+        });
+    }
+
+    // The rest is garbage, referenced only from other garbage. Pinning each
+    // object first means clearing the references inside the cycles cannot
+    // free any of them early; objects outside that lose their last
+    // reference are freed as usual.
+    for(int generation = 0; generation <= oldest; ++generation)
+    {
+        for(GcObject* object: objects[generation])
+        {
+            if(!object->marked)
+            {
+                work.push_back(object);
+            }
+        }
+    }
+    for(GcObject* object: work)
+    {
+        ++object->refcount;
+    }
+    for(GcObject* object: work)
+    {
+        clearReferences(object);
+    }
+    for(GcObject* object: work)
+    {
+        statistics.bytes_collected += object->gc_size;
+        removeFrom(object);
+        freeObject(object);
+    }
+    statistics.objects_collected += work.size();
+    work.clear();
+
+    // Survivors are old.
+    for(GcObject* object: objects[0])
+    {
+        object->generation = 1;
+        object->gc_index   = static_cast<std::uint32_t>(objects[1].size());
+        objects[1].push_back(object);
+    }
+    objects[0].clear();
+    bytes[1] += bytes[0];
+    bytes[0] = 0;
+
+    if(full)
+    {
+        ++statistics.full_collections;
+        old_limit = std::max(min_old_bytes, static_cast<std::size_t>(bytes[1] * growth_factor));
+    }
+    else
+    {
+        ++statistics.minor_collections;
+    }
+    double pause = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    statistics.total_pause += pause;
+    statistics.max_pause = std::max(statistics.max_pause, pause);
+    collecting           = false;
+}
+
+void Heap::printStats(std::ostream& out) const
+{
+    const Stats& s = statistics;
+    out << "[gc] collections: " << s.minor_collections << " minor, " << s.full_collections << " full\n";
+    out << "[gc] pause: " << s.total_pause * 1e3 << " ms total, " << s.max_pause * 1e3 << " ms max\n";
+    out << "[gc] allocated: " << s.bytes_allocated << " bytes, peak " << s.peak_bytes << " bytes live\n";
+    out << "[gc] collected: " << s.bytes_collected << " bytes in " << s.objects_collected << " objects\n";
+    out << "[gc] live: " << liveBytes() << " bytes\n";
+}
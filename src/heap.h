@@ -0,0 +1,129 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "value.h"
+
+class Environment;
+
+// Header of the objects that can refer to other objects: functions,
+// closures, upvalues, natives, classes, instances and bound methods. Unlike
+// strings and ropes these can form cycles (a closure that captures itself,
+// an instance that stores itself in a field), which reference counting
+// alone never frees, so the heap tracks every one of them.
+struct GcObject : Obj
+{
+    std::uint32_t gc_index   = 0; // position in its generation's list
+    std::int32_t  gc_refs    = 0; // scratch count while collecting
+    std::uint32_t gc_size    = 0; // bytes, as passed to Heap::track
+    std::uint8_t  generation = 0;
+    bool          marked     = false;
+};
+
+// Per-thread collector for GcObjects. Reference counting still frees most
+// objects the moment they become unreachable; the heap finds the rest, the
+// garbage cycles, with a precise mark-sweep.
+//
+// The roots are the values the attached Environments hold (stack, globals,
+// the pending return value and open upvalues) plus any object referenced
+// from outside the tracked heap: a C++ local in the tree walker, a tree node
+// or a compiled chunk. Those outside references are found exactly by taking
+// each object's refcount and subtracting the references the collector can
+// see, so a collection is safe at any allocation.
+//
+// Objects are allocated young. A minor collection examines only the young
+// generation, treating references from old objects as roots, and promotes
+// the survivors; a full collection examines both, and runs once the old
+// generation has grown by the growth factor since the last one.
+class Heap
+{
+public:
+    struct Stats
+    {
+        std::size_t minor_collections = 0;
+        std::size_t full_collections  = 0;
+        double      total_pause       = 0; // seconds
+        double      max_pause         = 0;
+        std::size_t bytes_allocated   = 0;
+        std::size_t bytes_collected   = 0; // by the collector, not refcounting
+        std::size_t objects_collected = 0;
+        std::size_t peak_bytes        = 0;
+    };
+
+    // Minor collections run whenever this much has been allocated young.
+    static constexpr std::size_t nursery_bytes = 256 * 1024;
+    // The old generation is never collected below this size.
+    static constexpr std::size_t min_old_bytes = 1024 * 1024;
+
+    Heap() = default;
+    ~Heap();
+
+    Heap(const Heap&)            = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    // The calling thread's heap.
+    static Heap& current();
+
+    // Starts tracking a newly created object of size bytes, which may run a
+    // collection first.
+    void track(GcObject* object, std::size_t size);
+
+    // Stops tracking an object that is being freed.
+    void untrack(GcObject* object);
+
+    // Adds or removes env's values from the roots.
+    void attach(Environment& env);
+    void detach(Environment& env);
+
+    // Collects the young generation, or both with full.
+    void collect(bool full);
+
+    // The old generation may grow to factor times its size after a full
+    // collection before the next one. Must be greater than 1.
+    void setGrowthFactor(double factor)
+    {
+        growth_factor = factor;
+    }
+
+    // When set, the statistics are written to out as the heap is destroyed,
+    // which for the main thread is at exit.
+    void reportStats(std::ostream* out)
+    {
+        report = out;
+    }
+
+    const Stats& stats() const
+    {
+        return statistics;
+    }
+
+    void printStats(std::ostream& out) const;
+
+private:
+    void addTo(int generation, GcObject* object);
+    void removeFrom(GcObject* object);
+    std::size_t liveBytes() const
+    {
+        return bytes[0] + bytes[1];
+    }
+
+    std::vector<GcObject*>    objects[2]; // young, old
+    std::size_t               bytes[2] = {0, 0};
+    std::size_t               old_limit = min_old_bytes;
+    double                    growth_factor = 2.0;
+    bool                      collecting    = false;
+    std::vector<Environment*> roots;
+    std::vector<GcObject*>    work; // mark stack and garbage list
+    Stats                     statistics;
+    std::ostream*             report = nullptr;
+};
+
+// Drops every reference object holds. The collector does this to each
+// object of a garbage cycle before freeing them all with freeObject.
+void clearReferences(GcObject* object);
+void freeObject(GcObject* object);
+
+#endif // HEAP_H
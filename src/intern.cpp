@@ -0,0 +1,219 @@
+#include "intern.h"
+#include <algorithm>
+#include <new>
+
+namespace
+{
+ObjString        tombstone_object{};
+ObjString* const tombstone = &tombstone_object;
+
+// 32-bit FNV-1a over head followed by tail.
+std::uint32_t hashString(std::string_view head, std::string_view tail)
+{
+    std::uint32_t hash = 2166136261u;
+    for(std::string_view part: {head, tail})
+    {
+        for(char ch: part)
+        {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+bool spells(const ObjString* string, std::string_view head, std::string_view tail)
+{
+    std::string_view text = string->view();
+    return text.size() == head.size() + tail.size() && text.substr(0, head.size()) == head &&
+        text.substr(head.size()) == tail;
+}
+} // namespace
+
+StringTable& StringTable::current()
+{
+    thread_local StringTable table;
+    return table;
+}
+
+StringTable::~StringTable()
+{
+    tearing_down = true;
+    for(const Symbol& entry: symbols)
+    {
+        if(entry.string && --entry.string->refcount == 0)
+        {
+            ::operator delete(entry.string);
+        }
+    }
+}
+
+StringTable::Pinning::Pinning(StringTable& table, SymbolPins& pins) : table(table), previous(table.active)
+{
+    if(!pins.table)
+    {
+        pins.table  = &table;
+        pins.serial = ++table.last_serial;
+    }
+    table.active = &pins;
+}
+
+StringTable::Pinning::~Pinning()
+{
+    table.active = previous;
+}
+
+ObjString* StringTable::intern(std::string_view head, std::string_view tail)
+{
+    std::uint32_t hash  = hashString(head, tail);
+    std::size_t   index = find(head, tail, hash);
+    ObjString*    found = slots[index];
+    if(found && found != tombstone)
+    {
+        ++found->refcount;
+        return found;
+    }
+
+    std::size_t length = head.size() + tail.size();
+    void*       memory = ::operator new(sizeof(ObjString) + length);
+    ObjString*  string = new(memory) ObjString{{1, ObjType::STRING}, static_cast<std::uint32_t>(length), hash, 0};
+    char*       chars  = const_cast<char*>(string->chars());
+    std::copy(tail.begin(), tail.end(), std::copy(head.begin(), head.end(), chars));
+
+    tombstones -= found == tombstone;
+    slots[index] = string;
+    ++live;
+    if((live + tombstones) * 4 > slots.size() * 3)
+    {
+        grow();
+    }
+    return string;
+}
+
+std::uint32_t StringTable::symbol(std::string_view text)
+{
+    ObjString* string = intern(text);
+    if(string->symbol == 0)
+    {
+        // The reference intern() handed out becomes the table's pin.
+        if(free_ids.empty())
+        {
+            string->symbol = static_cast<std::uint32_t>(symbols.size());
+            symbols.emplace_back();
+        }
+        else
+        {
+            string->symbol = free_ids.back();
+            free_ids.pop_back();
+        }
+        symbols[string->symbol] = {string};
+    }
+    else
+    {
+        --string->refcount;
+    }
+
+    // A set may take a symbol more than once if another set took it in
+    // between; each take is a hold and is released on its own.
+    Symbol& entry = symbols[string->symbol];
+    if(!active)
+    {
+        entry.permanent = true;
+    }
+    else if(!entry.permanent && entry.last_set != active->serial)
+    {
+        entry.last_set = active->serial;
+        ++entry.holders;
+        active->ids.push_back(string->symbol);
+    }
+    return string->symbol;
+}
+
+void StringTable::release(SymbolPins& pins)
+{
+    for(std::uint32_t id: pins.ids)
+    {
+        Symbol& entry = symbols[id];
+        if(--entry.holders > 0 || entry.permanent)
+        {
+            continue;
+        }
+        ObjString* string = entry.string;
+        string->symbol    = 0;
+        entry             = {};
+        free_ids.push_back(id);
+        if(--string->refcount == 0)
+        {
+            ObjString::destroy(string);
+        }
+    }
+    pins.ids.clear();
+}
+
+void StringTable::remove(const ObjString* string)
+{
+    if(tearing_down)
+    {
+        return;
+    }
+    std::size_t mask  = slots.size() - 1;
+    std::size_t index = string->hash & mask;
+    while(slots[index] != string)
+    {
+        index = (index + 1) & mask;
+    }
+    slots[index] = tombstone;
+    --live;
+    ++tombstones;
+}
+
+// Index of the entry spelling head + tail, or else of the slot it should be
+// inserted in.
+std::size_t StringTable::find(std::string_view head, std::string_view tail, std::uint32_t hash) const
+{
+    std::size_t mask      = slots.size() - 1;
+    std::size_t index     = hash & mask;
+    std::size_t insert_at = slots.size();
+    for(;;)
+    {
+        ObjString* entry = slots[index];
+        if(!entry)
+        {
+            return insert_at != slots.size() ? insert_at : index;
+        }
+        if(entry == tombstone)
+        {
+            if(insert_at == slots.size())
+            {
+                insert_at = index;
+            }
+        }
+        else if(entry->hash == hash && spells(entry, head, tail))
+        {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// Rehashes into a table twice the size, or the same size if most of the
+// load was tombstones.
+void StringTable::grow()
+{
+    std::size_t             capacity = live * 2 >= slots.size() ? slots.size() * 2 : slots.size();
+    std::vector<ObjString*> old(capacity, nullptr);
+    old.swap(slots);
+    std::size_t mask = capacity - 1;
+    for(ObjString* entry: old)
+    {
+        if(entry && entry != tombstone)
+        {
+            std::size_t index = entry->hash & mask;
+            while(slots[index])
+            {
+                index = (index + 1) & mask;
+            }
+            slots[index] = entry;
+        }
+    }
+    tombstones = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "value.h"
+
+// Every string a thread creates is interned in that thread's table, so two
+// strings with the same characters are the same ObjString and comparing them
+// is a pointer comparison.
+//
+// The table is weak: a string removes itself when its last reference goes.
+// Symbols, the identifiers and string literals of the program text, are the
+// exception. The table pins them with a reference of its own and numbers them
+// densely from 1, so later passes can index arrays by name.
+//
+// A symbol looked up while a SymbolPins is active belongs to that set and is
+// released, its id free for reuse, once no set holds it. One looked up with
+// no set active is kept for the life of the thread.
+class SymbolPins;
+
+class StringTable
+{
+public:
+    // Makes pins the active set until the Pinning goes out of scope.
+    class Pinning
+    {
+    public:
+        Pinning(StringTable& table, SymbolPins& pins);
+        ~Pinning();
+
+        Pinning(const Pinning&)            = delete;
+        Pinning& operator=(const Pinning&) = delete;
+
+    private:
+        StringTable& table;
+        SymbolPins*  previous;
+    };
+
+    StringTable() : slots(16, nullptr) {}
+    ~StringTable();
+
+    StringTable(const StringTable&)            = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    // The calling thread's table.
+    static StringTable& current();
+
+    // The string spelled head followed by tail, holding one reference for
+    // the caller.
+    ObjString* intern(std::string_view head, std::string_view tail = {});
+
+    // Id of the symbol spelled text, adding it on first use.
+    std::uint32_t symbol(std::string_view text);
+
+    ObjString* symbolString(std::uint32_t id) const
+    {
+        return symbols[id].string;
+    }
+    // Symbols currently held.
+    std::size_t symbolCount() const
+    {
+        return symbols.size() - 1 - free_ids.size();
+    }
+
+    // Called by ObjString::destroy as the last reference is dropped.
+    void remove(const ObjString* string);
+
+private:
+    friend class SymbolPins;
+
+    struct Symbol
+    {
+        ObjString*    string    = nullptr;
+        std::uint32_t holders   = 0;     // pin sets holding it
+        bool          permanent = false; // looked up with no set active
+        std::uint64_t last_set  = 0;     // serial of the set that last took it
+    };
+
+    void release(SymbolPins& pins);
+
+    std::size_t find(std::string_view head, std::string_view tail, std::uint32_t hash) const;
+    void        grow();
+
+    // Open addressing with linear probing; erased entries become tombstones
+    // so that probe chains stay intact.
+    std::vector<ObjString*> slots;
+    std::size_t             live       = 0;
+    std::size_t             tombstones = 0;
+    // Index 0 is unused so that 0 can mean "no symbol".
+    std::vector<Symbol>        symbols{Symbol{}};
+    std::vector<std::uint32_t> free_ids;
+    SymbolPins*                active      = nullptr;
+    std::uint64_t              last_serial = 0;
+    bool                       tearing_down = false;
+};
+
+// The symbols one program holds, from lexing it until it is dropped. A
+// serve cache entry or batch file owns one, so a thread that sees a stream
+// of different programs keeps only the symbols of those it still has.
+class SymbolPins
+{
+public:
+    SymbolPins() = default;
+    ~SymbolPins()
+    {
+        if(table)
+        {
+            table->release(*this);
+        }
+    }
+
+    SymbolPins(const SymbolPins&)            = delete;
+    SymbolPins& operator=(const SymbolPins&) = delete;
+
+private:
+    friend class StringTable;
+
+    StringTable*               table  = nullptr; // set when first active
+    std::uint64_t              serial = 0;
+    std::vector<std::uint32_t> ids;
+};
+
+#endif // INTERN_H
@@ -0,0 +1,823 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#if INTERPRETER_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Planning: finding the subtrees compiled code can run.
+
+void JitPlanner::plan(Statement* stmt)
+{
+    runnable = false;
+    stmt->accept(*this);
+}
+
+JitPlanner::Planned JitPlanner::planned(Expression* expr)
+{
+    expr->accept(*this);
+    return result;
+}
+
+Expression* JitPlanner::finish(const Planned& planned)
+{
+    if(planned.compilable && planned.operation)
+    {
+        return arena.make<JitExpression>(codeSpace(), planned.expr, planned.result);
+    }
+    return planned.expr;
+}
+
+Expression* JitPlanner::plan(Expression* expr)
+{
+    return finish(planned(expr));
+}
+
+JitCode& JitPlanner::codeSpace()
+{
+    if(space == nullptr)
+    {
+        space = arena.make<JitCode>();
+    }
+    return *space;
+}
+
+// Arithmetic on two numbers gives a number and comparing them a bool;
+// anything else, bools included, is left to the tree walker, which reports
+// the error or handles the other types.
+void JitPlanner::visitBinary(Binary& expr)
+{
+    Planned left  = planned(expr.left);
+    Planned right = planned(expr.right);
+    // The left operand stays in its register while the right one is
+    // computed in the registers above it.
+    int registers = std::max(left.registers, right.registers + 1);
+    if(left.compilable && right.compilable && left.result == JitExpression::Result::NUMBER &&
+       right.result == JitExpression::Result::NUMBER && registers <= max_registers)
+    {
+        bool arithmetic = expr.operation == BinaryOp::ADD || expr.operation == BinaryOp::SUBTRACT ||
+                          expr.operation == BinaryOp::MULTIPLY || expr.operation == BinaryOp::DIVIDE;
+        auto kind = arithmetic ? JitExpression::Result::NUMBER : JitExpression::Result::BOOL;
+        result    = {&expr, true, kind, registers, true};
+        return;
+    }
+    expr.left  = finish(left);
+    expr.right = finish(right);
+    result     = {&expr};
+}
+
+void JitPlanner::visitUnary(Unary& expr)
+{
+    Planned right = planned(expr.right);
+    auto    want  = expr.op.token_type == TokenType::MINUS ? JitExpression::Result::NUMBER : JitExpression::Result::BOOL;
+    if(right.compilable && right.result == want)
+    {
+        result = {&expr, true, want, std::max(right.registers, 1), true};
+        return;
+    }
+    expr.right = finish(right);
+    result     = {&expr};
+}
+
+void JitPlanner::visitLiteral(Literal& expr)
+{
+    bool number = expr.constant().isNumber();
+    result      = {&expr, number, JitExpression::Result::NUMBER, 1, false};
+}
+
+void JitPlanner::visitGrouping(Grouping& expr)
+{
+    Planned inner = planned(expr.expression);
+    if(inner.compilable)
+    {
+        result      = inner;
+        result.expr = &expr;
+        return;
+    }
+    expr.expression = inner.expr;
+    result          = {&expr};
+}
+
+// Guarded at run time: compiled code bails out unless it holds a number.
+void JitPlanner::visitVariable(Variable& expr)
+{
+    result = {&expr, true, JitExpression::Result::NUMBER, 1, false};
+}
+
+void JitPlanner::visitAssign(Assign& expr)
+{
+    Planned value = planned(expr.value);
+    expr.value    = finish(value);
+    result        = {&expr};
+    result.assignment = value.compilable && value.result == JitExpression::Result::NUMBER;
+}
+
+void JitPlanner::visitLogical(Logical& expr)
+{
+    expr.left  = plan(expr.left);
+    expr.right = plan(expr.right);
+    result     = {&expr};
+}
+
+void JitPlanner::visitCall(Call& expr)
+{
+    expr.callee = plan(expr.callee);
+    for(Expression*& argument: expr.arguments)
+    {
+        argument = plan(argument);
+    }
+    result = {&expr};
+}
+
+void JitPlanner::visitGet(Get& expr)
+{
+    expr.object = plan(expr.object);
+    result      = {&expr};
+}
+
+void JitPlanner::visitSet(Set& expr)
+{
+    expr.object = plan(expr.object);
+    expr.value  = plan(expr.value);
+    result      = {&expr};
+}
+
+void JitPlanner::visitThis(This& expr)
+{
+    result = {&expr};
+}
+
+void JitPlanner::visitSuper(Super& expr)
+{
+    result = {&expr};
+}
+
+void JitPlanner::visitInvoke(Invoke& expr)
+{
+    expr.object = plan(expr.object);
+    for(Expression*& argument: expr.arguments)
+    {
+        argument = plan(argument);
+    }
+    result = {&expr};
+}
+
+void JitPlanner::visitPrint(PrintStatement& stmt)
+{
+    stmt.expression = plan(stmt.expression);
+    runnable        = false;
+}
+
+void JitPlanner::visitExpression(ExpressionStatement& stmt)
+{
+    Planned expression = planned(stmt.expression);
+    stmt.expression    = finish(expression);
+    runnable           = expression.assignment;
+}
+
+// A compiled loop could only store numbers into a new local's slot, which
+// may still hold an object from an earlier block that has to be released.
+void JitPlanner::visitVar(VarStatement& stmt)
+{
+    if(stmt.initializer)
+    {
+        stmt.initializer = plan(stmt.initializer);
+    }
+    runnable = false;
+}
+
+void JitPlanner::visitBlock(BlockStatement& stmt)
+{
+    bool all = stmt.close_slot < 0;
+    for(Statement* inner: stmt.statements)
+    {
+        plan(inner);
+        all = all && runnable;
+    }
+    runnable = all;
+}
+
+void JitPlanner::visitIf(IfStatement& stmt)
+{
+    Planned condition = planned(stmt.condition);
+    stmt.condition    = finish(condition);
+    plan(stmt.then_branch);
+    bool branches = runnable;
+    if(stmt.else_branch)
+    {
+        plan(stmt.else_branch);
+        branches = branches && runnable;
+    }
+    runnable = branches && condition.compilable && condition.result == JitExpression::Result::BOOL;
+}
+
+void JitPlanner::visitWhile(WhileStatement& stmt)
+{
+    Planned condition = planned(stmt.condition);
+    plan(stmt.body);
+    runnable = runnable && condition.compilable && condition.result == JitExpression::Result::BOOL;
+    if(runnable)
+    {
+        stmt.condition = arena.make<JitExpression>(codeSpace(), condition.expr, condition.result, stmt.body);
+    }
+    else
+    {
+        stmt.condition = finish(condition);
+    }
+}
+
+void JitPlanner::visitFunction(FunctionStatement& stmt)
+{
+    for(Statement* inner: stmt.body)
+    {
+        plan(inner);
+    }
+    runnable = false;
+}
+
+void JitPlanner::visitReturn(ReturnStatement& stmt)
+{
+    if(stmt.value)
+    {
+        stmt.value = plan(stmt.value);
+    }
+    runnable = false;
+}
+
+void JitPlanner::visitClass(ClassStatement& stmt)
+{
+    for(FunctionStatement* method: stmt.methods)
+    {
+        plan(method);
+    }
+    runnable = false;
+}
+
+#if INTERPRETER_JIT
+
+// Code generation for x86-64 (System V). The frame pointer arrives in rdi
+// and the result pointer in rsi. The prologue loads the JitFrame fields into
+// r8 (frame), r9 (upvalues), rcx (globals), rdx (global count) and rdi
+// (interrupt flag), and QNAN into r11 for the number guards. Numbers are computed in xmm registers,
+// bools in al; r10 is scratch.
+
+namespace
+{
+static_assert(sizeof(Value) == 8, "compiled code loads values as 64-bit words");
+static_assert(offsetof(JitFrame, frame) == 0 && offsetof(JitFrame, upvalues) == 8 &&
+              offsetof(JitFrame, globals) == 16 && offsetof(JitFrame, global_count) == 24 &&
+              offsetof(JitFrame, interrupt) == 32);
+static_assert(sizeof(std::atomic<bool>) == 1 && std::atomic<bool>::is_always_lock_free,
+              "loops read the interrupt flag as a plain byte");
+static_assert(offsetof(Environment::Global, value) == 0 && sizeof(Environment::Global) == 16);
+
+constexpr std::uint64_t qnan = 0x7ffc000000000000ull; // Value's tag space
+
+// Where ObjUpvalue::location sits. The type is not standard-layout, so this
+// is measured rather than taken with offsetof.
+std::int32_t upvalueLocationOffset()
+{
+    ObjUpvalue probe{};
+    return static_cast<std::int32_t>(reinterpret_cast<char*>(&probe.location) - reinterpret_cast<char*>(&probe));
+}
+
+enum Reg : std::uint8_t
+{
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RSI = 6,
+    RDI = 7,
+    R8  = 8,
+    R9  = 9,
+    R10 = 10,
+    R11 = 11
+};
+
+class Assembler : private ExpressionVisitor, private StatementVisitor
+{
+public:
+    std::vector<std::uint8_t> code;
+
+    void function(Expression* expr, JitExpression::Result result)
+    {
+        prologue();
+        target = 0;
+        expr->accept(*this);
+        if(result == JitExpression::Result::NUMBER)
+        {
+            bytes({0xF2, 0x0F, 0x11, 0x06});             // movsd [rsi], xmm0
+            bytes({0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3}); // mov eax, 1; ret
+        }
+        else
+        {
+            bytes({0x0F, 0xB6, 0xC0, 0x83, 0xC0, 0x02, 0xC3}); // movzx eax, al; add eax, 2; ret
+        }
+        epilogue();
+    }
+
+    // while(condition) body, to its end. Every variable the loop touches is
+    // checked once up front, so the loop itself reads them unguarded. The
+    // loop is assembled before the checks that precede it, so its jumps to
+    // the interrupt exit are moved along with it.
+    void loop(Expression* condition, Statement* body)
+    {
+        in_loop = true;
+        whileLoop(condition, body);
+        std::vector<std::uint8_t> loop_code = std::move(code);
+        code.clear();
+
+        prologue();
+        for(const VariableRef& variable: touched)
+        {
+            loadVariable(variable);
+            guardNumber();
+        }
+        for(std::size_t& operand: interrupt_jumps)
+        {
+            operand += code.size();
+        }
+        code.insert(code.end(), loop_code.begin(), loop_code.end());
+        bytes({0xB8, 0x02, 0x00, 0x00, 0x00, 0xC3}); // mov eax, 2; ret: the condition is false
+        epilogue();
+    }
+
+private:
+    void prologue()
+    {
+        load(R8, RDI, 0);
+        load(R9, RDI, 8);
+        load(RCX, RDI, 16);
+        load(RDX, RDI, 24);
+        load(RDI, RDI, 32);
+        bytes({0x49, 0xBB}); // mov r11, imm64
+        imm64(qnan);
+    }
+
+    void epilogue()
+    {
+        std::size_t bail = code.size();
+        bytes({0x31, 0xC0, 0xC3}); // xor eax, eax; ret
+        for(std::size_t operand: bail_jumps)
+        {
+            patch(operand, bail);
+        }
+        std::size_t stop = code.size();
+        bytes({0xB8, 0x04, 0x00, 0x00, 0x00, 0xC3}); // mov eax, 4; ret
+        for(std::size_t operand: interrupt_jumps)
+        {
+            patch(operand, stop);
+        }
+    }
+
+    void bytes(std::initializer_list<std::uint8_t> list)
+    {
+        code.insert(code.end(), list);
+    }
+    void imm32(std::uint32_t value)
+    {
+        for(int i = 0; i < 4; ++i)
+        {
+            code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+    }
+    void imm64(std::uint64_t value)
+    {
+        for(int i = 0; i < 8; ++i)
+        {
+            code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    // mov reg, [base + disp32] (op 8B) or mov [base + disp32], reg (op 89),
+    // for a base other than rsp and r12.
+    void move(std::uint8_t op, Reg reg, Reg base, std::int32_t disp)
+    {
+        code.push_back(static_cast<std::uint8_t>(0x48 | (reg >> 3) << 2 | (base >> 3)));
+        code.push_back(op);
+        code.push_back(static_cast<std::uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+        imm32(static_cast<std::uint32_t>(disp));
+    }
+    void load(Reg dst, Reg base, std::int32_t disp)
+    {
+        move(0x8B, dst, base, disp);
+    }
+    void store(Reg src, Reg base, std::int32_t disp)
+    {
+        move(0x89, src, base, disp);
+    }
+
+    // jcc rel32 (or jmp rel32 for condition 0), returning where its operand
+    // is for patch.
+    std::size_t jump(std::uint8_t condition)
+    {
+        if(condition)
+        {
+            bytes({0x0F, condition});
+        }
+        else
+        {
+            code.push_back(0xE9);
+        }
+        std::size_t operand = code.size();
+        imm32(0);
+        return operand;
+    }
+    void patch(std::size_t operand, std::size_t destination)
+    {
+        std::int32_t offset = static_cast<std::int32_t>(destination - (operand + 4));
+        std::memcpy(&code[operand], &offset, 4);
+    }
+
+    // jcc rel32 to the bail-out, patched once its address is known.
+    void jumpToBail(std::uint8_t condition)
+    {
+        bail_jumps.push_back(jump(condition));
+    }
+
+    // An SSE instruction on xmm registers: prefix [REX] 0F op modrm.
+    void sse(std::uint8_t prefix, std::uint8_t op, int reg, int rm)
+    {
+        code.push_back(prefix);
+        if(reg >= 8 || rm >= 8)
+        {
+            code.push_back(static_cast<std::uint8_t>(0x40 | (reg >> 3) << 2 | (rm >> 3)));
+        }
+        bytes({0x0F, op});
+        code.push_back(static_cast<std::uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+
+    // movq xmm, rax and back.
+    void toXmm(int xmm)
+    {
+        code.push_back(0x66);
+        code.push_back(static_cast<std::uint8_t>(0x48 | (xmm >> 3) << 2));
+        bytes({0x0F, 0x6E});
+        code.push_back(static_cast<std::uint8_t>(0xC0 | (xmm & 7) << 3));
+    }
+    void fromXmm(int xmm)
+    {
+        code.push_back(0x66);
+        code.push_back(static_cast<std::uint8_t>(0x48 | (xmm >> 3) << 2));
+        bytes({0x0F, 0x7E});
+        code.push_back(static_cast<std::uint8_t>(0xC0 | (xmm & 7) << 3));
+    }
+
+    // Bails out unless the value in rax is a number.
+    void guardNumber()
+    {
+        bytes({0x49, 0x89, 0xC2}); // mov r10, rax
+        bytes({0x4D, 0x21, 0xDA}); // and r10, r11
+        bytes({0x4D, 0x39, 0xDA}); // cmp r10, r11
+        jumpToBail(0x84);          // je
+    }
+
+    // Loads variable into rax, bailing out if it is a global that is not
+    // defined.
+    void loadVariable(const VariableRef& variable)
+    {
+        if(variable.depth == 0)
+        {
+            load(RAX, R8, variable.slot * 8);
+        }
+        else if(variable.depth > 0)
+        {
+            load(RAX, R9, variable.slot * 8);
+            load(RAX, RAX, upvalueLocationOffset());
+            load(RAX, RAX, 0);
+        }
+        else
+        {
+            std::int32_t offset = globalOffset(variable);
+            bytes({0x48, 0x81, 0xFA}); // cmp rdx, imm32
+            imm32(static_cast<std::uint32_t>(variable.slot));
+            jumpToBail(0x86); // jbe: the environment has no room for the slot yet
+            bytes({0x80, 0xB9});      // cmp byte [rcx + disp32], 0
+            imm32(static_cast<std::uint32_t>(offset + offsetof(Environment::Global, defined)));
+            code.push_back(0x00);
+            jumpToBail(0x84); // je: not defined
+            load(RAX, RCX, offset);
+        }
+    }
+
+    // Stores rax into variable, which the loop has already checked.
+    void storeVariable(const VariableRef& variable)
+    {
+        if(variable.depth == 0)
+        {
+            store(RAX, R8, variable.slot * 8);
+        }
+        else if(variable.depth > 0)
+        {
+            load(R10, R9, variable.slot * 8);
+            load(R10, R10, upvalueLocationOffset());
+            store(RAX, R10, 0);
+        }
+        else
+        {
+            store(RAX, RCX, globalOffset(variable));
+        }
+    }
+
+    static std::int32_t globalOffset(const VariableRef& variable)
+    {
+        return static_cast<std::int32_t>(variable.slot * sizeof(Environment::Global));
+    }
+
+    // Records a variable the loop reads or writes, for the checks up front.
+    void touch(const VariableRef& variable)
+    {
+        auto key = [](const VariableRef& ref)
+        {
+            return ref.depth < 0 ? std::pair<int, std::int64_t>{-1, ref.slot}
+                                 : std::pair<int, std::int64_t>{ref.depth == 0 ? 0 : 1, ref.slot};
+        };
+        auto same = [&](const VariableRef& other) { return key(other) == key(variable); };
+        if(std::none_of(touched.begin(), touched.end(), same))
+        {
+            touched.push_back(variable);
+        }
+    }
+
+    // Evaluates a bool condition and jumps, when it is false, to an
+    // operand returned for patch.
+    std::size_t branchIfFalse(Expression* condition)
+    {
+        target = 0;
+        condition->accept(*this);
+        bytes({0x84, 0xC0}); // test al, al
+        return jump(0x84);   // je
+    }
+
+    void whileLoop(Expression* condition, Statement* body)
+    {
+        std::size_t head = code.size();
+        std::size_t exit = branchIfFalse(condition);
+        body->accept(*this);
+        bytes({0x80, 0x3F, 0x00}); // cmp byte [rdi], 0
+        interrupt_jumps.push_back(jump(0x85)); // jne
+        patch(jump(0), head);
+        patch(exit, code.size());
+    }
+
+    void visitBinary(Binary& expr) override
+    {
+        int left = target;
+        expr.left->accept(*this);
+        target = left + 1;
+        expr.right->accept(*this);
+        target    = left;
+        int right = left + 1;
+        switch(expr.operation)
+        {
+            case BinaryOp::ADD: sse(0xF2, 0x58, left, right); return;
+            case BinaryOp::SUBTRACT: sse(0xF2, 0x5C, left, right); return;
+            case BinaryOp::MULTIPLY: sse(0xF2, 0x59, left, right); return;
+            case BinaryOp::DIVIDE: sse(0xF2, 0x5E, left, right); return;
+            // ucomisd sets CF and ZF (and PF for NaN, which also sets the
+            // other two), so "above" comparisons are false for NaN; a < b
+            // is b > a with the operands swapped.
+            case BinaryOp::GREATER: sse(0x66, 0x2E, left, right); bytes({0x0F, 0x97, 0xC0}); return;
+            case BinaryOp::GREATER_EQUAL: sse(0x66, 0x2E, left, right); bytes({0x0F, 0x93, 0xC0}); return;
+            case BinaryOp::LESS: sse(0x66, 0x2E, right, left); bytes({0x0F, 0x97, 0xC0}); return;
+            case BinaryOp::LESS_EQUAL: sse(0x66, 0x2E, right, left); bytes({0x0F, 0x93, 0xC0}); return;
+            case BinaryOp::EQUAL:
+                sse(0x66, 0x2E, left, right);
+                bytes({0x0F, 0x94, 0xC0, 0x41, 0x0F, 0x9B, 0xC2, 0x44, 0x20, 0xD0}); // sete al; setnp r10b; and al, r10b
+                return;
+            case BinaryOp::NOT_EQUAL:
+                sse(0x66, 0x2E, left, right);
+                bytes({0x0F, 0x95, 0xC0, 0x41, 0x0F, 0x9A, 0xC2, 0x44, 0x08, 0xD0}); // setne al; setp r10b; or al, r10b
+                return;
+        }
+    }
+
+    void visitUnary(Unary& expr) override
+    {
+        expr.right->accept(*this);
+        if(expr.op.token_type == TokenType::MINUS)
+        {
+            fromXmm(target);
+            bytes({0x48, 0x0F, 0xBA, 0xF8, 0x3F}); // btc rax, 63
+            toXmm(target);
+        }
+        else
+        {
+            bytes({0x34, 0x01}); // xor al, 1
+        }
+    }
+
+    void visitLiteral(Literal& expr) override
+    {
+        bytes({0x48, 0xB8}); // mov rax, imm64
+        imm64(expr.constant().raw());
+        toXmm(target);
+    }
+
+    void visitGrouping(Grouping& expr) override
+    {
+        expr.expression->accept(*this);
+    }
+
+    void visitVariable(Variable& expr) override
+    {
+        if(in_loop)
+        {
+            touch(expr.variable);
+            if(expr.variable.depth < 0)
+            {
+                load(RAX, RCX, globalOffset(expr.variable));
+            }
+            else
+            {
+                loadVariable(expr.variable);
+            }
+        }
+        else
+        {
+            loadVariable(expr.variable);
+            guardNumber();
+        }
+        toXmm(target);
+    }
+
+    // Only in loops. NaNs are canonicalized as Value::number does, since a
+    // negative one would read as a pointer.
+    void visitAssign(Assign& expr) override
+    {
+        target = 0;
+        expr.value->accept(*this);
+        sse(0x66, 0x2E, 0, 0); // ucomisd xmm0, xmm0
+        fromXmm(0);
+        bytes({0x7B, 0x0A, 0x48, 0xB8}); // jnp +10; mov rax, imm64
+        imm64(Value::number(std::numeric_limits<double>::quiet_NaN()).raw());
+        touch(expr.variable);
+        storeVariable(expr.variable);
+    }
+
+    void visitExpression(ExpressionStatement& stmt) override
+    {
+        stmt.expression->accept(*this);
+    }
+
+    void visitBlock(BlockStatement& stmt) override
+    {
+        for(Statement* inner: stmt.statements)
+        {
+            inner->accept(*this);
+        }
+    }
+
+    void visitIf(IfStatement& stmt) override
+    {
+        std::size_t skip = branchIfFalse(stmt.condition);
+        stmt.then_branch->accept(*this);
+        if(stmt.else_branch)
+        {
+            std::size_t end = jump(0);
+            patch(skip, code.size());
+            stmt.else_branch->accept(*this);
+            skip = end;
+        }
+        patch(skip, code.size());
+    }
+
+    void visitWhile(WhileStatement& stmt) override
+    {
+        whileLoop(stmt.condition, stmt.body);
+    }
+
+    [[noreturn]] static void unplanned()
+    {
+        throw std::logic_error("The JIT planner only selects arithmetic over literals and variables.");
+    }
+    void visitLogical(Logical&) override
+    {
+        unplanned();
+    }
+    void visitCall(Call&) override
+    {
+        unplanned();
+    }
+    void visitGet(Get&) override
+    {
+        unplanned();
+    }
+    void visitSet(Set&) override
+    {
+        unplanned();
+    }
+    void visitThis(This&) override
+    {
+        unplanned();
+    }
+    void visitSuper(Super&) override
+    {
+        unplanned();
+    }
+    void visitInvoke(Invoke&) override
+    {
+        unplanned();
+    }
+    void visitPrint(PrintStatement&) override
+    {
+        unplanned();
+    }
+    void visitVar(VarStatement&) override
+    {
+        unplanned();
+    }
+    void visitFunction(FunctionStatement&) override
+    {
+        unplanned();
+    }
+    void visitReturn(ReturnStatement&) override
+    {
+        unplanned();
+    }
+    void visitClass(ClassStatement&) override
+    {
+        unplanned();
+    }
+
+    int                      target  = 0; // xmm register for the next number
+    bool                     in_loop = false;
+    std::vector<VariableRef> touched; // by the loop
+    std::vector<std::size_t> bail_jumps;
+    std::vector<std::size_t> interrupt_jumps;
+};
+} // namespace
+
+JitFunction JitExpression::compile()
+{
+    Assembler assembler;
+    if(loop_body)
+    {
+        assembler.loop(original, loop_body);
+    }
+    else
+    {
+        assembler.function(original, result);
+    }
+    return reinterpret_cast<JitFunction>(space.place(assembler.code));
+}
+
+JitCode::~JitCode()
+{
+    for(const Block& block: blocks)
+    {
+        munmap(block.memory, block.size);
+    }
+}
+
+void* JitCode::place(const std::vector<std::uint8_t>& code)
+{
+    std::size_t size = (code.size() + 15) & ~std::size_t{15};
+    if(blocks.empty() || blocks.back().size - blocks.back().used < size)
+    {
+        std::size_t page   = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        std::size_t length = std::max(block_size, (size + page - 1) / page * page);
+        void* memory = mmap(nullptr, length, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(memory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        blocks.push_back({static_cast<std::uint8_t*>(memory), length, 0});
+    }
+    Block& block = blocks.back();
+    if(mprotect(block.memory, block.size, PROT_READ | PROT_WRITE) != 0)
+    {
+        return nullptr;
+    }
+    std::uint8_t* start = block.memory + block.used;
+    std::memcpy(start, code.data(), code.size());
+    block.used += size;
+    if(mprotect(block.memory, block.size, PROT_READ | PROT_EXEC) != 0)
+    {
+        return nullptr;
+    }
+    return start;
+}
+
+#else
+
+JitFunction JitExpression::compile()
+{
+    return nullptr;
+}
+
+JitCode::~JitCode() = default;
+
+void* JitCode::place(const std::vector<std::uint8_t>&)
+{
+    return nullptr;
+}
+
+#endif // INTERPRETER_JIT
@@ -0,0 +1,225 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "arena.h"
+#include "parser.h"
+
+// Set by the build on x86-64 Linux (see INTERPRETER_JIT in CMakeLists.txt).
+// Without it the tree can still be planned, but nothing is ever compiled.
+#ifndef INTERPRETER_JIT
+#define INTERPRETER_JIT 0
+#endif
+
+inline constexpr bool jit_supported = INTERPRETER_JIT;
+
+// What compiled code reads: the running frame, closure upvalues and
+// globals, and the environment's interrupt flag, which loops check.
+struct JitFrame
+{
+    const Value*               frame;
+    ObjUpvalue* const*         upvalues; // nullptr at top level
+    const Environment::Global* globals;
+    std::size_t                global_count;
+    const std::atomic<bool>*   interrupt;
+};
+
+// Native code for one expression. Returns 0 when a guard failed (an operand
+// was not a number, or a global was undefined) and the expression must be
+// run by the tree walker instead; 1 with the result in *number; 2 for false
+// and 3 for true; or 4 when a loop stopped because interrupt was set.
+using JitFunction = int (*)(const JitFrame* frame, double* number);
+
+// Executable memory for the compiled code of one tree, handed out from
+// blocks that are only writable while code is being copied in. The planner
+// allocates it in the tree's arena, so the code is unmapped when the nodes
+// that call it are released, whether that is at exit or when a server
+// evicts the program.
+class JitCode
+{
+public:
+    JitCode() = default;
+    ~JitCode();
+
+    JitCode(const JitCode&)            = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    // Copies code in and returns where it is, or nullptr if no memory could
+    // be mapped.
+    void* place(const std::vector<std::uint8_t>& code);
+
+private:
+    static constexpr std::size_t block_size = 64 * 1024;
+
+    struct Block
+    {
+        std::uint8_t* memory;
+        std::size_t   size;
+        std::size_t   used;
+    };
+
+    std::vector<Block> blocks;
+};
+
+// A subtree of number arithmetic and comparisons over literals and
+// variables, which are the only operands compiled code handles. It runs in
+// the tree walker until it has been evaluated hot_threshold times, then is
+// compiled to x86-64. Compiled code has no side effects, so when a guard
+// fails the original tree simply runs instead; a site that keeps failing
+// goes back to the tree for good.
+//
+// As the condition of a while loop whose body only assigns such arithmetic
+// to variables (under more such loops and ifs), it carries the body too and
+// compiles the whole loop. Each evaluation is then an iteration, and once
+// hot the compiled code checks that every variable the loop touches holds a
+// number, runs the remaining iterations and leaves false as the condition's
+// value, so the WhileStatement ends. Nothing but numbers can be stored
+// while it runs, so those checks hold throughout; when they fail up front,
+// one more iteration runs in the tree. Every loop in the code also checks
+// the environment's interrupt flag as it goes round.
+class JitExpression : public Expression
+{
+public:
+    enum class Result : std::uint8_t
+    {
+        NUMBER,
+        BOOL
+    };
+
+    static constexpr std::uint32_t hot_threshold = 1000;
+    static constexpr std::uint32_t max_bailouts  = 100;
+
+    Expression* original;
+    Result      result;
+    Statement*  loop_body; // nullptr unless this is a compiled loop's condition
+
+    // The code goes into space, which must outlive the expression.
+    JitExpression(JitCode& space, Expression* original, Result result, Statement* loop_body = nullptr)
+        : original(original), result(result), loop_body(loop_body), space(space)
+    {
+    }
+
+    // Invisible to printing and to the passes, which see the original.
+    virtual std::string form_string() override
+    {
+        return original->form_string();
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        if(code)
+        {
+            std::span<const Environment::Global> globals  = env.globalSlots();
+            ObjUpvalue* const*                   upvalues = env.closure ? env.closure->upvalues() : nullptr;
+            JitFrame frame{env.frame, upvalues, globals.data(), globals.size(), env.interrupt};
+            double   number;
+            switch(code(&frame, &number))
+            {
+                case 1: return Value::number(number);
+                case 2: return Value::boolean(false);
+                case 3: return Value::boolean(true);
+                case 4: Environment::interrupted();
+                default:
+                    if(++bailouts == max_bailouts)
+                    {
+                        code = nullptr;
+                    }
+                    break;
+            }
+        }
+        else if(++count == hot_threshold)
+        {
+            code = compile();
+        }
+        return original->evaluate(env);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        original->accept(visitor);
+    }
+
+private:
+    // nullptr if the JIT is unavailable or the code could not be placed.
+    JitFunction compile();
+
+    JitCode&      space;
+    JitFunction   code     = nullptr;
+    std::uint32_t count    = 0;
+    std::uint32_t bailouts = 0;
+};
+
+// Wraps each maximal subtree of the program that compiled code can run, and
+// the condition of each loop it can run whole, in a JitExpression. Runs
+// after the Resolver and Optimizer, on a tree that only the tree walker
+// will execute.
+class JitPlanner : private ExpressionVisitor, private StatementVisitor
+{
+public:
+    // Wrappers, and the memory for their code, are allocated in arena,
+    // normally the one the tree lives in.
+    explicit JitPlanner(Arena& arena) : arena(arena) {}
+
+    void plan(Statement* stmt);
+
+    // xmm0-xmm15 hold the intermediate numbers.
+    static constexpr int max_registers = 16;
+
+private:
+    // A subtree and, if compiled code can run it, what it produces, how
+    // many registers that takes and whether it does any arithmetic at all
+    // (a lone variable or literal is not worth a call). assignment marks an
+    // assignment of a compilable number, which a compiled loop can run.
+    struct Planned
+    {
+        Expression*           expr;
+        bool                  compilable = false;
+        JitExpression::Result result     = JitExpression::Result::NUMBER;
+        int                   registers  = 0;
+        bool                  operation  = false;
+        bool                  assignment = false;
+    };
+
+    Planned     planned(Expression* expr);
+    // The subtree, wrapped if it is worth compiling on its own.
+    Expression* finish(const Planned& planned);
+    Expression* plan(Expression* expr);
+    // Where wrappers put their code, created with the first one.
+    JitCode&    codeSpace();
+
+    void visitBinary(Binary& expr) override;
+    void visitUnary(Unary& expr) override;
+    void visitLiteral(Literal& expr) override;
+    void visitGrouping(Grouping& expr) override;
+    void visitVariable(Variable& expr) override;
+    void visitAssign(Assign& expr) override;
+    void visitLogical(Logical& expr) override;
+    void visitCall(Call& expr) override;
+    void visitGet(Get& expr) override;
+    void visitSet(Set& expr) override;
+    void visitThis(This& expr) override;
+    void visitSuper(Super& expr) override;
+    void visitInvoke(Invoke& expr) override;
+
+    void visitPrint(PrintStatement& stmt) override;
+    void visitExpression(ExpressionStatement& stmt) override;
+    void visitVar(VarStatement& stmt) override;
+    void visitBlock(BlockStatement& stmt) override;
+    void visitIf(IfStatement& stmt) override;
+    void visitWhile(WhileStatement& stmt) override;
+    void visitFunction(FunctionStatement& stmt) override;
+    void visitReturn(ReturnStatement& stmt) override;
+    void visitClass(ClassStatement& stmt) override;
+
+    Arena&   arena;
+    JitCode* space = nullptr;
+    Planned  result{};
+    // Whether compiled loop code can run the statement just planned.
+    bool     runnable = false;
+};
+
+#endif // JIT_H
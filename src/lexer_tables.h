@@ -0,0 +1,153 @@
+#ifndef LEXER_TABLES_H
+#define LEXER_TABLES_H
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include "token.h"
+
+// Compile-time lookup tables for the tokenizer: a 256-entry character class
+// table that drives token dispatch, and a perfect hash over the reserved
+// words.
+
+enum class CharClass : std::uint8_t
+{
+    INVALID,    // not valid anywhere outside a string or comment
+    WHITESPACE, // ' ', '\t', '\r', '\n'
+    DIGIT,
+    ALPHA,      // letters and '_'
+    QUOTE,
+    SLASH,      // '/' or the start of a comment
+    SINGLE,     // always a one-character token
+    EQUAL_PAIR  // '!', '=', '<', '>': one character, or two with a trailing '='
+};
+
+struct CharInfo
+{
+    CharClass cls    = CharClass::INVALID;
+    TokenType single = TokenType::END_OF_FILE; // SINGLE and EQUAL_PAIR
+    TokenType paired = TokenType::END_OF_FILE; // EQUAL_PAIR followed by '='
+};
+
+inline constexpr std::array<CharInfo, 256> char_table = [] {
+    std::array<CharInfo, 256> table{};
+    for(char ch: {' ', '\t', '\r', '\n'})
+    {
+        table[static_cast<unsigned char>(ch)].cls = CharClass::WHITESPACE;
+    }
+    for(int ch = '0'; ch <= '9'; ++ch)
+    {
+        table[ch].cls = CharClass::DIGIT;
+    }
+    for(int ch = 'a'; ch <= 'z'; ++ch)
+    {
+        table[ch].cls                = CharClass::ALPHA;
+        table[ch - 'a' + 'A'].cls    = CharClass::ALPHA;
+    }
+    table['_'].cls = CharClass::ALPHA;
+    table['"'].cls = CharClass::QUOTE;
+    table['/'].cls = CharClass::SLASH;
+
+    auto single = [&](char ch, TokenType type) {
+        table[static_cast<unsigned char>(ch)] = {CharClass::SINGLE, type, type};
+    };
+    single('(', TokenType::LEFT_PAREN);
+    single(')', TokenType::RIGHT_PAREN);
+    single('{', TokenType::LEFT_BRACE);
+    single('}', TokenType::RIGHT_BRACE);
+    single(',', TokenType::COMMA);
+    single('.', TokenType::DOT);
+    single('-', TokenType::MINUS);
+    single('+', TokenType::PLUS);
+    single(';', TokenType::SEMICOLON);
+    single('*', TokenType::STAR);
+
+    auto pair = [&](char ch, TokenType alone, TokenType with_equal) {
+        table[static_cast<unsigned char>(ch)] = {CharClass::EQUAL_PAIR, alone, with_equal};
+    };
+    pair('!', TokenType::BANG, TokenType::BANG_EQUAL);
+    pair('=', TokenType::EQUAL, TokenType::EQUAL_EQUAL);
+    pair('<', TokenType::LESS, TokenType::LESS_EQUAL);
+    pair('>', TokenType::GREATER, TokenType::GREATER_EQUAL);
+    return table;
+}();
+
+inline constexpr const CharInfo& charInfo(char ch)
+{
+    return char_table[static_cast<unsigned char>(ch)];
+}
+
+struct KeywordEntry
+{
+    std::string_view text;
+    TokenType        type = TokenType::IDENTIFIER;
+};
+
+inline constexpr KeywordEntry reserved_words[] = {
+    {"and", TokenType::AND},
+    {"class", TokenType::CLASS},
+    {"else", TokenType::ELSE},
+    {"false", TokenType::FALSE},
+    {"for", TokenType::FOR},
+    {"fun", TokenType::FUN},
+    {"if", TokenType::IF},
+    {"nil", TokenType::NIL},
+    {"or", TokenType::OR},
+    {"print", TokenType::PRINT},
+    {"return", TokenType::RETURN},
+    {"super", TokenType::SUPER},
+    {"this", TokenType::THIS},
+    {"true", TokenType::TRUE},
+    {"var", TokenType::VAR},
+    {"while", TokenType::WHILE}};
+
+inline constexpr std::size_t keyword_table_size = 32;
+inline constexpr std::size_t keyword_max_length = 6;
+
+// Perfect for the reserved words above: no two of them share a slot (checked
+// below), so a lookup is one hash and at most one string comparison.
+inline constexpr std::size_t keywordHash(const char* text, std::size_t length)
+{
+    return (static_cast<unsigned char>(text[0]) + static_cast<unsigned char>(text[length - 1]) * 5 +
+            length) &
+        (keyword_table_size - 1);
+}
+
+inline constexpr std::array<KeywordEntry, keyword_table_size> keyword_table = [] {
+    std::array<KeywordEntry, keyword_table_size> table{};
+    for(const KeywordEntry& word: reserved_words)
+    {
+        table[keywordHash(word.text.data(), word.text.size())] = word;
+    }
+    return table;
+}();
+
+static_assert(
+    [] {
+        for(const KeywordEntry& word: reserved_words)
+        {
+            if(keyword_table[keywordHash(word.text.data(), word.text.size())].text != word.text)
+            {
+                return false;
+            }
+        }
+        return true;
+    }(),
+    "keywordHash collides for two reserved words; adjust its multipliers");
+
+// Token type of an identifier-shaped lexeme: the keyword it spells, or
+// IDENTIFIER.
+inline TokenType identifierType(const char* text, std::size_t length)
+{
+    if(length < 2 || length > keyword_max_length)
+    {
+        return TokenType::IDENTIFIER;
+    }
+    const KeywordEntry& entry = keyword_table[keywordHash(text, length)];
+    return entry.text.size() == length && std::memcmp(entry.text.data(), text, length) == 0
+        ? entry.type
+        : TokenType::IDENTIFIER;
+}
+
+#endif // LEXER_TABLES_H
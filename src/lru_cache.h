@@ -0,0 +1,75 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// A map that holds at most `capacity` entries and evicts the least recently
+// used one to make room. Entries are kept in a list in order of use, most
+// recent first, with a hash index into it, so lookups, inserts and
+// evictions are all constant time. Values never move, so pointers to them
+// stay valid until their entry is evicted or replaced.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache
+{
+public:
+    explicit LruCache(std::size_t capacity) : capacity(capacity) {}
+
+    LruCache(const LruCache&)            = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    // The value for key, now the most recently used, or nullptr.
+    Value* find(const Key& key)
+    {
+        auto found = index.find(key);
+        if(found == index.end())
+        {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        return &found->second->second;
+    }
+
+    // Stores value under key, replacing any value it had, and returns it.
+    // With a capacity of 0 nothing is kept and the value is returned from
+    // a scratch slot that the next insert overwrites.
+    Value& insert(const Key& key, Value value)
+    {
+        if(auto found = index.find(key); found != index.end())
+        {
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        if(capacity == 0)
+        {
+            scratch = std::move(value);
+            return scratch;
+        }
+        while(entries.size() >= capacity)
+        {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(key, std::move(value));
+        index.emplace(key, entries.begin());
+        return entries.front().second;
+    }
+
+    std::size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    using Entries = std::list<std::pair<Key, Value>>;
+
+    std::size_t                                                capacity;
+    Entries                                                    entries;
+    std::unordered_map<Key, typename Entries::iterator, Hash> index;
+    Value                                                      scratch{};
+};
+
+#endif // LRU_CACHE_H
@@ -1,205 +1,715 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
-#include <string>
-#include <fstream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "batch.h"
+#include "closure_compiler.h"
+#include "compiler.h"
+#include "heap.h"
+#include "intern.h"
+#include "jit.h"
+#include "lru_cache.h"
+#include "optimizer.h"
+#include "output.h"
+#include "parallel_lex.h"
+#include "source.h"
+#include "stream.h"
 #include "tokenize.h"
 #include "parser.h"
+#include "resolver.h"
+#include "serve.h"
+#include "vm.h"
 
-std::string read_file_contents(const std::string& filename)
-{
-    std::ifstream file(filename);
-    if (!file.is_open())
-    {
-        std::cerr << "Error reading file: " << filename << std::endl;
-        std::exit(1);
-    }
+// Set by --stream: lex the input in fixed-size chunks instead of loading it
+// whole. Applies to tokenize and run.
+bool stream_input = false;
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    file.close();
+// Set by --jobs=N: number of lexer threads for large inputs, or of worker
+// threads for batch and serve. 0 picks one per core (for lexing, once the
+// input reaches parallel_lex_threshold).
+unsigned lex_jobs = 0;
 
-    return buffer.str();
-}
+// Set by --engine=tree|closure|vm: walk the tree, run it compiled into
+// closures, or run it through the bytecode compiler and VM.
+enum class Engine { TREE, CLOSURE, VM };
+Engine engine = Engine::TREE;
 
-// Helper function to extract a string token
-void extractStringToken(const std::string& token, std::vector<Token>& tokenList) {
-    int first = token.find_first_of('"');
-    int last = token.find_last_of('"');
-    if (first != std::string::npos && last != std::string::npos && first < last) {
-        std::string lexeme = token.substr(first + 1, last - first - 1);
-        tokenList.push_back(Token(TokenType::STRING, lexeme, lexeme, 0));
-    }
-}
+// Set by --jit: let the tree walker compile hot arithmetic to native code.
+// Only in builds with INTERPRETER_JIT; the other engines ignore it.
+bool use_jit = false;
 
-// Helper function to extract a general token
-void extractGeneralToken(const std::string& token, std::vector<Token>& tokenList) {
-    std::istringstream iss(token);
-    std::string tktype;
-    iss >> tktype;
-    std::string lexeme;
-    iss >> lexeme;
-    std::string literal;
-    if (!(iss >> literal)) {
-        literal = " ";
+// Set by -O0 / -O1: whether evaluate and run optimize the tree before
+// executing it. --optimized makes parse print the optimized tree, which is
+// what the optimize command always does.
+int optimize_level = 1;
+bool parse_optimized = false;
+
+// Set by --gc-stats: report the collector's work on stderr at exit.
+// --gc-growth=F sets how far the old generation may grow between full
+// collections.
+bool gc_stats = false;
+double gc_growth = 2.0;
+
+// Set by --socket PATH: where serve listens and client connects. --cache=N
+// sets how many submissions each serve worker keeps, and --timeout=MS how
+// long serve lets a request run before stopping it (0 for no limit);
+// --inline makes client send the source instead of the file's path.
+std::string socket_path;
+std::size_t cache_size = 64;
+std::chrono::milliseconds request_timeout{0};
+bool send_inline = false;
+
+// Everything the interpreted program (or tokenize/parse) prints goes through
+// this buffer rather than std::cout. It is flushed when it fills up, before
+// an error is reported on stderr, and at exit.
+OutputBuffer stdout_buffer(STDOUT_FILENO);
+std::ostream output(&stdout_buffer);
+
+// Splits the command line into the command, options and the input files:
+// one for every command but batch, which takes any number, serve, which
+// takes none, and client, which takes the command to send and its file.
+// "-" names standard input.
+bool parseArguments(const std::vector<std::string>& args, std::string& command, std::vector<std::string>& inputs) {
+    if (args.empty()) return false;
+    command = args[0];
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (arg == "--stream") {
+            stream_input = true;
+        }
+        else if (arg == "--engine=tree") {
+            engine = Engine::TREE;
+        }
+        else if (arg == "--engine=closure") {
+            engine = Engine::CLOSURE;
+        }
+        else if (arg == "--engine=vm") {
+            engine = Engine::VM;
+        }
+        else if (arg == "--jit") {
+            if (!jit_supported) {
+                std::cerr << "--jit is not available in this build" << std::endl;
+                return false;
+            }
+            use_jit = true;
+        }
+        else if (arg == "-O0" || arg == "-O1") {
+            optimize_level = arg[2] - '0';
+        }
+        else if (arg == "--optimized") {
+            parse_optimized = true;
+        }
+        else if (arg == "--gc-stats") {
+            gc_stats = true;
+        }
+        else if (arg.rfind("--gc-growth=", 0) == 0) {
+            gc_growth = std::stod(arg.substr(12));
+            if (!(gc_growth > 1)) {
+                std::cerr << "--gc-growth must be greater than 1" << std::endl;
+                return false;
+            }
+        }
+        else if (arg.rfind("--jobs=", 0) == 0) {
+            lex_jobs = std::stoul(arg.substr(7));
+        }
+        else if (arg == "--socket" && i + 1 < args.size()) {
+            socket_path = args[++i];
+        }
+        else if (arg.rfind("--cache=", 0) == 0) {
+            cache_size = std::stoul(arg.substr(8));
+        }
+        else if (arg.rfind("--timeout=", 0) == 0) {
+            request_timeout = std::chrono::milliseconds(std::stoul(arg.substr(10)));
+        }
+        else if (arg == "--inline") {
+            send_inline = true;
+        }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+        else if (command == "client" && inputs.empty()) {
+            inputs.push_back(arg);
+        }
+        else if (command == "batch" || inputs.size() < (command == "client" ? 2u : command == "serve" ? 0u : 1u)) {
+            inputs.push_back(arg == "-" ? "/dev/stdin" : arg);
+        }
+        else {
+            return false;
+        }
     }
-    tokenList.push_back(Token(tktype, lexeme, literal, 0));
+    if (command == "serve")
+        return !socket_path.empty();
+    if (command == "client")
+        return !socket_path.empty() && inputs.size() == 2;
+    return !inputs.empty();
 }
 
-void tokenConvert(const std::vector<std::string> &tokens, std::vector<Token> &tokenList)
-{
-    for (const std::string& token : tokens) {
-        std::istringstream iss(token);
-        std::string tktype;
-        iss >> tktype;
-        if (tktype == "STRING") {
-            extractStringToken(token, tokenList);
+// The commands below write what the program prints to out and errors to
+// err, which are the process's own streams except in batch jobs, and
+// return the exit status: 0, 65 for a compile error or 70 for a runtime
+// error. out is flushed before anything is written to err.
+
+// A parsed program or expression made ready for the selected engine:
+// resolved and optimized, and compiled for the closure engine or the VM.
+// It can then be run any number of times, each time with fresh globals.
+// Points into the arena that holds the tree.
+struct PreparedCode {
+    GlobalNames globals;
+    std::vector<Statement*> program;
+    Expression* expression = nullptr; // instead of program, for evaluate
+    bool print = true;                // whether evaluate prints the value
+    int frame_size = 0;
+    Chunk chunk;
+    std::vector<CompiledStatement*> compiled;
+    CompiledExpression* compiled_expression = nullptr;
+};
+
+// Resolves code.expression, which has already been optimized, and compiles
+// it for the engine. Errors give 70, as they would have at run time.
+int prepareExpression(PreparedCode& code, Arena& arena, std::ostream& out, std::ostream& err) {
+    Resolver(arena, code.globals).resolve(code.expression);
+    try {
+        if (engine == Engine::VM) {
+            Compiler compiler(code.chunk);
+            compiler.expressionStatement(code.expression, code.print);
+            compiler.finish();
         }
-        else {
-            extractGeneralToken(token, tokenList);
+        else if (engine == Engine::CLOSURE) {
+            code.compiled_expression = ClosureCompiler(arena).compile(code.expression);
         }
     }
+    catch (const std::exception& e) {
+        out.flush();
+        err << e.what() << '\n';
+        return 70;
+    }
+    return 0;
 }
 
-// Function to evaluate the parsed expression
-void evaluateExpression(const std::shared_ptr<Expression>& expr, bool print = true) {
+int runExpression(PreparedCode& code, std::ostream& out, std::ostream& err, const std::atomic<bool>* interrupt) {
+    Environment env(out, code.globals);
+    if (interrupt)
+        env.interrupt = interrupt;
     try {
-        auto d = expr->evaluate();
-        if (print)
+        if (engine == Engine::VM) {
+            VM vm(env);
+            vm.run(code.chunk);
+            return 0;
+        }
+        auto d = code.compiled_expression ? (*code.compiled_expression)(env) : code.expression->evaluate(env);
+        if (code.print)
         {
-            if (std::holds_alternative<double>(d))
-                std::cout << std::get<double>(d) << std::endl;
-            else if (std::holds_alternative<bool>(d)) {
-                if (std::get<bool>(d))
-                    std::cout << "true" << std::endl;
-                else
-                    std::cout << "false" << std::endl;
-            }
-            else
-                std::cout << std::get<std::string>(d) << std::endl;
+            printValue(out, d);
+            out << '\n';
         }
     }
     catch (const std::exception& e) {
-        std::cerr << e.what() << '\n';
-        exit(70);
+        out.flush();
+        err << e.what() << '\n';
+        return 70;
     }
+    return 0;
 }
 
-// Function to parse the expression
-std::shared_ptr<Expression> parseExpression(Parser& parser) {
-    std::shared_ptr<Expression> expr = parser.parse();
-    if (expr == nullptr) {
-        exit(65);
-        throw std::runtime_error("Failed to parse expression");
+// Function to print tokens, formatting each one only at output time. Writes
+// straight to the stream's buffer.
+void printTokens(const std::vector<Token>& tokens, std::string_view source, std::streambuf& sink) {
+    auto write = [&sink](std::string_view text) { sink.sputn(text.data(), static_cast<std::streamsize>(text.size())); };
+    for (const Token& token : tokens) {
+        write(tokenTypeName(token.token_type));
+        sink.sputc(' ');
+        write(token.lexeme(source));
+        sink.sputc(' ');
+        write(token.literal(source));
+        sink.sputc('\n');
     }
-    return expr;
 }
 
-// Function to evaluate or print the parsed expression
-void evaluateOrPrintExpression(const std::shared_ptr<Expression>& expr, const std::string& command, bool print = true) {
-    if (command == "evaluate" || command == "run") {
-        evaluateExpression(expr, print);
+// Resolves code.program's variables, numbering its globals in globals,
+// optimizes it and compiles it for the selected engine. Scope errors give
+// 65; errors found while optimizing or compiling give 70, as they would
+// have at run time.
+int prepareProgram(PreparedCode& code, Arena& arena, GlobalNames& globals, std::ostream& out, std::ostream& err) {
+    const std::vector<Statement*>& program = code.program;
+    try {
+        code.frame_size = Resolver(arena, globals).resolve(program);
     }
-    else {
-        std::cout << expr->form_string() << std::endl;
+    catch (const std::exception& e) {
+        out.flush();
+        err << e.what() << '\n';
+        return 65;
     }
-}
-
-// Function to print tokens
-void printTokens(const std::vector<std::string>& tokens) {
-    for (const std::string& token : tokens) {
-        std::cout << token << std::endl;
+    try {
+        if (optimize_level > 0) {
+            Optimizer optimizer(arena);
+            for (Statement* stmt : program)
+                optimizer.optimize(stmt);
+        }
+        if (engine == Engine::VM) {
+            Compiler compiler(code.chunk);
+            for (Statement* stmt : program)
+                compiler.statement(stmt);
+            compiler.finish();
+        }
+        else if (engine == Engine::CLOSURE) {
+            ClosureCompiler compiler(arena);
+            for (Statement* stmt : program)
+                code.compiled.push_back(compiler.compile(stmt));
+        }
+        else if (use_jit) {
+            JitPlanner planner(arena);
+            for (Statement* stmt : program)
+                planner.plan(stmt);
+        }
     }
+    catch (const std::exception& e) {
+        out.flush();
+        err << e.what() << '\n';
+        return 70;
+    }
+    return 0;
 }
 
-// New function to handle parsing and evaluating or printing the expression
-void parseAndEvaluateOrPrint(Parser& parser, const std::string& command, bool print = true) {
+// Runs a prepared program, keeping globals in env. Runtime errors give 70.
+int runProgram(PreparedCode& code, Environment& env, std::ostream& err) {
     try {
-        std::shared_ptr<Expression> expr = parseExpression(parser);
-        evaluateOrPrintExpression(expr, command, print);
+        if (engine == Engine::VM) {
+            VM vm(env);
+            vm.run(code.chunk);
+            return 0;
+        }
+        env.enterFrame(code.frame_size);
+        if (engine == Engine::CLOSURE) {
+            for (CompiledStatement* stmt : code.compiled)
+                (*stmt)(env);
+            return 0;
+        }
+        for (Statement* stmt : code.program)
+            stmt->execute(env);
     }
     catch (const std::exception& e) {
-        std::cerr << e.what() << std::endl;
-        exit(65);
+        env.out.flush();
+        err << e.what() << '\n';
+        return 70;
     }
+    return 0;
 }
 
-// New function to handle breaking the list at semicolons and parsing and evaluating
-void processRunCommand(const std::vector<Token>& tokenList, const std::string& command) {
-    std::pair<TokenType, std::vector<Token>> tokenPair;
-    tokenPair.first = TokenType::END_OF_FILE;
-    bool is_first = true;
-    for (const auto& token : tokenList) {
-        if (token.token_type == TokenType::SEMICOLON) {
-            if (tokenPair.second.empty()) {
-                exit(65);
+// Prepares a parsed program and runs it with the selected engine, keeping
+// globals in env. Nothing runs if preparing it fails.
+int executeProgram(const std::vector<Statement*>& program, Arena& arena, Environment& env, std::ostream& err) {
+    PreparedCode code;
+    code.program = program;
+    if (int status = prepareProgram(code, arena, env.globalNames(), env.out, err))
+        return status;
+    return runProgram(code, env, err);
+}
+
+// Streaming run: each declaration runs as soon as
+// it has been parsed, so output before a syntax error is kept. A declaration
+// whose parse looked at the end of what has been lexed so far is retried
+// once the next batch is in. The stream's window moves between batches, so
+// pending tokens point into a private copy of their lexemes. Each
+// declaration's tree is dropped once it has run, unless it declared a
+// function, which may be called later and keeps its arena alive. Returns
+// the exit status.
+int processRunStream(TokenStream& stream) {
+    std::vector<Token> batch;
+    std::string_view window;
+    std::vector<Token> pending;
+    std::string text;
+    std::vector<Statement*> single(1);
+    auto arena = std::make_unique<Arena>();
+    std::vector<std::unique_ptr<Arena>> retained;
+    GlobalNames globals;
+    Environment env(output, globals);
+    // A declaration can only end at a ';' or '}' outside any brackets, and
+    // not when 'else' follows. Parsing waits for such a point, so that a
+    // declaration spanning many batches is parsed once, not once per batch.
+    // ready is the index in pending just past the last one.
+    int depth = 0;
+    bool at_end = false;
+    size_t ready = 0;
+    while (stream.next(batch, window)) {
+        if (stream.status()) return stream.status();
+        bool final = !batch.empty() && batch.back().token_type == TokenType::END_OF_FILE;
+        for (const Token& token : batch) {
+            TokenType type = token.token_type;
+            if (type != TokenType::END_OF_FILE) {
+                if (at_end && type != TokenType::ELSE)
+                    ready = pending.size();
+                if (type == TokenType::LEFT_PAREN || type == TokenType::LEFT_BRACE)
+                    ++depth;
+                else if (type == TokenType::RIGHT_PAREN || type == TokenType::RIGHT_BRACE)
+                    --depth;
+                at_end = depth <= 0 && (type == TokenType::SEMICOLON || type == TokenType::RIGHT_BRACE);
+                pending.push_back(Token(type, text.size(), token.length, token.line, token.symbol));
+                text.append(token.lexeme(window));
+                text.push_back(' ');
             }
-            tokenPair.second.push_back(Token(TokenType::END_OF_FILE, "null", "", 0));
-            Parser parser(tokenPair.second);
-            parseAndEvaluateOrPrint(parser, command, tokenPair.first == TokenType::PRINT);
-            tokenPair.second.clear();
-            tokenPair.first = TokenType::END_OF_FILE;
-            is_first = true;
-        }
-        else if (is_first && token.token_type == TokenType::PRINT) {
-            tokenPair.first = TokenType::PRINT;
         }
-        else {
-            is_first = false;
-            tokenPair.second.push_back(token);
+        // A batch that stops at such a point is tried as well, so output is
+        // not held back until more input arrives; only an 'if' waiting for
+        // its 'else' is parsed again.
+        size_t limit = final || at_end ? pending.size() : ready;
+        int line = pending.empty() ? batch.back().line : pending.back().line;
+        pending.push_back(Token(TokenType::END_OF_FILE, text.size(), 0, line));
+
+        size_t next = 0;
+        while (next < limit) {
+            Parser parser(std::span<const Token>(pending).subspan(next), text, *arena);
+            Statement* stmt = parser.parseDeclaration();
+            if (parser.reachedEnd() && !final) {
+                arena->reset();
+                break;
+            }
+            if (stmt == nullptr) {
+                return 65;
+            }
+            single[0] = stmt;
+            if (int status = executeProgram(single, *arena, env, std::cerr))
+                return status;
+            if (parser.functionCount() > 0) {
+                retained.push_back(std::move(arena));
+                arena = std::make_unique<Arena>();
+            }
+            else {
+                arena->reset();
+            }
+            next += parser.position();
         }
+
+        // Keep only the unparsed tail, rebased to the start of text.
+        ready = ready > next ? ready - next : 0;
+        pending.erase(pending.begin(), pending.begin() + next);
+        pending.pop_back();
+        size_t base = pending.empty() ? text.size() : pending.front().offset;
+        for (Token& token : pending)
+            token.offset -= base;
+        text.erase(0, base);
+    }
+    return 0;
+}
+
+// Streaming tokenize: each batch is printed as soon as it has been lexed.
+void processTokenizeStream(TokenStream& stream) {
+    std::vector<Token> batch;
+    std::string_view window;
+    while (stream.next(batch, window)) {
+        printTokens(batch, window, stdout_buffer);
+        // Keeps the tokens roughly in step with lexical errors on stderr.
+        output.flush();
     }
 }
 
-// Function to process the command
-void processCommand(const std::string& command, const std::string& filename, int& retVal) {
-    std::string file_contents = read_file_contents(filename);
+// A source made ready for a command: lexed, parsed and, for evaluate and
+// run, prepared to run. The tokens and tree point into source, and the
+// symbols they use are held in pins until the submission goes.
+struct Submission {
+    std::string command;
+    std::string_view source;
+    SymbolPins pins;
+    std::vector<Token> tokens;
+    Arena arena;
+    PreparedCode code;
+    bool runnable = false; // whether code is ready for runSubmission
+};
 
-    std::vector<std::string> tokens;
+// Lexes s.source on the calling thread. Lexical errors go to err. Returns
+// the lexer's status.
+int lexSubmission(Submission& s, std::ostream& err) {
+    std::vector<LexError> errors;
+    int status = 0;
+    StringTable::Pinning pinning(StringTable::current(), s.pins);
     Tokenizer tokenizer;
-    tokenizer.tokenize(file_contents, retVal, tokens);
+    tokenizer.deferErrors(errors);
+    if (s.command != "tokenize")
+        tokenizer.internSymbols(StringTable::current());
+    tokenizer.tokenize(s.source, status, s.tokens);
+    for (const LexError& error : errors)
+        Tokenizer::report(error, err);
+    return status;
+}
 
-    if (command == "parse" || command == "evaluate" || command == "run") {
-        if (retVal) exit(retVal);
+// Carries out command on the lexed s.tokens up to the point of running:
+// tokenize, parse and optimize print their output, evaluate and run are
+// prepared. lex_status is the lexer's. A syntax error is 65.
+int prepareSubmission(Submission& s, int lex_status, std::ostream& out, std::ostream& err) {
+    if (s.command == "tokenize") {
+        printTokens(s.tokens, s.source, *out.rdbuf());
+        return lex_status;
+    }
+    if (lex_status) return lex_status;
+    StringTable::Pinning pinning(StringTable::current(), s.pins);
+    Parser parser(s.tokens, s.source, s.arena);
+    int status;
+    if (s.command == "run") {
+        if (!parser.parseProgram(s.code.program))
+            return 65;
+        status = prepareProgram(s.code, s.arena, s.code.globals, out, err);
+    }
+    else {
+        Expression* expr = nullptr;
+        try {
+            expr = parser.parse();
+            if (expr == nullptr)
+                return 65;
+            bool optimize = s.command == "optimize" || (s.command == "parse" ? parse_optimized : optimize_level > 0);
+            if (optimize) {
+                expr = Optimizer(s.arena).optimize(expr);
+            }
+        }
+        catch (const std::exception& e) {
+            out.flush();
+            err << e.what() << std::endl;
+            return 65;
+        }
+        if (s.command != "evaluate") {
+            out << expr->form_string() << '\n';
+            return 0;
+        }
+        s.code.expression = expr;
+        status = prepareExpression(s.code, s.arena, out, err);
+    }
+    s.runnable = status == 0;
+    return status;
+}
 
-        std::vector<Token> tokenList;
-        tokenConvert(tokens, tokenList);
-        if (command == "run")
-        {
-            processRunCommand(tokenList, command);
+// Runs a prepared submission, each time with fresh globals. Setting
+// interrupt, if given, stops it with a runtime error.
+int runSubmission(Submission& s, std::ostream& out, std::ostream& err, const std::atomic<bool>* interrupt = nullptr) {
+    if (s.code.expression)
+        return runExpression(s.code, out, err, interrupt);
+    Environment env(out, s.code.globals);
+    if (interrupt)
+        env.interrupt = interrupt;
+    return runProgram(s.code, env, err);
+}
+
+// Lexes source on the calling thread and runs command on it. Lexical errors
+// go to err ahead of anything else.
+int processSource(const std::string& command, std::string_view source, std::ostream& out, std::ostream& err) {
+    Submission s;
+    s.command = command;
+    s.source = source;
+    int status = prepareSubmission(s, lexSubmission(s, err), out, err);
+    return s.runnable ? runSubmission(s, out, err) : status;
+}
+
+// One file of a batch, run as the run command would on its own.
+int runBatchFile(const std::string& filename, std::ostream& out, std::ostream& err) {
+    Heap::current().setGrowthFactor(gc_growth);
+    SourceBuffer file_contents;
+    if (!file_contents.open(filename)) {
+        err << "Error reading file: " << filename << '\n';
+        return 1;
+    }
+    return processSource("run", file_contents.text(), out, err);
+}
+
+// What a serve worker keeps of a submission so that the same source sent
+// again for the same command skips lexing, parsing and preparing. For
+// evaluate and run that is the prepared tree, run afresh on every request;
+// otherwise, and whenever the front end failed, what it printed is the
+// whole answer.
+struct CachedSubmission {
+    std::string text; // the source, which the submission points into
+    Submission submission;
+    std::string out;
+    std::string err;
+    int status = 0;
+};
+
+using SubmissionCache = LruCache<std::uint64_t, std::unique_ptr<CachedSubmission>>;
+
+// FNV-1a over the command and the source.
+std::uint64_t submissionKey(std::string_view command, std::string_view source) {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    auto mix = [&hash](std::string_view text) {
+        for (char ch : text) {
+            hash ^= static_cast<unsigned char>(ch);
+            hash *= 0x100000001b3;
         }
-        else {
-            Parser parser(tokenList);
-            parseAndEvaluateOrPrint(parser, command);
+    };
+    mix(command);
+    mix(std::string_view("\0", 1));
+    mix(source);
+    return hash;
+}
+
+// Answers one serve request from cache, lexing and preparing the source
+// first if it is not there. Entries are found by hash and then compared in
+// full, so a collision only costs a miss.
+int answerRequest(SubmissionCache& cache, const ServeRequest& request, std::ostream& out, std::ostream& err) {
+    const std::string& command = request.command;
+    if (command != "tokenize" && command != "parse" && command != "optimize" && command != "evaluate" && command != "run") {
+        err << "Unknown command: " << command << '\n';
+        return 64;
+    }
+    SourceBuffer file_contents;
+    std::string_view source = request.source;
+    if (!request.inline_source) {
+        if (!file_contents.open(request.file)) {
+            err << "Error reading file: " << request.file << '\n';
+            return 1;
         }
+        source = file_contents.text();
     }
-    else if(command == "tokenize")
-    {
-        printTokens(tokens);
+
+    std::uint64_t key = submissionKey(command, source);
+    std::unique_ptr<CachedSubmission>* found = cache.find(key);
+    CachedSubmission* entry = found ? found->get() : nullptr;
+    if (entry == nullptr || entry->submission.command != command || entry->text != source) {
+        auto fresh = std::make_unique<CachedSubmission>();
+        fresh->text.assign(source);
+        Submission& s = fresh->submission;
+        s.command = command;
+        s.source = fresh->text;
+        std::ostringstream front_out;
+        std::ostringstream front_err;
+        fresh->status = prepareSubmission(s, lexSubmission(s, front_err), front_out, front_err);
+        fresh->out = std::move(front_out).str();
+        fresh->err = std::move(front_err).str();
+        entry = cache.insert(key, std::move(fresh)).get();
+    }
+
+    // Lexical errors come ahead of tokenize's output, and nothing else is
+    // printed once an error has been.
+    if (!entry->err.empty())
+        err << entry->err;
+    out << entry->out;
+    return entry->submission.runnable ? runSubmission(entry->submission, out, err, request.expired) : entry->status;
+}
+
+// One serve worker's handler, with its own cache.
+ServeHandler makeServeHandler() {
+    Heap::current().setGrowthFactor(gc_growth);
+    auto cache = std::make_shared<SubmissionCache>(cache_size);
+    return [cache](const ServeRequest& request, std::ostream& out, std::ostream& err) {
+        return answerRequest(*cache, request, out, err);
+    };
+}
+
+// Sends command on filename to the server and relays the reply. A file is
+// sent by absolute path, so the server need not share the working
+// directory; standard input, or anything with --inline, is sent as source.
+int runClient(const std::string& command, const std::string& filename) {
+    ServeRequest request;
+    request.command = command;
+    request.inline_source = send_inline || filename == "/dev/stdin";
+    SourceBuffer file_contents;
+    if (request.inline_source) {
+        if (!file_contents.open(filename)) {
+            std::cerr << "Error reading file: " << filename << std::endl;
+            return 1;
+        }
+        request.source.assign(file_contents.text());
     }
     else {
+        request.file = std::filesystem::absolute(filename).string();
+    }
+    int fd = connectToServer(socket_path);
+    if (fd < 0) {
+        std::cerr << "Cannot connect to " << socket_path << std::endl;
+        return 1;
+    }
+    int status = sendRequest(fd, request, output, std::cerr);
+    close(fd);
+    if (status < 0) {
+        output.flush();
+        std::cerr << "Connection to " << socket_path << " lost" << std::endl;
+        return 1;
     }
+    return status;
+}
+
+// Function to process the command. Returns the exit status.
+int processCommand(const std::string& command, const std::string& filename) {
+    if (stream_input && (command == "tokenize" || command == "run")) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Error reading file: " << filename << std::endl;
+            return 1;
+        }
+        TokenStream stream(fd);
+        if (command == "run")
+            stream.internSymbols(StringTable::current());
+        int status = 0;
+        if (command == "tokenize")
+            processTokenizeStream(stream);
+        else
+            status = processRunStream(stream);
+        close(fd);
+        return status ? status : stream.status();
+    }
+
+    SourceBuffer file_contents;
+    if (!file_contents.open(filename)) {
+        std::cerr << "Error reading file: " << filename << std::endl;
+        return 1;
+    }
+    std::string_view source = file_contents.text();
+
+    unsigned jobs = lex_jobs;
+    if (jobs == 0 && source.size() >= parallel_lex_threshold)
+        jobs = std::thread::hardware_concurrency();
+    if (jobs > 1) {
+        Submission s;
+        s.command = command;
+        s.source = source;
+        int lex_status = 0;
+        tokenizeParallel(source, jobs, lex_status, s.tokens);
+        int status = prepareSubmission(s, lex_status, output, std::cerr);
+        return s.runnable ? runSubmission(s, output, std::cerr) : status;
+    }
+    return processSource(command, source, output, std::cerr);
 }
 
 int main(int argc, char *argv[])
 {
     int retVal = 0;
-    // Disable output buffering
-    std::cout << std::unitbuf;
-    std::cerr << std::unitbuf;
 
     try {
         std::vector<std::string> args(argv + 1, argv + argc);
-        if (args.size() < 2) {
-            std::cerr << "Usage: ./your_program tokenize <filename>" << std::endl;
+        std::string command;
+        std::vector<std::string> inputs;
+        if (!parseArguments(args, command, inputs)) {
+            std::cerr << "Usage: ./your_program <tokenize|parse|optimize|evaluate|run> [--stream] [--jobs=N] [--engine=tree|closure|vm] [--jit] [-O0|-O1] [--optimized] [--gc-stats] [--gc-growth=F] <filename|->" << std::endl;
+            std::cerr << "       ./your_program batch [options] <file|directory|@list>..." << std::endl;
+            std::cerr << "       ./your_program serve --socket PATH [--jobs=N] [--cache=N] [--timeout=MS] [options]" << std::endl;
+            std::cerr << "       ./your_program client --socket PATH [--inline] <command> <filename|->" << std::endl;
             return 64;
         }
 
-        const std::string command = args[0];
-        const std::string filename = args[1];
+        Heap& heap = Heap::current();
+        heap.setGrowthFactor(gc_growth);
+        if (gc_stats)
+            heap.reportStats(&std::cerr);
 
-        if (command == "tokenize" || command == "parse" || command == "evaluate" || command == "run") {
-            processCommand(command, filename, retVal);
+        if (command == "tokenize" || command == "parse" || command == "optimize" || command == "evaluate" || command == "run") {
+            retVal = processCommand(command, inputs[0]);
+        }
+        else if (command == "batch") {
+            unsigned threads = lex_jobs ? lex_jobs : std::max(1u, std::thread::hardware_concurrency());
+            retVal = runBatch(expandBatchInputs(inputs), threads, runBatchFile, output, std::cerr);
+        }
+        else if (command == "serve") {
+            unsigned workers = lex_jobs ? lex_jobs : std::max(1u, std::thread::hardware_concurrency());
+            retVal = serve(socket_path, workers, request_timeout, makeServeHandler, std::cerr);
+        }
+        else if (command == "client") {
+            retVal = runClient(inputs[0], inputs[1]);
         }
         else {
             std::cerr << "Unknown command: " << command << std::endl;
@@ -211,5 +721,7 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // Ahead of the --gc-stats report, which is written as the thread exits.
+    output.flush();
     return retVal;
 }
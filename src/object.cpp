@@ -0,0 +1,133 @@
+#include "class.h"
+#include <new>
+#include <utility>
+#include <vector>
+
+// Lifetime and printing of the GcObject types: what each holds references
+// to, and how it is freed.
+
+namespace
+{
+void release(Obj* object)
+{
+    if(object && --object->refcount == 0)
+    {
+        destroyHeapObject(object);
+    }
+}
+} // namespace
+
+// Iterative, like ObjRope::destroy: objects whose last reference goes while
+// another is being destroyed wait in dying, so releasing a long chain of
+// closures or instances cannot overflow the stack.
+void destroyHeapObject(Obj* object)
+{
+    thread_local std::vector<GcObject*> dying;
+    thread_local bool                   destroying = false;
+
+    dying.push_back(static_cast<GcObject*>(object));
+    if(destroying)
+    {
+        return;
+    }
+    destroying = true;
+    Heap& heap = Heap::current();
+    while(!dying.empty())
+    {
+        GcObject* next = dying.back();
+        dying.pop_back();
+        heap.untrack(next);
+        clearReferences(next);
+        freeObject(next);
+    }
+    destroying = false;
+}
+
+void clearReferences(GcObject* object)
+{
+    switch(object->type)
+    {
+        case ObjType::FUNCTION: static_cast<ObjFunction*>(object)->chunk.constants.clear(); break;
+        case ObjType::CLOSURE:
+        {
+            auto* closure = static_cast<ObjClosure*>(object);
+            if(closure->function)
+            {
+                for(int i = 0; i < closure->function->upvalue_count; ++i)
+                {
+                    release(std::exchange(closure->upvalues()[i], nullptr));
+                }
+                release(std::exchange(closure->function, nullptr));
+            }
+            break;
+        }
+        case ObjType::UPVALUE: static_cast<ObjUpvalue*>(object)->closed = Value(); break;
+        case ObjType::CLASS:
+        {
+            auto* klass        = static_cast<ObjClass*>(object);
+            klass->initializer = nullptr;
+            klass->methods.clear();
+            break;
+        }
+        case ObjType::INSTANCE:
+        {
+            auto* instance = static_cast<ObjInstance*>(object);
+            instance->fields.clear();
+            release(std::exchange(instance->klass, nullptr));
+            break;
+        }
+        case ObjType::BOUND_METHOD:
+        {
+            auto* bound     = static_cast<ObjBoundMethod*>(object);
+            bound->receiver = Value();
+            release(std::exchange(bound->method, nullptr));
+            break;
+        }
+        default: break;
+    }
+}
+
+void freeObject(GcObject* object)
+{
+    switch(object->type)
+    {
+        case ObjType::FUNCTION: delete static_cast<ObjFunction*>(object); break;
+        case ObjType::CLOSURE:
+        {
+            auto* closure = static_cast<ObjClosure*>(object);
+            closure->~ObjClosure();
+            ::operator delete(closure);
+            break;
+        }
+        case ObjType::NATIVE: delete static_cast<ObjNative*>(object); break;
+        case ObjType::UPVALUE: delete static_cast<ObjUpvalue*>(object); break;
+        case ObjType::CLASS: delete static_cast<ObjClass*>(object); break;
+        case ObjType::INSTANCE: delete static_cast<ObjInstance*>(object); break;
+        case ObjType::BOUND_METHOD: delete static_cast<ObjBoundMethod*>(object); break;
+        case ObjType::STRING:
+        case ObjType::ROPE: break; // freed through Value
+    }
+}
+
+void printObject(std::ostream& out, const Obj* object)
+{
+    switch(object->type)
+    {
+        case ObjType::CLOSURE:
+            out << "<fn " << static_cast<const ObjClosure*>(object)->function->name.asString()->view() << ">";
+            break;
+        case ObjType::FUNCTION:
+            out << "<fn " << static_cast<const ObjFunction*>(object)->name.asString()->view() << ">";
+            break;
+        case ObjType::NATIVE: out << "<native fn>"; break;
+        case ObjType::CLASS: out << static_cast<const ObjClass*>(object)->name.asString()->view(); break;
+        case ObjType::INSTANCE:
+            out << static_cast<const ObjInstance*>(object)->klass->name.asString()->view() << " instance";
+            break;
+        case ObjType::BOUND_METHOD:
+            out << "<fn " << static_cast<const ObjBoundMethod*>(object)->method->function->name.asString()->view()
+                << ">";
+            break;
+        default: out << "<object>"; break;
+    }
+}
@@ -0,0 +1,324 @@
+#include "optimizer.h"
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// True if literal is the number n, sign of zero included.
+bool isNumber(Literal* literal, double n)
+{
+    if(!literal)
+    {
+        return false;
+    }
+    Value value = literal->constant();
+    return value.isNumber() && value.asNumber() == n && std::signbit(value.asNumber()) == std::signbit(n);
+}
+
+// Kind of a binary result, assuming the operation succeeds.
+std::optional<ValueKind> resultKind(BinaryOp op, std::optional<ValueKind> left, std::optional<ValueKind> right)
+{
+    switch(op)
+    {
+        case BinaryOp::ADD:
+            if(left && left == right && (*left == ValueKind::NUMBER || *left == ValueKind::STRING))
+            {
+                return left;
+            }
+            return std::nullopt;
+        case BinaryOp::SUBTRACT:
+        case BinaryOp::MULTIPLY:
+        case BinaryOp::DIVIDE: return ValueKind::NUMBER;
+        default: return ValueKind::BOOL;
+    }
+}
+} // namespace
+
+Expression* Optimizer::optimize(Expression* expr)
+{
+    return fold(expr).expr;
+}
+
+void Optimizer::optimize(Statement* stmt)
+{
+    stmt->accept(*this);
+}
+
+Optimizer::Folded Optimizer::fold(Expression* expr)
+{
+    expr->accept(*this);
+    return result;
+}
+
+Optimizer::Folded Optimizer::constant(const Value& value)
+{
+    Literal* literal = nullptr;
+    switch(value.kind())
+    {
+        case ValueKind::NUMBER: literal = arena.make<NumberLiteral>(value.asNumber(), std::string_view()); break;
+        case ValueKind::BOOL: literal = arena.make<BoolLiteral>(value.asBool()); break;
+        case ValueKind::NIL: literal = arena.make<NilLiteral>(); break;
+        case ValueKind::STRING: literal = arena.make<StringLiteral>(value); break;
+        case ValueKind::OBJECT: throw std::logic_error("Operators never produce objects.");
+    }
+    return {literal, value.kind(), nullptr, literal};
+}
+
+// A long chain such as a + b + c + ... nests down the left, so its spine is
+// walked in a loop and folded from the bottom up rather than recursively,
+// which would run out of stack on a few tens of thousands of terms.
+void Optimizer::visitBinary(Binary& expr)
+{
+    std::vector<Binary*> spine{&expr};
+    while(auto* inner = dynamic_cast<Binary*>(spine.back()->left))
+    {
+        spine.push_back(inner);
+    }
+    Folded left = fold(spine.back()->left);
+    for(auto node = spine.rbegin(); node != spine.rend(); ++node)
+    {
+        left = combine(**node, left, fold((*node)->right));
+    }
+    result = left;
+}
+
+Optimizer::Folded Optimizer::combine(Binary& expr, const Folded& left, const Folded& right)
+{
+    if(left.literal && right.literal)
+    {
+        try
+        {
+            return constant(binaryOperation(expr.operation, left.literal->constant(), right.literal->constant()));
+        }
+        catch(const std::runtime_error&)
+        {
+            // Left for the program to raise when it gets here.
+        }
+    }
+
+    // Identities only hold for numbers. x + 0 is not one, since it turns -0
+    // into 0; x + -0 and x - 0 are. Dropping a literal operand never hides an
+    // error, because the other side is already known to be a number.
+    bool left_number  = left.kind == ValueKind::NUMBER;
+    bool right_number = right.kind == ValueKind::NUMBER;
+    switch(expr.operation)
+    {
+        case BinaryOp::MULTIPLY:
+            if(left_number && isNumber(right.literal, 1))
+            {
+                return left;
+            }
+            if(right_number && isNumber(left.literal, 1))
+            {
+                return right;
+            }
+            break;
+        case BinaryOp::DIVIDE:
+            if(left_number && isNumber(right.literal, 1))
+            {
+                return left;
+            }
+            break;
+        case BinaryOp::ADD:
+            if(left_number && isNumber(right.literal, -0.0))
+            {
+                return left;
+            }
+            if(right_number && isNumber(left.literal, -0.0))
+            {
+                return right;
+            }
+            break;
+        case BinaryOp::SUBTRACT:
+            if(left_number && isNumber(right.literal, 0.0))
+            {
+                return left;
+            }
+            break;
+        default: break;
+    }
+
+    expr.left  = left.expr;
+    expr.right = right.expr;
+    return {&expr, resultKind(expr.operation, left.kind, right.kind)};
+}
+
+void Optimizer::visitUnary(Unary& expr)
+{
+    Folded right = fold(expr.right);
+
+    if(right.literal)
+    {
+        try
+        {
+            result = constant(unaryOperation(expr.op.token_type, right.literal->constant()));
+            return;
+        }
+        catch(const std::runtime_error&)
+        {
+        }
+    }
+
+    expr.right = right.expr;
+    if(expr.op.token_type == TokenType::BANG)
+    {
+        // !!x is x when x is already a bool.
+        if(right.negated_bool)
+        {
+            result = {right.negated_bool, ValueKind::BOOL};
+            return;
+        }
+        result = {&expr, ValueKind::BOOL, right.kind == ValueKind::BOOL ? right.expr : nullptr};
+        return;
+    }
+    result = {&expr, ValueKind::NUMBER};
+}
+
+void Optimizer::visitLiteral(Literal& expr)
+{
+    result = {&expr, expr.constant().kind(), nullptr, &expr};
+}
+
+void Optimizer::visitGrouping(Grouping& expr)
+{
+    result = fold(expr.expression);
+}
+
+void Optimizer::visitVariable(Variable& expr)
+{
+    result = {&expr, std::nullopt};
+}
+
+void Optimizer::visitAssign(Assign& expr)
+{
+    Folded value = fold(expr.value);
+    expr.value   = value.expr;
+    result       = {&expr, value.kind};
+}
+
+// A literal left operand decides which operand is the result, and has no
+// side effects to keep.
+void Optimizer::visitLogical(Logical& expr)
+{
+    Folded left  = fold(expr.left);
+    Folded right = fold(expr.right);
+    if(left.literal)
+    {
+        result = left.literal->constant().isTruthy() == (expr.op == TokenType::OR) ? left : right;
+        return;
+    }
+    expr.left  = left.expr;
+    expr.right = right.expr;
+    result     = {&expr, left.kind == right.kind ? left.kind : std::nullopt};
+}
+
+void Optimizer::visitCall(Call& expr)
+{
+    expr.callee = optimize(expr.callee);
+    for(Expression*& argument: expr.arguments)
+    {
+        argument = optimize(argument);
+    }
+    result = {&expr, std::nullopt};
+}
+
+void Optimizer::visitGet(Get& expr)
+{
+    expr.object = optimize(expr.object);
+    result      = {&expr, std::nullopt};
+}
+
+void Optimizer::visitSet(Set& expr)
+{
+    expr.object  = optimize(expr.object);
+    Folded value = fold(expr.value);
+    expr.value   = value.expr;
+    result       = {&expr, value.kind};
+}
+
+void Optimizer::visitThis(This& expr)
+{
+    result = {&expr, std::nullopt};
+}
+
+void Optimizer::visitSuper(Super& expr)
+{
+    result = {&expr, std::nullopt};
+}
+
+void Optimizer::visitInvoke(Invoke& expr)
+{
+    expr.object = optimize(expr.object);
+    for(Expression*& argument: expr.arguments)
+    {
+        argument = optimize(argument);
+    }
+    result = {&expr, std::nullopt};
+}
+
+void Optimizer::visitPrint(PrintStatement& stmt)
+{
+    stmt.expression = optimize(stmt.expression);
+}
+
+void Optimizer::visitExpression(ExpressionStatement& stmt)
+{
+    stmt.expression = optimize(stmt.expression);
+}
+
+void Optimizer::visitVar(VarStatement& stmt)
+{
+    if(stmt.initializer)
+    {
+        stmt.initializer = optimize(stmt.initializer);
+    }
+}
+
+void Optimizer::visitBlock(BlockStatement& stmt)
+{
+    for(Statement* inner: stmt.statements)
+    {
+        optimize(inner);
+    }
+}
+
+void Optimizer::visitIf(IfStatement& stmt)
+{
+    stmt.condition = optimize(stmt.condition);
+    optimize(stmt.then_branch);
+    if(stmt.else_branch)
+    {
+        optimize(stmt.else_branch);
+    }
+}
+
+void Optimizer::visitWhile(WhileStatement& stmt)
+{
+    stmt.condition = optimize(stmt.condition);
+    optimize(stmt.body);
+}
+
+void Optimizer::visitFunction(FunctionStatement& stmt)
+{
+    for(Statement* inner: stmt.body)
+    {
+        optimize(inner);
+    }
+}
+
+void Optimizer::visitReturn(ReturnStatement& stmt)
+{
+    if(stmt.value)
+    {
+        stmt.value = optimize(stmt.value);
+    }
+}
+
+void Optimizer::visitClass(ClassStatement& stmt)
+{
+    for(FunctionStatement* method: stmt.methods)
+    {
+        optimize(method);
+    }
+}
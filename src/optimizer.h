@@ -0,0 +1,69 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <optional>
+#include "parser.h"
+
+// Rewrites a syntax tree into a cheaper one with the same behaviour: constant
+// subexpressions are folded into literals, groupings are dropped, and
+// identities such as x * 1 are removed where the type of x is known.
+// Subexpressions that would raise a runtime error are left in place so the
+// error is still reported when, and in the order, the program reaches it.
+class Optimizer : private ExpressionVisitor, private StatementVisitor
+{
+public:
+    // New nodes are allocated in arena, normally the one the tree lives in.
+    explicit Optimizer(Arena& arena) : arena(arena) {}
+
+    Expression* optimize(Expression* expr);
+
+    // Optimizes the expressions of stmt in place.
+    void optimize(Statement* stmt);
+
+private:
+    // An optimized subtree and, when it is known without running it, the
+    // kind of value it produces.
+    struct Folded
+    {
+        Expression*              expr;
+        std::optional<ValueKind> kind;
+        // x, when this is !x and x is known to be a bool.
+        Expression* negated_bool = nullptr;
+        // expr itself, when it is a literal.
+        Literal* literal = nullptr;
+    };
+
+    Folded fold(Expression* expr);
+    Folded constant(const Value& value);
+    // Folds expr given its already folded operands.
+    Folded combine(Binary& expr, const Folded& left, const Folded& right);
+
+    void visitBinary(Binary& expr) override;
+    void visitUnary(Unary& expr) override;
+    void visitLiteral(Literal& expr) override;
+    void visitGrouping(Grouping& expr) override;
+    void visitVariable(Variable& expr) override;
+    void visitAssign(Assign& expr) override;
+    void visitLogical(Logical& expr) override;
+    void visitCall(Call& expr) override;
+    void visitGet(Get& expr) override;
+    void visitSet(Set& expr) override;
+    void visitThis(This& expr) override;
+    void visitSuper(Super& expr) override;
+    void visitInvoke(Invoke& expr) override;
+
+    void visitPrint(PrintStatement& stmt) override;
+    void visitExpression(ExpressionStatement& stmt) override;
+    void visitVar(VarStatement& stmt) override;
+    void visitBlock(BlockStatement& stmt) override;
+    void visitIf(IfStatement& stmt) override;
+    void visitWhile(WhileStatement& stmt) override;
+    void visitFunction(FunctionStatement& stmt) override;
+    void visitReturn(ReturnStatement& stmt) override;
+    void visitClass(ClassStatement& stmt) override;
+
+    Arena& arena;
+    Folded result{};
+};
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,79 @@
+#include "output.h"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+OutputBuffer::OutputBuffer(int fd, std::size_t capacity)
+    : fd(fd), buffer(new char[capacity]), capacity(capacity)
+{
+    setp(buffer.get(), buffer.get() + capacity);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+bool OutputBuffer::flush()
+{
+    std::size_t size = pptr() - pbase();
+    setp(buffer.get(), buffer.get() + capacity);
+    return writeAll(buffer.get(), size);
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type ch)
+{
+    if(!flush())
+    {
+        return traits_type::eof();
+    }
+    if(!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        put(traits_type::to_char_type(ch));
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize OutputBuffer::xsputn(const char* data, std::streamsize size)
+{
+    std::size_t length = static_cast<std::size_t>(size);
+    if(static_cast<std::size_t>(epptr() - pptr()) < length)
+    {
+        if(!flush())
+        {
+            return 0;
+        }
+        // Too big to be worth buffering: write it straight through.
+        if(length >= capacity)
+        {
+            return writeAll(data, length) ? size : 0;
+        }
+    }
+    std::copy(data, data + length, pptr());
+    pbump(static_cast<int>(length));
+    return size;
+}
+
+int OutputBuffer::sync()
+{
+    return flush() ? 0 : -1;
+}
+
+bool OutputBuffer::writeAll(const char* data, std::size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = ::write(fd, data, size);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstddef>
+#include <memory>
+#include <streambuf>
+#include <string_view>
+
+// Block-buffered sink for program output on a file descriptor. Bytes are
+// collected in one large buffer and handed to write(2) when it fills up, on
+// flush(), and when the sink is destroyed, which includes std::exit. Callers
+// that are about to report an error on stderr flush first so the two streams
+// stay in order on a terminal.
+//
+// It is a std::streambuf so that code written against std::ostream can use
+// it; put() and write() skip the stream layer for hot loops.
+class OutputBuffer : public std::streambuf
+{
+public:
+    static constexpr std::size_t default_capacity = 1 << 18;
+
+    explicit OutputBuffer(int fd, std::size_t capacity = default_capacity);
+    ~OutputBuffer() override;
+
+    OutputBuffer(const OutputBuffer&)            = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void put(char ch)
+    {
+        if(pptr() == epptr())
+        {
+            flush();
+        }
+        *pptr() = ch;
+        pbump(1);
+    }
+
+    void write(std::string_view text)
+    {
+        if(static_cast<std::size_t>(epptr() - pptr()) >= text.size())
+        {
+            text.copy(pptr(), text.size());
+            pbump(static_cast<int>(text.size()));
+            return;
+        }
+        xsputn(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    // Writes out everything buffered so far. Returns false if writing failed.
+    bool flush();
+
+protected:
+    int_type        overflow(int_type ch) override;
+    std::streamsize xsputn(const char* data, std::streamsize size) override;
+    int             sync() override;
+
+private:
+    bool writeAll(const char* data, std::size_t size);
+
+    int                     fd;
+    std::unique_ptr<char[]> buffer;
+    std::size_t             capacity;
+};
+
+#endif // OUTPUT_H
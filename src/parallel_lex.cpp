@@ -0,0 +1,117 @@
+#include "parallel_lex.h"
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include "tokenize.h"
+
+namespace
+{
+struct Piece
+{
+    size_t                begin;
+    size_t                end;
+    std::vector<Token>    tokens;
+    std::vector<LexError> errors;
+    int                   newlines    = 0;
+    bool                  open_string = false;
+    int                   status      = 0;
+};
+
+void lexPiece(std::string_view source, Piece &piece, bool last)
+{
+    Tokenizer tokenizer;
+    piece.tokens.clear();
+    piece.errors.clear();
+    tokenizer.deferErrors(piece.errors);
+    std::string_view window = source.substr(piece.begin, piece.end - piece.begin);
+    piece.tokens.reserve(window.size() / 4 + 1);
+    tokenizer.tokenizeChunk(window, true, piece.tokens);
+    if(!last)
+    {
+        piece.tokens.pop_back(); // EOF
+    }
+    piece.newlines    = tokenizer.line() - 1;
+    piece.open_string = tokenizer.endedInString();
+    piece.status      = tokenizer.status();
+}
+
+std::vector<Piece> splitAtNewlines(std::string_view source, unsigned jobs)
+{
+    std::vector<Piece> pieces;
+    size_t             begin = 0;
+    for(unsigned k = 1; k < jobs && begin < source.size(); ++k)
+    {
+        size_t target = std::max(begin, source.size() / jobs * k);
+        const void *nl = std::memchr(source.data() + target, '\n', source.size() - target);
+        if(!nl)
+        {
+            break;
+        }
+        size_t cut = static_cast<const char *>(nl) - source.data() + 1;
+        pieces.push_back({begin, cut, {}, {}});
+        begin = cut;
+    }
+    pieces.push_back({begin, source.size(), {}, {}});
+    return pieces;
+}
+} // namespace
+
+void tokenizeParallel(std::string_view    source,
+                      unsigned            jobs,
+                      int                &ret,
+                      std::vector<Token> &toks)
+{
+    std::vector<Piece> pieces = splitAtNewlines(source, jobs ? jobs : 1);
+
+    std::vector<std::thread> workers;
+    for(size_t i = 1; i < pieces.size(); ++i)
+    {
+        workers.emplace_back(
+            [&, i] { lexPiece(source, pieces[i], i + 1 == pieces.size()); });
+    }
+    lexPiece(source, pieces[0], pieces.size() == 1);
+    for(std::thread &worker: workers)
+    {
+        worker.join();
+    }
+
+    // A piece that ends inside a string means the following cut was inside
+    // that string: merge the two and lex the combined range again.
+    for(size_t i = 0; i + 1 < pieces.size();)
+    {
+        if(!pieces[i].open_string)
+        {
+            ++i;
+            continue;
+        }
+        pieces[i].end = pieces[i + 1].end;
+        pieces.erase(pieces.begin() + i + 1);
+        lexPiece(source, pieces[i], i + 1 == pieces.size());
+    }
+
+    size_t total = 0;
+    for(const Piece &piece: pieces)
+    {
+        total += piece.tokens.size();
+    }
+    toks.clear();
+    toks.reserve(total);
+
+    int line_base = 0;
+    ret           = 0;
+    for(Piece &piece: pieces)
+    {
+        for(Token token: piece.tokens)
+        {
+            token.offset += piece.begin;
+            token.line += line_base;
+            toks.push_back(token);
+        }
+        for(const LexError &error: piece.errors)
+        {
+            Tokenizer::report({error.line + line_base, error.message}, std::cerr);
+        }
+        ret = ret ? ret : piece.status;
+        line_base += piece.newlines;
+    }
+}
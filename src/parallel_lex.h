@@ -0,0 +1,27 @@
+#ifndef PARALLEL_LEX_H
+#define PARALLEL_LEX_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "token.h"
+
+// Inputs below this size are not worth splitting across threads.
+inline constexpr std::size_t parallel_lex_threshold = 16u << 20;
+
+// Same result as Tokenizer::tokenize, computed on up to `jobs` threads.
+//
+// The buffer is cut just after newlines near equal-sized offsets. Such a cut
+// is safe unless the newline sits inside a string literal (a comment always
+// ends at its newline), which is only known once everything before it has
+// been lexed. Each piece is therefore lexed speculatively, assuming it
+// starts outside a string; a piece that ends inside an unterminated string
+// proves the next cut wrong, and the two are merged and lexed again. Token
+// offsets and line numbers are rebased when the pieces are stitched
+// together, and lexical errors are reported in source order afterwards.
+void tokenizeParallel(std::string_view    source,
+                      unsigned            jobs,
+                      int                &ret,
+                      std::vector<Token> &toks);
+
+#endif // PARALLEL_LEX_H
@@ -1,11 +1,52 @@
 #include "parser.h"
+#include "intern.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
-#include <unordered_map>
+#include <type_traits>
 
-Parser::Parser(const std::vector<Token> &tokens) : tokens(tokens), current(0) {}
+namespace
+{
+// Binding power of each token in infix position; NONE ends an expression.
+constexpr std::array<Parser::Precedence, token_type_count> infix_precedence = [] {
+    using enum Parser::Precedence;
+    std::array<Parser::Precedence, token_type_count> table{};
+    auto set = [&](TokenType type, Parser::Precedence precedence) {
+        table[static_cast<std::size_t>(type)] = precedence;
+    };
+    set(TokenType::EQUAL, ASSIGNMENT);
+    set(TokenType::OR, OR);
+    set(TokenType::AND, AND);
+    set(TokenType::BANG_EQUAL, EQUALITY);
+    set(TokenType::EQUAL_EQUAL, EQUALITY);
+    set(TokenType::GREATER, COMPARISON);
+    set(TokenType::GREATER_EQUAL, COMPARISON);
+    set(TokenType::LESS, COMPARISON);
+    set(TokenType::LESS_EQUAL, COMPARISON);
+    set(TokenType::MINUS, TERM);
+    set(TokenType::PLUS, TERM);
+    set(TokenType::SLASH, FACTOR);
+    set(TokenType::STAR, FACTOR);
+    set(TokenType::LEFT_PAREN, CALL);
+    set(TokenType::DOT, CALL);
+    return table;
+}();
+
+Parser::Precedence infixPrecedence(TokenType type)
+{
+    return infix_precedence[static_cast<std::size_t>(type)];
+}
+} // namespace
 
-std::shared_ptr<Expression> Parser::parse()
+Parser::Parser(std::span<const Token> tokens, std::string_view source, Arena &arena)
+    : tokens(tokens), source(source), arena(arena), current(0)
+{
+}
+
+Expression* Parser::parse()
 {
     try
     {
@@ -17,153 +58,418 @@ std::shared_ptr<Expression> Parser::parse()
     }
 }
 
-std::shared_ptr<Expression> Parser::expression()
+bool Parser::parseProgram(std::vector<Statement*> &program)
 {
-    return equality();
+    try
+    {
+        while(!isAtEnd())
+        {
+            program.push_back(declaration());
+        }
+        return true;
+    }
+    catch(const std::runtime_error &e)
+    {
+        return false;
+    }
 }
 
-std::shared_ptr<Expression> Parser::equality()
+Statement* Parser::parseDeclaration()
 {
-    std::shared_ptr<Expression> expr = comparison();
+    try
+    {
+        return declaration();
+    }
+    catch(const std::runtime_error &e)
+    {
+        return nullptr;
+    }
+}
+
+Statement* Parser::declaration()
+{
+    if(match(TokenType::CLASS)) return classDeclaration();
+    if(match(TokenType::FUN)) return function(FunctionKind::FUNCTION);
+    if(match(TokenType::VAR)) return varDeclaration();
+    return statement();
+}
 
-    while(match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL}))
+Statement* Parser::classDeclaration()
+{
+    const Token &name       = consume(TokenType::IDENTIFIER, "Expect class name.");
+    Variable    *superclass = nullptr;
+    if(match(TokenType::LESS))
+    {
+        consume(TokenType::IDENTIFIER, "Expect superclass name.");
+        superclass = arena.make<Variable>(variableRef(previous()));
+    }
+    consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
+    std::vector<FunctionStatement*> methods;
+    std::uint32_t                   init = StringTable::current().symbol("init");
+    while(!check(TokenType::RIGHT_BRACE) && !isAtEnd())
     {
-        Token                       op    = previous();
-        std::shared_ptr<Expression> right = comparison();
-        expr                              = std::make_shared<Binary>(expr, op, right);
+        bool is_init = check(TokenType::IDENTIFIER) && variableRef(peek()).symbol == init;
+        methods.push_back(function(is_init ? FunctionKind::INITIALIZER : FunctionKind::METHOD));
     }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
 
-    return expr;
+    VariableRef super_variable{"super", StringTable::current().symbol("super"), name.line};
+    return arena.make<ClassStatement>(variableRef(name), superclass, super_variable, arenaSpan(methods));
 }
 
-std::shared_ptr<Expression> Parser::comparison()
+FunctionStatement* Parser::function(FunctionKind kind)
 {
-    std::shared_ptr<Expression> expr = term();
+    const Token             &name = consume(TokenType::IDENTIFIER, "Expect function name.");
+    std::vector<VariableRef> params;
+    consume(TokenType::LEFT_PAREN, "Expect '(' after function name.");
+    if(!check(TokenType::RIGHT_PAREN))
+    {
+        do
+        {
+            if(params.size() >= 255)
+            {
+                error(peek(), "Can't have more than 255 parameters.");
+                throw std::runtime_error("Can't have more than 255 parameters.");
+            }
+            params.push_back(variableRef(consume(TokenType::IDENTIFIER, "Expect parameter name.")));
+        } while(match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TokenType::LEFT_BRACE, "Expect '{' before function body.");
+    std::span<Statement* const> body = blockStatements();
+    ++function_count;
+    return arena.make<FunctionStatement>(variableRef(name), arenaSpan(params), body, kind);
+}
 
-    while(match({TokenType::GREATER,
-                 TokenType::GREATER_EQUAL,
-                 TokenType::LESS,
-                 TokenType::LESS_EQUAL}))
+Statement* Parser::varDeclaration()
+{
+    const Token &name        = consume(TokenType::IDENTIFIER, "Expect variable name.");
+    Expression  *initializer = nullptr;
+    if(match(TokenType::EQUAL))
     {
-        Token                       op    = previous();
-        std::shared_ptr<Expression> right = term();
-        expr                              = std::make_shared<Binary>(expr, op, right);
+        initializer = expression();
     }
+    consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+    return arena.make<VarStatement>(variableRef(name), initializer);
+}
+
+Statement* Parser::statement()
+{
+    if(match(TokenType::PRINT)) return printStatement();
+    if(match(TokenType::IF)) return ifStatement();
+    if(match(TokenType::WHILE)) return whileStatement();
+    if(match(TokenType::FOR)) return forStatement();
+    if(match(TokenType::RETURN)) return returnStatement();
+    if(match(TokenType::LEFT_BRACE)) return block();
+    return expressionStatement();
+}
+
+Statement* Parser::printStatement()
+{
+    Expression* value = expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after value.");
+    return arena.make<PrintStatement>(value);
+}
+
+Statement* Parser::ifStatement()
+{
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+    Expression* condition = expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
+    Statement* then_branch = statement();
+    Statement* else_branch = match(TokenType::ELSE) ? statement() : nullptr;
+    return arena.make<IfStatement>(condition, then_branch, else_branch);
+}
 
-    return expr;
+Statement* Parser::whileStatement()
+{
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+    Expression* condition = expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+    return arena.make<WhileStatement>(condition, statement());
 }
 
-std::shared_ptr<Expression> Parser::term()
+// for (init; condition; increment) body becomes
+// { init; while (condition) { body; increment; } }.
+Statement* Parser::forStatement()
 {
-    std::shared_ptr<Expression> expr = factor();
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+    Statement* initializer = nullptr;
+    if(match(TokenType::VAR))
+    {
+        initializer = varDeclaration();
+    }
+    else if(!match(TokenType::SEMICOLON))
+    {
+        initializer = expressionStatement();
+    }
+
+    Expression* condition = check(TokenType::SEMICOLON) ? arena.make<BoolLiteral>(true) : expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+    Expression* increment = check(TokenType::RIGHT_PAREN) ? nullptr : expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
 
-    while(match({TokenType::MINUS, TokenType::PLUS}))
+    Statement* body = statement();
+    if(increment)
     {
-        Token                       op    = previous();
-        std::shared_ptr<Expression> right = factor();
-        expr                              = std::make_shared<Binary>(expr, op, right);
+        std::vector<Statement*> parts{body, arena.make<ExpressionStatement>(increment)};
+        body = arena.make<BlockStatement>(arenaSpan(parts));
     }
+    body = arena.make<WhileStatement>(condition, body);
+    if(initializer)
+    {
+        std::vector<Statement*> parts{initializer, body};
+        body = arena.make<BlockStatement>(arenaSpan(parts));
+    }
+    return body;
+}
 
-    return expr;
+Statement* Parser::returnStatement()
+{
+    int         line  = previous().line;
+    Expression* value = check(TokenType::SEMICOLON) ? nullptr : expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+    return arena.make<ReturnStatement>(value, line);
 }
 
-std::shared_ptr<Expression> Parser::factor()
+Statement* Parser::block()
 {
-    std::shared_ptr<Expression> expr = unary();
+    return arena.make<BlockStatement>(blockStatements());
+}
 
-    while(match({TokenType::SLASH, TokenType::STAR}))
+std::span<Statement* const> Parser::blockStatements()
+{
+    std::vector<Statement*> statements;
+    while(!check(TokenType::RIGHT_BRACE) && !isAtEnd())
     {
-        Token                       op    = previous();
-        std::shared_ptr<Expression> right = unary();
-        expr                              = std::make_shared<Binary>(expr, op, right);
+        statements.push_back(declaration());
     }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+    return arenaSpan(statements);
+}
 
-    return expr;
+template <typename T>
+std::span<T> Parser::arenaSpan(const std::vector<T> &items)
+{
+    // Only trivially destructible types: the arena never destroys these.
+    static_assert(std::is_trivially_destructible_v<T>);
+    void *memory = arena.allocate(items.size() * sizeof(T), alignof(T));
+    T    *copy   = static_cast<T*>(memory);
+    std::uninitialized_copy(items.begin(), items.end(), copy);
+    return std::span<T>(copy, items.size());
+}
+
+Statement* Parser::expressionStatement()
+{
+    Expression* expr = expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+    return arena.make<ExpressionStatement>(expr);
+}
+
+Expression* Parser::expression()
+{
+    return parsePrecedence(Precedence::ASSIGNMENT);
+}
+
+// Parses a prefix expression, then keeps folding it into the left operand of
+// any infix operator that binds at least as tightly as min_precedence. Binary
+// operators are left-associative: their right operand only takes operators
+// that bind more tightly. Assignment is right-associative, and its target
+// must be a variable or a property.
+Expression* Parser::parsePrecedence(Precedence min_precedence)
+{
+    Expression* expr = prefix();
+    for(;;)
+    {
+        Precedence precedence = infixPrecedence(peek().token_type);
+        if(precedence == Precedence::NONE || precedence < min_precedence)
+        {
+            return expr;
+        }
+        const Token &op = advance();
+        if(op.token_type == TokenType::EQUAL)
+        {
+            if(auto *property = dynamic_cast<Get*>(expr))
+            {
+                Expression *value = parsePrecedence(Precedence::ASSIGNMENT);
+                expr = arena.make<Set>(property->object, property->name, property->symbol, value);
+                continue;
+            }
+            auto *target = dynamic_cast<Variable*>(expr);
+            if(!target)
+            {
+                error(op, "Invalid assignment target.");
+                throw std::runtime_error("Invalid assignment target.");
+            }
+            expr = arena.make<Assign>(target->variable, parsePrecedence(Precedence::ASSIGNMENT));
+            continue;
+        }
+        if(op.token_type == TokenType::LEFT_PAREN)
+        {
+            expr = finishCall(expr);
+            continue;
+        }
+        if(op.token_type == TokenType::DOT)
+        {
+            VariableRef name = variableRef(consume(TokenType::IDENTIFIER, "Expect property name after '.'."));
+            expr             = arena.make<Get>(expr, name.name, name.symbol);
+            continue;
+        }
+        if(op.token_type == TokenType::AND || op.token_type == TokenType::OR)
+        {
+            Expression *right = parsePrecedence(static_cast<Precedence>(static_cast<int>(precedence) + 1));
+            expr              = arena.make<Logical>(expr, op.token_type, right);
+            continue;
+        }
+        Expression *right = parsePrecedence(static_cast<Precedence>(static_cast<int>(precedence) + 1));
+        expr              = arena.make<Binary>(expr, op, right);
+    }
 }
 
-std::shared_ptr<Expression> Parser::unary()
+Expression* Parser::prefix()
 {
-    if(match({TokenType::BANG, TokenType::MINUS}))
+    if(match(TokenType::BANG) || match(TokenType::MINUS))
     {
-        Token                       op    = previous();
-        std::shared_ptr<Expression> right = unary();
-        return std::make_shared<Unary>(op, right);
+        const Token &op    = previous();
+        Expression  *right = parsePrecedence(Precedence::UNARY);
+        return arena.make<Unary>(op, right);
     }
-    
+
     return primary();
 }
 
-std::shared_ptr<Expression> Parser::primary()
+Expression* Parser::finishCall(Expression* callee)
+{
+    std::vector<Expression*> arguments;
+    if(!check(TokenType::RIGHT_PAREN))
+    {
+        do
+        {
+            if(arguments.size() >= 255)
+            {
+                error(peek(), "Can't have more than 255 arguments.");
+                throw std::runtime_error("Can't have more than 255 arguments.");
+            }
+            arguments.push_back(expression());
+        } while(match(TokenType::COMMA));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+    // A method call skips creating the bound method.
+    if(auto *property = dynamic_cast<Get*>(callee))
+    {
+        return arena.make<Invoke>(property->object, property->name, property->symbol, arenaSpan(arguments));
+    }
+    return arena.make<Call>(callee, arenaSpan(arguments));
+}
+
+Expression* Parser::primary()
 {
-    if(match({TokenType::FALSE})) return std::make_shared<Literal>("false");
-    if(match({TokenType::TRUE})) return std::make_shared<Literal>("true");
-    if(match({TokenType::NIL})) return std::make_shared<Literal>("nil");
+    if(match(TokenType::FALSE)) return arena.make<BoolLiteral>(false);
+    if(match(TokenType::TRUE)) return arena.make<BoolLiteral>(true);
+    if(match(TokenType::NIL)) return arena.make<NilLiteral>();
+
+    if(match(TokenType::NUMBER))
+    {
+        // The lexer only produces digits with an optional fraction, which
+        // from_chars always accepts.
+        std::string_view lexeme = previous().lexeme(source);
+        double           number = 0;
+        std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), number);
+        return arena.make<NumberLiteral>(number, lexeme);
+    }
+
+    if(match(TokenType::STRING))
+    {
+        if(previous().symbol)
+        {
+            return arena.make<StringLiteral>(Value::share(StringTable::current().symbolString(previous().symbol)));
+        }
+        std::string_view lexeme = previous().lexeme(source);
+        return arena.make<StringLiteral>(lexeme.substr(1, lexeme.size() - 2));
+    }
+
+    if(match(TokenType::IDENTIFIER))
+    {
+        return arena.make<Variable>(variableRef(previous()));
+    }
 
-    if (match({ TokenType::NUMBER, TokenType::STRING }))
+    if(match(TokenType::THIS))
     {
-        auto retVal = std::make_shared<Literal>(previous().literal);
-        retVal->getstring = previous().token_type == TokenType::STRING;
-        return retVal;
+        return arena.make<This>(variableRef(previous()));
     }
 
-    if(match({TokenType::LEFT_PAREN}))
+    if(match(TokenType::SUPER))
     {
-        std::shared_ptr<Expression> expr = expression();
+        VariableRef receiver{"this", StringTable::current().symbol("this"), previous().line};
+        VariableRef superclass = variableRef(previous());
+        consume(TokenType::DOT, "Expect '.' after 'super'.");
+        VariableRef name = variableRef(consume(TokenType::IDENTIFIER, "Expect superclass method name."));
+        return arena.make<Super>(superclass, receiver, name.name, name.symbol);
+    }
+
+    if(match(TokenType::LEFT_PAREN))
+    {
+        Expression* expr = expression();
         consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-        return std::make_shared<Grouping>(expr);
+        return arena.make<Grouping>(expr);
     }
 
     throw std::runtime_error("Expect expression.");
 }
 
-bool Parser::match(const std::vector<TokenType> &types)
+VariableRef Parser::variableRef(const Token &name) const
 {
-    for(TokenType type: types)
+    std::string_view lexeme = name.lexeme(source);
+    std::uint32_t    symbol = name.symbol ? name.symbol : StringTable::current().symbol(lexeme);
+    return VariableRef{lexeme, symbol, name.line};
+}
+
+bool Parser::match(TokenType type)
+{
+    if(check(type))
     {
-        if(check(type))
-        {
-            advance();
-            return true;
-        }
+        advance();
+        return true;
     }
     return false;
 }
 
-bool Parser::check(TokenType type)
+bool Parser::check(TokenType type) const
 {
     if(isAtEnd()) return false;
     return peek().token_type == type;
 }
 
-bool Parser::isAtEnd()
+bool Parser::isAtEnd() const
 {
     return peek().token_type == TokenType::END_OF_FILE;
 }
 
-Token Parser::advance()
+const Token &Parser::advance()
 {
     if(!isAtEnd()) current++;
     return previous();
 }
 
-Token Parser::peek()
+const Token &Parser::peek() const
 {
+    reached_end |= current + 1 == tokens.size();
     return tokens[current];
 }
 
-Token Parser::previous()
+const Token &Parser::previous() const
 {
     return tokens[current - 1];
 }
 
-Token Parser::consume(TokenType type, const std::string &message)
+const Token &Parser::consume(TokenType type, const char *message)
 {
     if(check(type)) return advance();
     error(peek(), message);
     throw std::runtime_error(message);
 }
 
-void Parser::error(const Token &token, const std::string &message)
+void Parser::error(const Token &token, const char *message)
 {
     if(token.token_type == TokenType::END_OF_FILE)
     {
@@ -171,64 +477,11 @@ void Parser::error(const Token &token, const std::string &message)
     }
     else
     {
-        report(token.line, " at '" + token.lexeme + "'", message);
+        report(token.line, " at '" + std::string(token.lexeme(source)) + "'", message);
     }
 }
 
-void Parser::report(int line, const std::string &where, const std::string &message)
+void Parser::report(int line, const std::string &where, const char *message)
 {
     // std::cerr << "[line " << line << "] Error" << where << ": " << message << std::endl;
 }
-
-void Token::getStringtoTokenType(const std::string &str, TokenType &type)
-{
-    static const std::unordered_map<std::string, TokenType> tokenMap = {
-        {"LEFT_PAREN", TokenType::LEFT_PAREN},
-        {"RIGHT_PAREN", TokenType::RIGHT_PAREN},
-        {"LEFT_BRACE", TokenType::LEFT_BRACE},
-        {"RIGHT_BRACE", TokenType::RIGHT_BRACE},
-        {"COMMA", TokenType::COMMA},
-        {"DOT", TokenType::DOT},
-        {"MINUS", TokenType::MINUS},
-        {"PLUS", TokenType::PLUS},
-        {"SEMICOLON", TokenType::SEMICOLON},
-        {"SLASH", TokenType::SLASH},
-        {"STAR", TokenType::STAR},
-        {"BANG", TokenType::BANG},
-        {"BANG_EQUAL", TokenType::BANG_EQUAL},
-        {"EQUAL", TokenType::EQUAL},
-        {"EQUAL_EQUAL", TokenType::EQUAL_EQUAL},
-        {"GREATER", TokenType::GREATER},
-        {"GREATER_EQUAL", TokenType::GREATER_EQUAL},
-        {"LESS", TokenType::LESS},
-        {"LESS_EQUAL", TokenType::LESS_EQUAL},
-        {"IDENTIFIER", TokenType::IDENTIFIER},
-        {"STRING", TokenType::STRING},
-        {"NUMBER", TokenType::NUMBER},
-        {"AND", TokenType::AND},
-        {"CLASS", TokenType::CLASS},
-        {"ELSE", TokenType::ELSE},
-        {"FALSE", TokenType::FALSE},
-        {"FUN", TokenType::FUN},
-        {"FOR", TokenType::FOR},
-        {"IF", TokenType::IF},
-        {"NIL", TokenType::NIL},
-        {"OR", TokenType::OR},
-        {"PRINT", TokenType::PRINT},
-        {"RETURN", TokenType::RETURN},
-        {"SUPER", TokenType::SUPER},
-        {"THIS", TokenType::THIS},
-        {"TRUE", TokenType::TRUE},
-        {"VAR", TokenType::VAR},
-        {"WHILE", TokenType::WHILE},
-        {"EOF", TokenType::END_OF_FILE}};
-    auto it = tokenMap.find(str);
-    if(it != tokenMap.end())
-    {
-        type = it->second;
-    }
-    else
-    {
-        throw std::runtime_error("Unknown token type: " + str);
-    }
-}
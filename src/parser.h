@@ -1,323 +1,990 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <vector>
+#include <cstddef>
+#include <span>
 #include <string>
-#include <memory>
+#include <vector>
+#include <string_view>
 #include <iostream>
 #include <sstream>
-#include <variant>
-
-enum class TokenType
-{
-    LEFT_PAREN,
-    RIGHT_PAREN,
-    LEFT_BRACE,
-    RIGHT_BRACE,
-    COMMA,
-    DOT,
-    MINUS,
-    PLUS,
-    SEMICOLON,
-    SLASH,
-    STAR,
-    BANG,
-    BANG_EQUAL,
-    EQUAL,
-    EQUAL_EQUAL,
-    GREATER,
-    GREATER_EQUAL,
-    LESS,
-    LESS_EQUAL,
-    IDENTIFIER,
-    STRING,
-    NUMBER,
-    AND,
-    CLASS,
-    ELSE,
-    FALSE,
-    FUN,
-    FOR,
-    IF,
-    NIL,
-    OR,
-    PRINT,
-    RETURN,
-    SUPER,
-    THIS,
-    TRUE,
-    VAR,
-    WHILE,
-    END_OF_FILE
-};
-
-class Token
+#include "arena.h"
+#include "class.h"
+#include "environment.h"
+#include "token.h"
+#include "value.h"
+
+class Binary;
+class Unary;
+class Literal;
+class Grouping;
+class Variable;
+class Assign;
+class Logical;
+class Call;
+class Get;
+class Set;
+class This;
+class Super;
+class Invoke;
+
+// Double dispatch over the node types for passes that live outside the tree,
+// such as the bytecode compiler.
+class ExpressionVisitor
 {
 public:
-    TokenType   token_type;
-    std::string lexeme;
-    std::string literal;
-    int         line;
+    virtual void visitBinary(Binary& expr)     = 0;
+    virtual void visitUnary(Unary& expr)       = 0;
+    virtual void visitLiteral(Literal& expr)   = 0;
+    virtual void visitGrouping(Grouping& expr) = 0;
+    virtual void visitVariable(Variable& expr) = 0;
+    virtual void visitAssign(Assign& expr)     = 0;
+    virtual void visitLogical(Logical& expr)   = 0;
+    virtual void visitCall(Call& expr)         = 0;
+    virtual void visitGet(Get& expr)           = 0;
+    virtual void visitSet(Set& expr)           = 0;
+    virtual void visitThis(This& expr)         = 0;
+    virtual void visitSuper(Super& expr)       = 0;
+    virtual void visitInvoke(Invoke& expr)     = 0;
 
-    Token(TokenType type, const std::string& lexeme, const std::string& literal, int line)
-        : token_type(type), lexeme(lexeme), literal(literal), line(line)
+protected:
+    ~ExpressionVisitor() = default;
+};
+
+// Syntax tree nodes live in an Arena owned by whoever parsed them and are
+// released together with it, never individually; the destructor is therefore
+// non-virtual, which keeps nodes without owned members trivially
+// destructible.
+class Expression
+{
+public:
+    virtual std::string form_string()
     {
+        return "";
     }
+    // Runs the expression in the tree walker, with variables in env.
+    virtual Value evaluate(Environment& env) = 0;
+    virtual void accept(ExpressionVisitor& visitor) = 0;
 
-    Token(std::string type, const std::string& lexeme, const std::string& literal, int line)
-        : lexeme(lexeme), literal(literal), line(line)
+protected:
+    ~Expression() = default;
+
+private:
+};
+
+class Binary : public Expression
+{
+public:
+    Expression* left;
+    Token       op;
+    BinaryOp    operation;
+    Expression* right;
+
+    Binary(Expression* left, Token op, Expression* right)
+        : left(left), op(op), operation(binaryOpFor(op.token_type)), right(right)
     {
-        getStringtoTokenType(type, token_type);
+    }
+    virtual std::string form_string() override
+    {
+        return "(" + std::string(op.spelling()) + " " + left->form_string() + " " + right->form_string() +
+            ")";
     }
 
-    std::string toString() const
+    Value evaluate(Environment& env) override
     {
-        return lexeme + " " + literal;
+        Value left_result  = left->evaluate(env);
+        Value right_result = right->evaluate(env);
+        return binaryOperation(operation, left_result, right_result);
     }
 
-private:
-    void getStringtoTokenType(const std::string& str, TokenType& type);
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitBinary(*this);
+    }
 };
 
-using EvalResult = std::variant<double, bool, std::string>;
+class Unary : public Expression
+{
+public:
+    Token       op;
+    Expression* right;
+
+    Unary(Token op, Expression* right) : op(op), right(right) {}
+    virtual std::string form_string() override
+    {
+        return "(" + std::string(op.spelling()) + " " + right->form_string() + ")";
+    }
 
-class Expression
+    Value evaluate(Environment& env) override
+    {
+        return unaryOperation(op.token_type, right->evaluate(env));
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitUnary(*this);
+    }
+};
+
+// A constant decoded once by the parser; evaluating it is a plain load. Only
+// string literals hold a reference, so the others stay trivially
+// destructible and cost the arena no finalizer.
+class Literal : public Expression
 {
 public:
-    virtual ~Expression() = default;
-    virtual std::string form_string()
+    virtual Value constant() const = 0;
+
+    void accept(ExpressionVisitor& visitor) override
     {
-        return "";
+        visitor.visitLiteral(*this);
+    }
+};
+
+class NumberLiteral final : public Literal
+{
+public:
+    double number;
+    // lexeme points into the parsed source, which must outlive the node. It
+    // is empty for numbers computed by the optimizer.
+    std::string_view lexeme;
+
+    NumberLiteral(double number, std::string_view lexeme) : number(number), lexeme(lexeme) {}
+    virtual std::string form_string() override
+    {
+        return lexeme.empty() ? numberLiteral(number) : numberLiteral(lexeme);
     }
-    virtual EvalResult evaluate() = 0;
-    bool getstring = false;
 
-protected:
+    Value constant() const override
+    {
+        return Value::number(number);
+    }
+    Value evaluate(Environment&) override
+    {
+        return constant();
+    }
+};
 
-private:
+class StringLiteral final : public Literal
+{
+public:
+    Value value;
+
+    explicit StringLiteral(std::string_view text) : value(Value::string(text)) {}
+    explicit StringLiteral(Value string) : value(std::move(string)) {}
+    virtual std::string form_string() override
+    {
+        return std::string(value.asString()->view());
+    }
+
+    Value constant() const override
+    {
+        return value;
+    }
+    Value evaluate(Environment&) override
+    {
+        return constant();
+    }
 };
 
-class Binary : public Expression
+class BoolLiteral final : public Literal
 {
 public:
-    std::shared_ptr<Expression> left;
-    Token                       op;
-    std::shared_ptr<Expression> right;
+    bool value;
+
+    explicit BoolLiteral(bool value) : value(value) {}
+    virtual std::string form_string() override
+    {
+        return value ? "true" : "false";
+    }
 
-    Binary(std::shared_ptr<Expression> left, Token op, std::shared_ptr<Expression> right)
-        : left(left), op(op), right(right)
+    Value constant() const override
     {
+        return Value::boolean(value);
     }
+    Value evaluate(Environment&) override
+    {
+        return constant();
+    }
+};
+
+class NilLiteral final : public Literal
+{
+public:
     virtual std::string form_string() override
     {
-        return "(" + op.lexeme + " " + left->form_string() + " " + right->form_string() +
-            ")";
+        return "nil";
     }
 
-    EvalResult evaluate() override
+    Value constant() const override
     {
-        EvalResult left_result = left->evaluate();
-        EvalResult right_result = right->evaluate();
-        bool are_both_double = std::holds_alternative<double>(left_result) &&
-            std::holds_alternative<double>(right_result);
-        bool are_both_boolean = std::holds_alternative<bool>(left_result) &&
-            std::holds_alternative<bool>(right_result);
-        if (op.token_type == TokenType::GREATER)
-        {
-            if (are_both_double)
-                return std::get<double>(left_result) > std::get<double>(right_result);
-        }
-        else if (op.token_type == TokenType::GREATER_EQUAL)
-        {
-            if (are_both_double)
-                return std::get<double>(left_result) >= std::get<double>(right_result);
-        }
-        else if (op.token_type == TokenType::LESS)
+        return Value::nil();
+    }
+    Value evaluate(Environment&) override
+    {
+        return constant();
+    }
+};
+
+class Grouping : public Expression
+{
+public:
+    Expression* expression;
+
+    Grouping(Expression* expression) : expression(expression) {}
+    virtual std::string form_string() override
+    {
+        return "(group " + expression->form_string() + ")";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        return expression->evaluate(env);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitGrouping(*this);
+    }
+};
+
+// A use or declaration of a variable. The parser fills in the name, the
+// Resolver where the variable lives.
+struct VariableRef
+{
+    std::string_view name;   // points into the parsed source
+    std::uint32_t    symbol; // StringTable symbol id of name
+    int              line;
+    // Function frames between the use and the declaration, 0 being the
+    // current one, or -1 for a global.
+    int depth = -1;
+    // For depth 0, the index in the frame; above that, the index of the
+    // upvalue in the running closure; for a global, its slot in the
+    // program's GlobalNames.
+    int slot = 0;
+};
+
+// The value of a resolved variable in env.
+inline const Value& variableValue(Environment& env, const VariableRef& variable)
+{
+    if(variable.depth < 0)
+    {
+        return env.global(variable.slot);
+    }
+    return variable.depth == 0 ? env.local(variable.slot) : env.upvalue(variable.slot);
+}
+
+class Variable : public Expression
+{
+public:
+    VariableRef variable;
+
+    explicit Variable(VariableRef variable) : variable(variable) {}
+    virtual std::string form_string() override
+    {
+        return std::string(variable.name);
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        return variableValue(env, variable);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitVariable(*this);
+    }
+};
+
+class Assign : public Expression
+{
+public:
+    VariableRef variable;
+    Expression* value;
+
+    Assign(VariableRef variable, Expression* value) : variable(variable), value(value) {}
+    virtual std::string form_string() override
+    {
+        return "(= " + std::string(variable.name) + " " + value->form_string() + ")";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        Value result = value->evaluate(env);
+        if(variable.depth < 0)
         {
-            if (are_both_double)
-                return std::get<double>(left_result) < std::get<double>(right_result);
+            env.assignGlobal(variable.slot, result);
         }
-        else if (op.token_type == TokenType::LESS_EQUAL)
+        else if(variable.depth == 0)
         {
-            if (are_both_double) return std::get<double>(left_result) <= std::get<double>(right_result);
+            env.local(variable.slot) = result;
         }
-        else if (op.token_type == TokenType::EQUAL_EQUAL)
+        else
         {
-            return are_both_double ? std::get<double>(left_result) == std::get<double>(right_result)
-                : (!are_both_boolean ? (evaluateWithStringFlag(left) == evaluateWithStringFlag(right)) :
-                    std::get<bool>(left_result) == std::get<bool>(right_result));
+            env.upvalue(variable.slot) = result;
         }
-        else if (op.token_type == TokenType::BANG_EQUAL)
-        {
-            return are_both_double ? std::get<double>(left_result) != std::get<double>(right_result)
-                : (!are_both_boolean ? (evaluateWithStringFlag(left) != evaluateWithStringFlag(right)) :
-                    std::get<bool>(left_result) != std::get<bool>(right_result));
-        } 
-        else if(op.lexeme == "+")
+        return result;
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitAssign(*this);
+    }
+};
+
+// and / or: the right operand only runs if the left does not decide the
+// result, which is whichever operand was evaluated last.
+class Logical : public Expression
+{
+public:
+    Expression* left;
+    TokenType   op; // AND or OR
+    Expression* right;
+
+    Logical(Expression* left, TokenType op, Expression* right) : left(left), op(op), right(right) {}
+    virtual std::string form_string() override
+    {
+        return std::string("(") + (op == TokenType::AND ? "and" : "or") + " " + left->form_string() + " " +
+            right->form_string() + ")";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        Value result = left->evaluate(env);
+        if(result.isTruthy() == (op == TokenType::OR))
         {
-            if (are_both_double)
-                return std::get<double>(left_result) + std::get<double>(right_result);
-            if(!are_both_boolean)
-            {
-                return std::get<std::string>(left_result) + std::get<std::string>(right_result);
-            }
-            throw std::runtime_error("Operands must be two numbers or two strings.");
+            return result;
         }
-        else if(op.lexeme == "&&")
+        return right->evaluate(env);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitLogical(*this);
+    }
+};
+
+// Finishes a call set up at the top of env's stack by prepareCall or
+// prepareInvoke: runs closure with base as its frame (compiled, if the
+// closure engine compiled its body), or, for nullptr, takes
+// the result the call already left in base[0]. The stack is popped back to
+// base afterwards. Throws std::runtime_error for calls nested too deeply.
+Value completeCall(Environment& env, ObjClosure* closure, Value* base);
+
+class Call : public Expression
+{
+public:
+    Expression*            callee;
+    std::span<Expression*> arguments; // allocated in the same arena
+
+    Call(Expression* callee, std::span<Expression*> arguments) : callee(callee), arguments(arguments) {}
+    virtual std::string form_string() override
+    {
+        std::string text = "(call " + callee->form_string();
+        for(Expression* argument: arguments)
         {
-            if (std::holds_alternative<bool>(left_result) && std::holds_alternative<bool>(right_result))
-            {
-                return std::get<bool>(left_result) && std::get<bool>(right_result);
-            }
-            throw std::runtime_error("Operands must be two booleans.");
+            text += " " + argument->form_string();
         }
-        else if(op.lexeme == "||")
+        return text + ")";
+    }
+
+    // The callee and arguments are evaluated straight into the slots the
+    // callee's frame will start with.
+    Value evaluate(Environment& env) override
+    {
+        Value* base = env.top;
+        if(env.stackEnd() - base <= static_cast<std::ptrdiff_t>(arguments.size()))
         {
-            if (std::holds_alternative<bool>(left_result) && std::holds_alternative<bool>(right_result))
-            {
-                return std::get<bool>(left_result) || std::get<bool>(right_result);
-            }
-            throw std::runtime_error("Operands must be two booleans.");
+            Environment::stackOverflow();
         }
-        else if (are_both_double)
+        Value function = callee->evaluate(env);
+        *env.top++     = std::move(function);
+        for(Expression* argument: arguments)
         {
-            double left_val = std::get<double>(left_result);
-            double right_val = std::get<double>(right_result);
-            return (op.lexeme == "-" ? left_val - right_val : 
-                       (op.lexeme == "*" ? left_val * right_val : 
-                           (op.lexeme == "/" ? left_val / right_val : 0.0)));
-        }
-        throw std::runtime_error("Operands must be numbers.");
-    }
-    private:
-        std::string evaluateWithStringFlag(std::shared_ptr<Expression> expr, bool flag = true) const {
-            bool oldFlag = expr->getstring;
-            expr->getstring = flag;
-            EvalResult result = expr->evaluate();
-            expr->getstring = oldFlag;
-            return std::get<std::string>(result);
+            Value value = argument->evaluate(env);
+            *env.top++  = std::move(value);
         }
+        int argc = static_cast<int>(arguments.size());
+        return completeCall(env, prepareCall(base, argc), base);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitCall(*this);
+    }
 };
 
-class Unary : public Expression
+// object.name, where name is a field or a method.
+class Get : public Expression
+{
+public:
+    Expression*      object;
+    std::string_view name; // points into the parsed source
+    std::uint32_t    symbol;
+    InlineCache      cache;
+
+    Get(Expression* object, std::string_view name, std::uint32_t symbol) : object(object), name(name), symbol(symbol)
+    {
+    }
+    virtual std::string form_string() override
+    {
+        return "(. " + object->form_string() + " " + std::string(name) + ")";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        return getProperty(object->evaluate(env), symbol, cache);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitGet(*this);
+    }
+};
+
+class Set : public Expression
 {
 public:
-    Token                       op;
-    std::shared_ptr<Expression> right;
+    Expression*      object;
+    std::string_view name;
+    std::uint32_t    symbol;
+    Expression*      value;
+    InlineCache      cache;
 
-    Unary(Token op, std::shared_ptr<Expression> right) : op(op), right(right) {}
+    Set(Expression* object, std::string_view name, std::uint32_t symbol, Expression* value)
+        : object(object), name(name), symbol(symbol), value(value)
+    {
+    }
     virtual std::string form_string() override
     {
-        return "(" + op.lexeme + " " + right->form_string() + ")";
+        return "(= (. " + object->form_string() + " " + std::string(name) + ") " + value->form_string() + ")";
     }
 
-    EvalResult evaluate() override
+    Value evaluate(Environment& env) override
     {
-        EvalResult right_result = right->evaluate();
+        Value target = object->evaluate(env);
+        Value result = value->evaluate(env);
+        setProperty(target, symbol, result, cache);
+        return result;
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitSet(*this);
+    }
+};
 
-        if (std::holds_alternative<bool>(right_result))
+// Resolved like a variable: slot 0 of a method's frame, or an upvalue in
+// functions nested in one.
+class This : public Expression
+{
+public:
+    VariableRef variable;
+
+    explicit This(VariableRef variable) : variable(variable) {}
+    virtual std::string form_string() override
+    {
+        return "this";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        return variableValue(env, variable);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitThis(*this);
+    }
+};
+
+// super.name: the superclass's method, bound to this. The superclass is
+// held in a hidden variable that the class declaration creates and its
+// methods capture.
+class Super : public Expression
+{
+public:
+    VariableRef      superclass;
+    VariableRef      receiver;
+    std::string_view name;
+    std::uint32_t    symbol;
+
+    Super(VariableRef superclass, VariableRef receiver, std::string_view name, std::uint32_t symbol)
+        : superclass(superclass), receiver(receiver), name(name), symbol(symbol)
+    {
+    }
+    virtual std::string form_string() override
+    {
+        return "(super " + std::string(name) + ")";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        // 'super' first, so that is the name an error reports.
+        Value methods = variableValue(env, superclass);
+        return getSuperMethod(variableValue(env, receiver), methods, symbol);
+    }
+
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitSuper(*this);
+    }
+};
+
+// object.name(arguments), parsed from a call of a Get. A method is called
+// directly with object as this, without creating a bound method.
+class Invoke : public Expression
+{
+public:
+    Expression*            object;
+    std::string_view       name;
+    std::uint32_t          symbol;
+    std::span<Expression*> arguments; // allocated in the same arena
+    InlineCache            cache;
+
+    Invoke(Expression* object, std::string_view name, std::uint32_t symbol, std::span<Expression*> arguments)
+        : object(object), name(name), symbol(symbol), arguments(arguments)
+    {
+    }
+    virtual std::string form_string() override
+    {
+        std::string text = "(call (. " + object->form_string() + " " + std::string(name) + ")";
+        for(Expression* argument: arguments)
         {
-            if(op.lexeme == "!") return !std::get<bool>(right_result);
+            text += " " + argument->form_string();
         }
-        else if (std::holds_alternative<double>(right_result))
+        return text + ")";
+    }
+
+    Value evaluate(Environment& env) override
+    {
+        Value* base = env.top;
+        if(env.stackEnd() - base <= static_cast<std::ptrdiff_t>(arguments.size()))
         {
-            if (op.lexeme == "-")  return -std::get<double>(right_result);
-            return false;
+            Environment::stackOverflow();
         }
-        else if (std::holds_alternative<std::string>(right_result))
+        Value receiver = object->evaluate(env);
+        *env.top++     = std::move(receiver);
+        for(Expression* argument: arguments)
         {
-            if (op.lexeme == "!")
-                return (std::get<std::string>(right_result) == "nil");
+            Value value = argument->evaluate(env);
+            *env.top++  = std::move(value);
         }
+        int argc = static_cast<int>(arguments.size());
+        return completeCall(env, prepareInvoke(base, argc, symbol, cache), base);
+    }
 
-        throw std::runtime_error("Operand must be a number.");
+    void accept(ExpressionVisitor& visitor) override
+    {
+        visitor.visitInvoke(*this);
     }
 };
 
-class Literal : public Expression
+struct CompiledStatement;
+
+class PrintStatement;
+class ExpressionStatement;
+class VarStatement;
+class BlockStatement;
+class IfStatement;
+class WhileStatement;
+class FunctionStatement;
+class ReturnStatement;
+class ClassStatement;
+
+class StatementVisitor
 {
 public:
-    std::string value;
+    virtual void visitPrint(PrintStatement& stmt)           = 0;
+    virtual void visitExpression(ExpressionStatement& stmt) = 0;
+    virtual void visitVar(VarStatement& stmt)               = 0;
+    virtual void visitBlock(BlockStatement& stmt)           = 0;
+    virtual void visitIf(IfStatement& stmt)                 = 0;
+    virtual void visitWhile(WhileStatement& stmt)           = 0;
+    virtual void visitFunction(FunctionStatement& stmt)     = 0;
+    virtual void visitReturn(ReturnStatement& stmt)         = 0;
+    virtual void visitClass(ClassStatement& stmt)           = 0;
 
-    Literal(const std::string& value) : value(value) {}
+protected:
+    ~StatementVisitor() = default;
+};
 
-    virtual std::string form_string() override
+// How a statement finished in the tree walker: normally, or by a return
+// statement, whose value is in Environment::returned.
+enum class Flow : std::uint8_t
+{
+    NEXT,
+    RETURN
+};
+
+// Statements live in the same arena as the expressions they hold.
+class Statement
+{
+public:
+    // Runs the statement in the tree walker, with variables in env and
+    // program output going to env.out.
+    virtual Flow execute(Environment& env) = 0;
+    virtual void accept(StatementVisitor& visitor) = 0;
+
+protected:
+    ~Statement() = default;
+};
+
+class PrintStatement : public Statement
+{
+public:
+    Expression* expression;
+
+    explicit PrintStatement(Expression* expression) : expression(expression) {}
+
+    Flow execute(Environment& env) override
     {
-        return value;
+        printValue(env.out, expression->evaluate(env));
+        env.out << '\n';
+        return Flow::NEXT;
     }
 
-    EvalResult evaluate() override
+    void accept(StatementVisitor& visitor) override
     {
-        if (value == "true")
+        visitor.visitPrint(*this);
+    }
+};
+
+class ExpressionStatement : public Statement
+{
+public:
+    Expression* expression;
+
+    explicit ExpressionStatement(Expression* expression) : expression(expression) {}
+
+    Flow execute(Environment& env) override
+    {
+        expression->evaluate(env);
+        return Flow::NEXT;
+    }
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitExpression(*this);
+    }
+};
+
+class VarStatement : public Statement
+{
+public:
+    VariableRef variable;
+    Expression* initializer; // nullptr when there is none
+
+    VarStatement(VariableRef variable, Expression* initializer) : variable(variable), initializer(initializer) {}
+
+    Flow execute(Environment& env) override
+    {
+        Value value = initializer ? initializer->evaluate(env) : Value::nil();
+        if(variable.depth < 0)
         {
-            return true;
+            env.defineGlobal(variable.slot, std::move(value));
         }
-        else if (value == "false")
+        else
         {
-            return false;
+            env.local(variable.slot) = std::move(value);
         }
-        else
+        return Flow::NEXT;
+    }
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitVar(*this);
+    }
+};
+
+// Its locals take frame slots that later blocks reuse, so leaving a block
+// costs nothing at run time unless a closure captured one of them.
+class BlockStatement : public Statement
+{
+public:
+    std::span<Statement* const> statements; // allocated in the same arena
+    // First slot of the block's locals if a closure captures any of them,
+    // else -1. Set by the Resolver.
+    int close_slot = -1;
+
+    explicit BlockStatement(std::span<Statement* const> statements) : statements(statements) {}
+
+    Flow execute(Environment& env) override
+    {
+        Flow flow = Flow::NEXT;
+        for(Statement* stmt: statements)
         {
-            if(getstring)
-            {
-                return value;
-            }
-            try
+            flow = stmt->execute(env);
+            if(flow == Flow::RETURN)
             {
-                return std::stod(value);
+                break;
             }
-            catch (const std::exception& e)
+        }
+        if(close_slot >= 0)
+        {
+            env.closeUpvalues(env.frame + close_slot);
+        }
+        return flow;
+    }
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitBlock(*this);
+    }
+};
+
+class IfStatement : public Statement
+{
+public:
+    Expression* condition;
+    Statement*  then_branch;
+    Statement*  else_branch; // nullptr when there is none
+
+    IfStatement(Expression* condition, Statement* then_branch, Statement* else_branch)
+        : condition(condition), then_branch(then_branch), else_branch(else_branch)
+    {
+    }
+
+    Flow execute(Environment& env) override
+    {
+        if(condition->evaluate(env).isTruthy())
+        {
+            return then_branch->execute(env);
+        }
+        return else_branch ? else_branch->execute(env) : Flow::NEXT;
+    }
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitIf(*this);
+    }
+};
+
+// Also what for loops are parsed into.
+class WhileStatement : public Statement
+{
+public:
+    Expression* condition;
+    Statement*  body;
+
+    WhileStatement(Expression* condition, Statement* body) : condition(condition), body(body) {}
+
+    Flow execute(Environment& env) override
+    {
+        while(condition->evaluate(env).isTruthy())
+        {
+            if(body->execute(env) == Flow::RETURN)
             {
-                return value;
+                return Flow::RETURN;
             }
+            env.checkInterrupt();
         }
+        return Flow::NEXT;
+    }
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitWhile(*this);
     }
 };
 
-class Grouping : public Expression
+// Where a closure finds a captured variable when it is created: a slot of
+// the enclosing frame, or an upvalue of the enclosing closure.
+struct UpvalueRef
+{
+    bool is_local;
+    int  index;
+};
+
+enum class FunctionKind : std::uint8_t
+{
+    FUNCTION,
+    METHOD,
+    INITIALIZER // a method named init
+};
+
+// A function declaration, or a method of a class. Executing it creates a
+// closure over the running frame; the code itself is shared by every
+// closure through function. Slot 0 of the frame holds the callee, or this
+// in a method; the parameters follow.
+class FunctionStatement : public Statement
 {
 public:
-    std::shared_ptr<Expression> expression;
+    VariableRef                 name;
+    std::span<VariableRef>      params; // allocated in the same arena
+    std::span<Statement* const> body;
+    FunctionKind                kind;
+    // Set by the Resolver.
+    int                   frame_size = 0;
+    std::span<UpvalueRef> upvalues;
+    // Built on first execution; holds a reference.
+    ObjFunction* function = nullptr;
+    // The body, when the closure engine compiled it (see closure_compiler.h).
+    CompiledStatement* compiled = nullptr;
 
-    Grouping(std::shared_ptr<Expression> expression) : expression(expression) {}
-    virtual std::string form_string() override
+    FunctionStatement(VariableRef name, std::span<VariableRef> params, std::span<Statement* const> body,
+                      FunctionKind kind = FunctionKind::FUNCTION)
+        : name(name), params(params), body(body), kind(kind)
     {
-        return "(group " + expression->form_string() + ")";
     }
+    ~FunctionStatement()
+    {
+        if(function && --function->refcount == 0)
+        {
+            destroyHeapObject(function);
+        }
+    }
+
+    Flow execute(Environment& env) override;
+
+    // A new closure over env's running frame, holding one reference.
+    ObjClosure* makeClosure(Environment& env);
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitFunction(*this);
+    }
+};
+
+class ReturnStatement : public Statement
+{
+public:
+    Expression* value; // nullptr for a bare return
+    int         line;
+
+    ReturnStatement(Expression* value, int line) : value(value), line(line) {}
+
+    Flow execute(Environment& env) override
+    {
+        env.returned = value ? value->evaluate(env) : Value::nil();
+        return Flow::RETURN;
+    }
+
+    void accept(StatementVisitor& visitor) override
+    {
+        visitor.visitReturn(*this);
+    }
+};
+
+class ClassStatement : public Statement
+{
+public:
+    VariableRef                        name;
+    Variable*                          superclass; // nullptr when there is none
+    std::span<FunctionStatement* const> methods;   // allocated in the same arena
+    // The hidden local "super", which holds the superclass while the
+    // methods are created. Set by the Resolver, along with close_slot: its
+    // slot if a method captured it, else -1.
+    VariableRef super_variable;
+    int         close_slot = -1;
+
+    ClassStatement(VariableRef name, Variable* superclass, VariableRef super_variable,
+                   std::span<FunctionStatement* const> methods)
+        : name(name), superclass(superclass), methods(methods), super_variable(super_variable)
+    {
+    }
+
+    Flow execute(Environment& env) override;
 
-    EvalResult evaluate() override
+    void accept(StatementVisitor& visitor) override
     {
-        return expression->evaluate();
+        visitor.visitClass(*this);
     }
 };
 
+// Pratt parser over a borrowed token sequence ending in EOF. Apart from the
+// nodes it allocates in the arena, parsing does not allocate.
 class Parser
 {
 public:
-    Parser(const std::vector<Token>& tokens);
-    std::shared_ptr<Expression> parse();
+    // Operator binding power, weakest first.
+    enum class Precedence : std::uint8_t
+    {
+        NONE,
+        ASSIGNMENT, // =
+        OR,         // or
+        AND,        // and
+        EQUALITY,   // == !=
+        COMPARISON, // < > <= >=
+        TERM,       // + -
+        FACTOR,     // * /
+        UNARY,      // ! -
+        CALL,       // () .
+        PRIMARY
+    };
+
+    // tokens must outlive the parser; nodes are allocated in arena, which
+    // must outlive the returned tree.
+    Parser(std::span<const Token> tokens, std::string_view source, Arena& arena);
+
+    // A single expression, or nullptr on a syntax error.
+    Expression* parse();
+
+    // Every declaration up to EOF. Returns false on a syntax error.
+    bool parseProgram(std::vector<Statement*>& program);
+
+    // The next declaration, or nullptr on a syntax error. For input that is
+    // parsed as it arrives: position() is where the following one starts,
+    // and if reachedEnd() the result depended on the final token, so it
+    // may change once more tokens follow.
+    Statement* parseDeclaration();
+
+    std::size_t position() const
+    {
+        return current;
+    }
+    bool reachedEnd() const
+    {
+        return reached_end;
+    }
+
+    // Function and method declarations parsed so far. The tree walker runs
+    // their bodies from the tree, so the arena must outlive their closures.
+    std::size_t functionCount() const
+    {
+        return function_count;
+    }
 
 private:
-    std::vector<Token> tokens;
-    int                current;
-
-    std::shared_ptr<Expression> expression();
-    std::shared_ptr<Expression> equality();
-    std::shared_ptr<Expression> comparison();
-    std::shared_ptr<Expression> term();
-    std::shared_ptr<Expression> factor();
-    std::shared_ptr<Expression> unary();
-    std::shared_ptr<Expression> primary();
-
-    bool  match(const std::vector<TokenType>& types);
-    bool  check(TokenType type);
-    bool  isAtEnd();
-    Token advance();
-    Token peek();
-    Token previous();
-    Token consume(TokenType type, const std::string& message);
-    void  error(const Token& token, const std::string& message);
-    void  report(int line, const std::string& where, const std::string& message);
+    std::span<const Token> tokens;
+    std::string_view       source;
+    Arena&                 arena;
+    std::size_t            current;
+    mutable bool           reached_end    = false;
+    std::size_t            function_count = 0;
+
+    Statement*  declaration();
+    Statement*  varDeclaration();
+    Statement*  classDeclaration();
+    FunctionStatement* function(FunctionKind kind);
+    Statement*  statement();
+    Statement*  printStatement();
+    Statement*  ifStatement();
+    Statement*  whileStatement();
+    Statement*  forStatement();
+    Statement*  returnStatement();
+    Statement*  block();
+    Statement*  expressionStatement();
+    Expression* expression();
+    Expression* parsePrecedence(Precedence min_precedence);
+    Expression* prefix();
+    Expression* finishCall(Expression* callee);
+    Expression* primary();
+    VariableRef variableRef(const Token& name) const;
+
+    std::span<Statement* const> blockStatements();
+    // Copies items into the arena.
+    template <typename T>
+    std::span<T> arenaSpan(const std::vector<T>& items);
+
+    bool         match(TokenType type);
+    bool         check(TokenType type) const;
+    bool         isAtEnd() const;
+    const Token& advance();
+    const Token& peek() const;
+    const Token& previous() const;
+    const Token& consume(TokenType type, const char* message);
+    void         error(const Token& token, const char* message);
+    void         report(int line, const std::string& where, const char* message);
 };
 
 #endif // PARSER_H
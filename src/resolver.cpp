@@ -0,0 +1,383 @@
+#include "resolver.h"
+#include "intern.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+int Resolver::resolve(std::span<Statement* const> program)
+{
+    functions.clear();
+    functions.emplace_back();
+    current_class = ClassKind::NONE;
+    for(Statement* stmt: program)
+    {
+        stmt->accept(*this);
+    }
+    return functions.front().frame_size;
+}
+
+void Resolver::resolve(Expression* expr)
+{
+    functions.clear();
+    functions.emplace_back();
+    current_class = ClassKind::SUBCLASS;
+    expr->accept(*this);
+}
+
+void Resolver::visitBinary(Binary& expr)
+{
+    expr.left->accept(*this);
+    expr.right->accept(*this);
+}
+
+void Resolver::visitUnary(Unary& expr)
+{
+    expr.right->accept(*this);
+}
+
+void Resolver::visitLiteral(Literal&) {}
+
+void Resolver::visitGrouping(Grouping& expr)
+{
+    expr.expression->accept(*this);
+}
+
+void Resolver::visitVariable(Variable& expr)
+{
+    resolveUse(expr.variable, true);
+}
+
+void Resolver::visitAssign(Assign& expr)
+{
+    expr.value->accept(*this);
+    resolveUse(expr.variable, false);
+}
+
+void Resolver::visitLogical(Logical& expr)
+{
+    expr.left->accept(*this);
+    expr.right->accept(*this);
+}
+
+void Resolver::visitCall(Call& expr)
+{
+    expr.callee->accept(*this);
+    for(Expression* argument: expr.arguments)
+    {
+        argument->accept(*this);
+    }
+}
+
+void Resolver::visitGet(Get& expr)
+{
+    expr.object->accept(*this);
+}
+
+void Resolver::visitSet(Set& expr)
+{
+    expr.object->accept(*this);
+    expr.value->accept(*this);
+}
+
+void Resolver::visitThis(This& expr)
+{
+    if(current_class == ClassKind::NONE)
+    {
+        error(expr.variable.line, expr.variable.name, "Can't use 'this' outside of a class.");
+    }
+    resolveUse(expr.variable, true);
+}
+
+void Resolver::visitSuper(Super& expr)
+{
+    if(current_class == ClassKind::NONE)
+    {
+        error(expr.superclass.line, expr.superclass.name, "Can't use 'super' outside of a class.");
+    }
+    if(current_class != ClassKind::SUBCLASS)
+    {
+        error(expr.superclass.line, expr.superclass.name, "Can't use 'super' in a class with no superclass.");
+    }
+    resolveUse(expr.superclass, true);
+    resolveUse(expr.receiver, true);
+}
+
+void Resolver::visitInvoke(Invoke& expr)
+{
+    expr.object->accept(*this);
+    for(Expression* argument: expr.arguments)
+    {
+        argument->accept(*this);
+    }
+}
+
+void Resolver::visitPrint(PrintStatement& stmt)
+{
+    stmt.expression->accept(*this);
+}
+
+void Resolver::visitExpression(ExpressionStatement& stmt)
+{
+    stmt.expression->accept(*this);
+}
+
+void Resolver::visitVar(VarStatement& stmt)
+{
+    // Declared before the initializer is resolved, so that reading the
+    // variable there is caught rather than silently meaning an outer one.
+    declare(stmt.variable);
+    if(stmt.initializer)
+    {
+        stmt.initializer->accept(*this);
+    }
+    define(stmt.variable);
+}
+
+void Resolver::visitBlock(BlockStatement& stmt)
+{
+    beginScope();
+    for(Statement* inner: stmt.statements)
+    {
+        inner->accept(*this);
+    }
+    endScope(stmt.close_slot);
+}
+
+void Resolver::beginScope()
+{
+    functions.back().scopes.push_back(functions.back().locals.size());
+}
+
+void Resolver::endScope(int& close_slot)
+{
+    // Resolving the scope may have grown functions.
+    Function&   function = functions.back();
+    std::size_t first    = function.scopes.back();
+    for(std::size_t i = first; i < function.locals.size(); ++i)
+    {
+        if(function.locals[i].captured)
+        {
+            close_slot = static_cast<int>(first);
+            break;
+        }
+    }
+    function.locals.resize(first);
+    function.scopes.pop_back();
+}
+
+void Resolver::visitIf(IfStatement& stmt)
+{
+    stmt.condition->accept(*this);
+    stmt.then_branch->accept(*this);
+    if(stmt.else_branch)
+    {
+        stmt.else_branch->accept(*this);
+    }
+}
+
+void Resolver::visitWhile(WhileStatement& stmt)
+{
+    stmt.condition->accept(*this);
+    stmt.body->accept(*this);
+}
+
+void Resolver::visitFunction(FunctionStatement& stmt)
+{
+    // Defined straight away, so the body can call the function recursively.
+    declare(stmt.name);
+    define(stmt.name);
+    resolveFunction(stmt);
+}
+
+void Resolver::resolveFunction(FunctionStatement& stmt)
+{
+    // Parameters and the body's locals share one scope: the frame, which
+    // starts with the reserved slot. Symbol 0 names nothing, so the callee
+    // of a plain function can never be referred to.
+    functions.emplace_back();
+    Function& callee = functions.back();
+    callee.kind      = stmt.kind;
+    callee.scopes.push_back(0);
+    std::uint32_t slot_symbol = stmt.kind == FunctionKind::FUNCTION ? 0 : StringTable::current().symbol("this");
+    callee.locals.push_back({slot_symbol, true, false});
+    callee.frame_size = 1;
+    for(VariableRef& param: stmt.params)
+    {
+        declare(param);
+        define(param);
+    }
+    for(Statement* inner: stmt.body)
+    {
+        inner->accept(*this);
+    }
+
+    Function& function = functions.back();
+    stmt.frame_size    = function.frame_size;
+    void* memory       = arena.allocate(function.upvalues.size() * sizeof(UpvalueRef), alignof(UpvalueRef));
+    auto* upvalues     = static_cast<UpvalueRef*>(memory);
+    std::copy(function.upvalues.begin(), function.upvalues.end(), upvalues);
+    stmt.upvalues = std::span<UpvalueRef>(upvalues, function.upvalues.size());
+    functions.pop_back();
+}
+
+void Resolver::visitReturn(ReturnStatement& stmt)
+{
+    if(functions.size() == 1)
+    {
+        error(stmt.line, "return", "Can't return from top-level code.");
+    }
+    if(stmt.value)
+    {
+        if(functions.back().kind == FunctionKind::INITIALIZER)
+        {
+            error(stmt.line, "return", "Can't return a value from an initializer.");
+        }
+        stmt.value->accept(*this);
+    }
+}
+
+void Resolver::visitClass(ClassStatement& stmt)
+{
+    declare(stmt.name);
+    define(stmt.name);
+
+    ClassKind enclosing = current_class;
+    current_class       = ClassKind::CLASS;
+    if(stmt.superclass)
+    {
+        if(stmt.superclass->variable.symbol == stmt.name.symbol)
+        {
+            error(stmt.superclass->variable.line, stmt.superclass->variable.name,
+                  "A class can't inherit from itself.");
+        }
+        stmt.superclass->accept(*this);
+        current_class = ClassKind::SUBCLASS;
+        beginScope();
+        declare(stmt.super_variable);
+        define(stmt.super_variable);
+    }
+    for(FunctionStatement* method: stmt.methods)
+    {
+        resolveFunction(*method);
+    }
+    if(stmt.superclass)
+    {
+        endScope(stmt.close_slot);
+    }
+    current_class = enclosing;
+}
+
+void Resolver::declare(VariableRef& variable)
+{
+    Function& function = functions.back();
+    if(function.scopes.empty())
+    {
+        variable.depth = -1;
+        variable.slot  = static_cast<int>(globals.slot(variable.symbol));
+        return;
+    }
+
+    for(std::size_t i = function.scopes.back(); i < function.locals.size(); ++i)
+    {
+        if(function.locals[i].symbol == variable.symbol)
+        {
+            error(variable.line, variable.name, "Already a variable with this name in this scope.");
+        }
+    }
+    if(function.locals.size() == max_locals)
+    {
+        error(variable.line, variable.name, "Too many local variables in function.");
+    }
+
+    variable.depth = 0;
+    variable.slot  = static_cast<int>(function.locals.size());
+    function.locals.push_back({variable.symbol, false, false});
+    function.frame_size = std::max(function.frame_size, static_cast<int>(function.locals.size()));
+}
+
+void Resolver::define(const VariableRef& variable)
+{
+    if(variable.depth == 0)
+    {
+        functions.back().locals[variable.slot].defined = true;
+    }
+}
+
+void Resolver::resolveUse(VariableRef& variable, bool reading)
+{
+    const std::vector<Local>& locals = functions.back().locals;
+    for(std::size_t i = locals.size(); i-- > 0;)
+    {
+        if(locals[i].symbol == variable.symbol)
+        {
+            if(reading && !locals[i].defined)
+            {
+                error(variable.line, variable.name, "Can't read local variable in its own initializer.");
+            }
+            variable.depth = 0;
+            variable.slot  = static_cast<int>(i);
+            return;
+        }
+    }
+
+    int depth = 0;
+    int index = resolveUpvalue(functions.size() - 1, variable.symbol, depth);
+    if(index < 0)
+    {
+        variable.depth = -1;
+        variable.slot  = static_cast<int>(globals.slot(variable.symbol));
+        return;
+    }
+    for(const Function& function: functions)
+    {
+        if(function.upvalues.size() > max_upvalues)
+        {
+            error(variable.line, variable.name, "Too many closure variables in function.");
+        }
+    }
+    variable.depth = depth;
+    variable.slot  = index;
+}
+
+int Resolver::resolveUpvalue(std::size_t level, std::uint32_t symbol, int& depth)
+{
+    if(level == 0)
+    {
+        return -1;
+    }
+    Function& enclosing = functions[level - 1];
+    for(std::size_t i = enclosing.locals.size(); i-- > 0;)
+    {
+        if(enclosing.locals[i].symbol == symbol)
+        {
+            enclosing.locals[i].captured = true;
+            depth                        = 1;
+            return addUpvalue(functions[level], true, static_cast<int>(i));
+        }
+    }
+    int index = resolveUpvalue(level - 1, symbol, depth);
+    if(index < 0)
+    {
+        return -1;
+    }
+    ++depth;
+    return addUpvalue(functions[level], false, index);
+}
+
+int Resolver::addUpvalue(Function& function, bool is_local, int index)
+{
+    for(std::size_t i = 0; i < function.upvalues.size(); ++i)
+    {
+        if(function.upvalues[i].is_local == is_local && function.upvalues[i].index == index)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    function.upvalues.push_back({is_local, index});
+    return static_cast<int>(function.upvalues.size() - 1);
+}
+
+void Resolver::error(int line, std::string_view lexeme, const char* message)
+{
+    throw std::runtime_error("[line " + std::to_string(line) + "] Error at '" + std::string(lexeme) + "': " + message);
+}
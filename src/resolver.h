@@ -0,0 +1,124 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "environment.h"
+#include "parser.h"
+
+// Decides where every variable lives before the program runs, so that the
+// engines never look a name up. Variables declared outside any block or
+// function are globals, numbered in the program's GlobalNames; the others
+// get a slot in the flat frame of the
+// function (or top-level code) they appear in. A block's slots are handed
+// out again once it ends, so a frame is as large as the most locals alive at
+// one time. A variable used from a nested function becomes an upvalue of
+// every function in between.
+//
+// Slot 0 of every function's frame is reserved for the callee, which in a
+// method is this; the parameters follow from slot 1. The superclass of a
+// class is held in a hidden local named super, in a scope of its own around
+// the methods.
+class Resolver : private ExpressionVisitor, private StatementVisitor
+{
+public:
+    // Upvalue lists are allocated in arena, normally the one the tree lives
+    // in. Globals are given slots in globals.
+    Resolver(Arena& arena, GlobalNames& globals) : arena(arena), globals(globals) {}
+
+    // Annotates every variable, block and function in program and returns
+    // the number of frame slots the top-level code needs. Throws
+    // std::runtime_error for a local read in its own initializer, a name
+    // declared twice in one block, a return outside any function or with a
+    // value in an initializer, this or super outside a method, super in a
+    // class without a superclass, or a class inheriting from itself.
+    int resolve(std::span<Statement* const> program);
+
+    // Gives every variable in expr, all of them globals, its slot. An
+    // expression has no scope to check, so this and super are let through
+    // and fail at run time as undefined globals.
+    void resolve(Expression* expr);
+
+    // Locals and upvalues are addressed by a one-byte operand in bytecode.
+    static constexpr std::size_t max_locals   = 256;
+    static constexpr std::size_t max_upvalues = 256;
+
+private:
+    struct Local
+    {
+        std::uint32_t symbol;
+        bool          defined;
+        bool          captured;
+    };
+
+    // The function being resolved; the first one is the top-level code.
+    struct Function
+    {
+        // Locals in scope, innermost last; a local's slot is its index here.
+        std::vector<Local>       locals;
+        // Where each open block's locals start in locals.
+        std::vector<std::size_t> scopes;
+        std::vector<UpvalueRef>  upvalues;
+        int                      frame_size = 0;
+        FunctionKind             kind       = FunctionKind::FUNCTION;
+    };
+
+    enum class ClassKind
+    {
+        NONE,
+        CLASS,
+        SUBCLASS
+    };
+
+    void visitBinary(Binary& expr) override;
+    void visitUnary(Unary& expr) override;
+    void visitLiteral(Literal& expr) override;
+    void visitGrouping(Grouping& expr) override;
+    void visitVariable(Variable& expr) override;
+    void visitAssign(Assign& expr) override;
+    void visitLogical(Logical& expr) override;
+    void visitCall(Call& expr) override;
+    void visitGet(Get& expr) override;
+    void visitSet(Set& expr) override;
+    void visitThis(This& expr) override;
+    void visitSuper(Super& expr) override;
+    void visitInvoke(Invoke& expr) override;
+
+    void visitPrint(PrintStatement& stmt) override;
+    void visitExpression(ExpressionStatement& stmt) override;
+    void visitVar(VarStatement& stmt) override;
+    void visitBlock(BlockStatement& stmt) override;
+    void visitIf(IfStatement& stmt) override;
+    void visitWhile(WhileStatement& stmt) override;
+    void visitFunction(FunctionStatement& stmt) override;
+    void visitReturn(ReturnStatement& stmt) override;
+    void visitClass(ClassStatement& stmt) override;
+
+    void resolveFunction(FunctionStatement& stmt);
+    // Opens and closes a block's scope. Closing sets close_slot to the
+    // block's first slot if a closure captured any of its locals.
+    void beginScope();
+    void endScope(int& close_slot);
+
+    // Gives variable a slot in the innermost block, or leaves it global at
+    // the top level. It counts as defined only once define() is called.
+    void declare(VariableRef& variable);
+    void define(const VariableRef& variable);
+    void resolveUse(VariableRef& variable, bool reading);
+    // Index of the upvalue of functions[level] that reaches symbol, or -1.
+    int  resolveUpvalue(std::size_t level, std::uint32_t symbol, int& depth);
+    int  addUpvalue(Function& function, bool is_local, int index);
+
+    [[noreturn]] static void error(int line, std::string_view lexeme, const char* message);
+
+    Arena&                arena;
+    GlobalNames&          globals;
+    std::vector<Function> functions;
+    ClassKind             current_class = ClassKind::NONE;
+};
+
+#endif // RESOLVER_H
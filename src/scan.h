@@ -0,0 +1,229 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Bulk character-class scanners used by the tokenizer. Each kernel starts at
+// pos and returns the index of the first byte in [pos, size) that ends the
+// run, or size if the run reaches the end of the buffer. The buffer is never
+// read past size.
+//
+// Most runs are a few bytes long, so the kernels are inline and chosen at
+// compile time: SSE2, which every x86-64 CPU has, classifies 16 bytes per
+// step; other targets use the scalar loops.
+namespace scan
+{
+namespace scalar
+{
+inline bool isWhitespace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+inline bool isDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+inline bool isIdentifier(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || isDigit(ch) || ch == '_';
+}
+
+inline std::size_t skipWhitespace(const char* data, std::size_t pos, std::size_t size, int& lines)
+{
+    for(; pos < size && isWhitespace(data[pos]); ++pos)
+    {
+        lines += data[pos] == '\n';
+    }
+    return pos;
+}
+
+inline std::size_t skipIdentifier(const char* data, std::size_t pos, std::size_t size)
+{
+    while(pos < size && isIdentifier(data[pos]))
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+inline std::size_t skipDigits(const char* data, std::size_t pos, std::size_t size)
+{
+    while(pos < size && isDigit(data[pos]))
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+inline std::size_t findQuote(const char* data, std::size_t pos, std::size_t size, int& lines)
+{
+    for(; pos < size && data[pos] != '"'; ++pos)
+    {
+        lines += data[pos] == '\n';
+    }
+    return pos;
+}
+
+inline std::size_t findNewline(const char* data, std::size_t pos, std::size_t size)
+{
+    const void* found = std::memchr(data + pos, '\n', size - pos);
+    return found ? static_cast<const char*>(found) - data : size;
+}
+} // namespace scalar
+
+#ifdef __SSE2__
+// The vector loops hand the last partial block to the scalar ones.
+namespace sse2
+{
+inline __m128i load(const char* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline __m128i equal(__m128i v, char ch)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch));
+}
+
+inline __m128i inRange(__m128i v, char lo, char hi)
+{
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(static_cast<char>(hi - lo))), d);
+}
+
+inline std::uint32_t mask(__m128i v)
+{
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+}
+
+// Counts the set bits of lines_mask that sit below the first set bit of stop.
+inline int linesBefore(std::uint32_t lines_mask, std::uint32_t stop)
+{
+    return __builtin_popcount(lines_mask & ((stop & -stop) - 1));
+}
+
+inline std::size_t skipWhitespace(const char* data, std::size_t pos, std::size_t size, int& lines)
+{
+    for(; pos + 16 <= size; pos += 16)
+    {
+        __m128i       v    = load(data + pos);
+        __m128i       nl   = equal(v, '\n');
+        __m128i       ws   = _mm_or_si128(_mm_or_si128(equal(v, ' '), equal(v, '\t')), _mm_or_si128(equal(v, '\r'), nl));
+        std::uint32_t stop = ~mask(ws) & 0xFFFF;
+        if(stop)
+        {
+            lines += linesBefore(mask(nl), stop);
+            return pos + __builtin_ctz(stop);
+        }
+        lines += __builtin_popcount(mask(nl));
+    }
+    return scalar::skipWhitespace(data, pos, size, lines);
+}
+
+inline std::size_t skipIdentifier(const char* data, std::size_t pos, std::size_t size)
+{
+    for(; pos + 16 <= size; pos += 16)
+    {
+        __m128i       v     = load(data + pos);
+        __m128i       lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i       ident = _mm_or_si128(_mm_or_si128(inRange(lower, 'a', 'z'), inRange(v, '0', '9')), equal(v, '_'));
+        std::uint32_t stop  = ~mask(ident) & 0xFFFF;
+        if(stop)
+        {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scalar::skipIdentifier(data, pos, size);
+}
+
+inline std::size_t skipDigits(const char* data, std::size_t pos, std::size_t size)
+{
+    for(; pos + 16 <= size; pos += 16)
+    {
+        std::uint32_t stop = ~mask(inRange(load(data + pos), '0', '9')) & 0xFFFF;
+        if(stop)
+        {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scalar::skipDigits(data, pos, size);
+}
+
+inline std::size_t findQuote(const char* data, std::size_t pos, std::size_t size, int& lines)
+{
+    for(; pos + 16 <= size; pos += 16)
+    {
+        __m128i       v    = load(data + pos);
+        std::uint32_t nl   = mask(equal(v, '\n'));
+        std::uint32_t stop = mask(equal(v, '"'));
+        if(stop)
+        {
+            lines += linesBefore(nl, stop);
+            return pos + __builtin_ctz(stop);
+        }
+        lines += __builtin_popcount(nl);
+    }
+    return scalar::findQuote(data, pos, size, lines);
+}
+
+inline std::size_t findNewline(const char* data, std::size_t pos, std::size_t size)
+{
+    for(; pos + 16 <= size; pos += 16)
+    {
+        std::uint32_t stop = mask(equal(load(data + pos), '\n'));
+        if(stop)
+        {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scalar::findNewline(data, pos, size);
+}
+} // namespace sse2
+
+namespace kernels = sse2;
+inline constexpr const char* implementation_name = "sse2";
+#else
+namespace kernels = scalar;
+inline constexpr const char* implementation_name = "scalar";
+#endif
+
+// Spaces, tabs, carriage returns and newlines. Newlines crossed are added to
+// lines.
+inline std::size_t skipWhitespace(const char* data, std::size_t pos, std::size_t size, int& lines)
+{
+    return kernels::skipWhitespace(data, pos, size, lines);
+}
+
+// [A-Za-z0-9_]
+inline std::size_t skipIdentifier(const char* data, std::size_t pos, std::size_t size)
+{
+    return kernels::skipIdentifier(data, pos, size);
+}
+
+// [0-9]
+inline std::size_t skipDigits(const char* data, std::size_t pos, std::size_t size)
+{
+    return kernels::skipDigits(data, pos, size);
+}
+
+// Position of the next '"'. Newlines crossed are added to lines.
+inline std::size_t findQuote(const char* data, std::size_t pos, std::size_t size, int& lines)
+{
+    return kernels::findQuote(data, pos, size, lines);
+}
+
+// Position of the next '\n' (the end of a // comment).
+inline std::size_t findNewline(const char* data, std::size_t pos, std::size_t size)
+{
+    return kernels::findNewline(data, pos, size);
+}
+} // namespace scan
+
+#endif // SCAN_H
@@ -0,0 +1,587 @@
+#include "serve.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+// Requests are refused past this size, so a broken client cannot make the
+// server allocate without bound.
+constexpr std::uint32_t max_request_frame = 256u << 20;
+
+bool writeAll(int fd, const char* data, std::size_t size, int flags = 0)
+{
+    while(size > 0)
+    {
+        ssize_t n = ::send(fd, data, size, flags | MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, char* data, std::size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = ::read(fd, data, size);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+void putWord(char* out, std::uint32_t word)
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        out[i] = static_cast<char>(word >> (8 * i));
+    }
+}
+
+std::uint32_t getWord(const char* in)
+{
+    std::uint32_t word = 0;
+    for(int i = 0; i < 4; ++i)
+    {
+        word |= static_cast<std::uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return word;
+}
+
+bool writeFrame(int fd, char tag, std::string_view payload)
+{
+    char header[5];
+    header[0] = tag;
+    putWord(header + 1, static_cast<std::uint32_t>(payload.size()));
+#ifdef MSG_MORE
+    int more = payload.empty() ? 0 : MSG_MORE;
+#else
+    int more = 0;
+#endif
+    return writeAll(fd, header, sizeof header, more) && writeAll(fd, payload.data(), payload.size());
+}
+
+bool readFrame(int fd, char& tag, std::string& payload, std::uint32_t limit)
+{
+    char header[5];
+    if(!readAll(fd, header, sizeof header))
+    {
+        return false;
+    }
+    tag                = header[0];
+    std::uint32_t size = getWord(header + 1);
+    if(size > limit)
+    {
+        return false;
+    }
+    payload.resize(size);
+    return readAll(fd, payload.data(), size);
+}
+
+// Sends what is written to it as frames with one tag, each time the buffer
+// fills or the stream is flushed, and once output has waited for `hold`
+// (see Watcher), so a slow program's output arrives as it prints. The
+// watcher sends from its own thread, so writes and sends take the
+// request's lock, and there is no put area for the stream to write to
+// behind it. Once sending fails (the client has gone) further output is
+// dropped.
+class FrameBuffer : public std::streambuf
+{
+public:
+    static constexpr std::chrono::milliseconds hold{20};
+
+    FrameBuffer(int fd, char tag, std::mutex& sending) : fd(fd), tag(tag), sending(sending) {}
+
+    bool ok() const
+    {
+        return !failed;
+    }
+
+    // Sends the output if it has waited for hold by now.
+    void flushIfDue(std::chrono::steady_clock::time_point now)
+    {
+        std::lock_guard<std::mutex> guard(sending);
+        if(used > 0 && now - since >= hold)
+        {
+            send();
+        }
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if(!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            char byte = traits_type::to_char_type(ch);
+            xsputn(&byte, 1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        std::lock_guard<std::mutex> guard(sending);
+        if(used == 0)
+        {
+            since = std::chrono::steady_clock::now();
+        }
+        for(std::size_t left = static_cast<std::size_t>(size); left > 0;)
+        {
+            if(used == sizeof buffer)
+            {
+                send();
+            }
+            std::size_t chunk = std::min(left, sizeof buffer - used);
+            std::copy(data, data + chunk, buffer + used);
+            used += chunk;
+            data += chunk;
+            left -= chunk;
+        }
+        return size;
+    }
+
+    int sync() override
+    {
+        std::lock_guard<std::mutex> guard(sending);
+        send();
+        return 0;
+    }
+
+private:
+    // With sending held.
+    void send()
+    {
+        if(used > 0 && !failed)
+        {
+            failed = !writeFrame(fd, tag, std::string_view(buffer, used));
+        }
+        used = 0;
+    }
+
+    int                                   fd;
+    char                                  tag;
+    std::mutex&                           sending;
+    bool                                  failed = false;
+    std::size_t                           used   = 0;
+    std::chrono::steady_clock::time_point since;
+    char                                  buffer[1 << 16];
+};
+
+// A request being answered, as the watcher sees it.
+struct Running
+{
+    FrameBuffer&                          out;
+    std::chrono::steady_clock::time_point deadline; // max() without a limit
+    std::atomic<bool>                     expired = false;
+};
+
+// Looks in on the requests being answered every FrameBuffer::hold, from a
+// thread of its own: output that has waited that long is sent, so what a
+// program printed before a long computation is not held back, and a request
+// past its deadline is marked expired.
+class Watcher
+{
+public:
+    Watcher() : thread([this] { run(); }) {}
+    ~Watcher()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    void add(Running& request)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running.push_back(&request);
+        }
+        wake.notify_one();
+    }
+
+    // Once this returns, the watcher no longer touches request.
+    void remove(Running& request)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::erase(running, &request);
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while(!stopping)
+        {
+            if(running.empty())
+            {
+                wake.wait(guard);
+                continue;
+            }
+            wake.wait_for(guard, FrameBuffer::hold);
+            auto now = std::chrono::steady_clock::now();
+            for(Running* request: running)
+            {
+                request->out.flushIfDue(now);
+                if(now >= request->deadline)
+                {
+                    request->expired.store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::vector<Running*>   running;
+    bool                    stopping = false;
+    std::thread             thread; // last, so the rest is ready when it starts
+};
+
+bool readRequest(int fd, ServeRequest& request)
+{
+    char tag;
+    if(!readFrame(fd, tag, request.command, 64) || tag != 'C')
+    {
+        return false;
+    }
+    std::string body;
+    if(!readFrame(fd, tag, body, max_request_frame) || (tag != 'F' && tag != 'S'))
+    {
+        return false;
+    }
+    request.inline_source = tag == 'S';
+    (request.inline_source ? request.source : request.file) = std::move(body);
+    (request.inline_source ? request.file : request.source).clear();
+    return true;
+}
+
+// Written to by the signal handler to wake the accept loop.
+int stop_pipe[2] = {-1, -1};
+
+extern "C" void requestStop(int)
+{
+    int saved = errno;
+    char byte = 0;
+    [[maybe_unused]] ssize_t n = ::write(stop_pipe[1], &byte, 1);
+    errno = saved;
+}
+
+// Accepted connections waiting for a worker, and the ones being served.
+struct Connections
+{
+    std::mutex              lock;
+    std::condition_variable ready;
+    std::deque<int>         waiting;
+    std::unordered_set<int> open;
+    bool                    closed = false;
+
+    // The next connection to serve, or -1 once closed and drained.
+    int take()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [this] { return closed || !waiting.empty(); });
+        if(waiting.empty())
+        {
+            return -1;
+        }
+        int fd = waiting.front();
+        waiting.pop_front();
+        return fd;
+    }
+
+    void finish(int fd)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        open.erase(fd);
+        ::close(fd);
+    }
+};
+
+void serveConnection(int                       fd,
+                     ServeHandler&             handler,
+                     Watcher&                  watcher,
+                     std::chrono::milliseconds timeout,
+                     std::atomic<std::size_t>& answered)
+{
+    ServeRequest request;
+    while(readRequest(fd, request))
+    {
+        std::mutex   sending;
+        FrameBuffer  out_buffer(fd, 'O', sending);
+        FrameBuffer  err_buffer(fd, 'E', sending);
+        std::ostream out(&out_buffer);
+        std::ostream err(&err_buffer);
+        // Errors are rare and go out at once, so they stay in order with
+        // the output, which is flushed before an error is reported.
+        err.setf(std::ios::unitbuf);
+
+        auto    now = std::chrono::steady_clock::now();
+        Running running{out_buffer, timeout.count() > 0 ? now + timeout : decltype(now)::max()};
+        request.expired = &running.expired;
+        watcher.add(running);
+        int status;
+        try
+        {
+            status = handler(request, out, err);
+        }
+        catch(const std::exception& e)
+        {
+            out.flush();
+            err << e.what() << '\n';
+            status = 1;
+        }
+        watcher.remove(running);
+        out.flush();
+        char word[4];
+        putWord(word, static_cast<std::uint32_t>(status));
+        if(!out_buffer.ok() || !err_buffer.ok() || !writeFrame(fd, 'X', std::string_view(word, 4)))
+        {
+            return;
+        }
+        answered.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int listenOn(const std::string& path, std::ostream& log)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof address.sun_path)
+    {
+        log << "Socket path too long: " << path << '\n';
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        log << "Cannot create socket: " << std::strerror(errno) << '\n';
+        return -1;
+    }
+    // A socket file left by a server that is no longer running is replaced;
+    // one that still answers is not, and neither is anything else.
+    struct stat existing;
+    if(::lstat(path.c_str(), &existing) == 0)
+    {
+        int probe = S_ISSOCK(existing.st_mode) ? connectToServer(path) : -1;
+        if(!S_ISSOCK(existing.st_mode) || probe >= 0)
+        {
+            if(probe >= 0)
+            {
+                ::close(probe);
+            }
+            ::close(fd);
+            log << "Cannot listen on " << path << ": "
+                << (probe >= 0 ? "a server is already listening" : "not a socket") << '\n';
+            return -1;
+        }
+        ::unlink(path.c_str());
+    }
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0 || ::listen(fd, SOMAXCONN) < 0)
+    {
+        log << "Cannot listen on " << path << ": " << std::strerror(errno) << '\n';
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+} // namespace
+
+int serve(const std::string&        path,
+          unsigned                  workers,
+          std::chrono::milliseconds timeout,
+          const ServeHandlerFactory& make_handler,
+          std::ostream&             log)
+{
+    int listener = listenOn(path, log);
+    if(listener < 0)
+    {
+        return 1;
+    }
+    if(::pipe2(stop_pipe, O_CLOEXEC) < 0)
+    {
+        log << "Cannot create pipe: " << std::strerror(errno) << '\n';
+        ::close(listener);
+        ::unlink(path.c_str());
+        return 1;
+    }
+    struct sigaction action{};
+    action.sa_handler = requestStop;
+    sigemptyset(&action.sa_mask);
+    struct sigaction old_int, old_term;
+    ::sigaction(SIGINT, &action, &old_int);
+    ::sigaction(SIGTERM, &action, &old_term);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    Connections              connections;
+    Watcher                  watcher;
+    std::atomic<std::size_t> answered = 0;
+    std::size_t              accepted = 0;
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < workers; ++t)
+    {
+        threads.emplace_back([&] {
+            // Local to the thread, so what it keeps goes before the
+            // thread's own state does.
+            ServeHandler handler = make_handler();
+            for(int fd; (fd = connections.take()) >= 0;)
+            {
+                serveConnection(fd, handler, watcher, timeout, answered);
+                connections.finish(fd);
+            }
+        });
+    }
+    log << "[serve] listening on " << path << " with " << workers << " workers" << std::endl;
+
+    pollfd watched[2] = {{listener, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+    for(;;)
+    {
+        if(::poll(watched, 2, -1) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if(watched[1].revents)
+        {
+            break;
+        }
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0)
+        {
+            continue;
+        }
+        ++accepted;
+        std::lock_guard<std::mutex> guard(connections.lock);
+        connections.waiting.push_back(fd);
+        connections.open.insert(fd);
+        connections.ready.notify_one();
+    }
+
+    ::close(listener);
+    ::unlink(path.c_str());
+    {
+        // Connections still open see end of input once the request in
+        // progress, if any, has been answered.
+        std::lock_guard<std::mutex> guard(connections.lock);
+        connections.closed = true;
+        for(int fd: connections.open)
+        {
+            ::shutdown(fd, SHUT_RD);
+        }
+        connections.ready.notify_all();
+    }
+    for(std::thread& thread: threads)
+    {
+        thread.join();
+    }
+    ::sigaction(SIGINT, &old_int, nullptr);
+    ::sigaction(SIGTERM, &old_term, nullptr);
+    ::close(stop_pipe[0]);
+    ::close(stop_pipe[1]);
+    log << "[serve] stopped: " << answered.load() << " requests on " << accepted << " connections" << std::endl;
+    return 0;
+}
+
+int connectToServer(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof address.sun_path)
+    {
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    while(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0)
+    {
+        if(errno != EINTR)
+        {
+            ::close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+int sendRequest(int fd, const ServeRequest& request, std::ostream& out, std::ostream& err)
+{
+    if(!writeFrame(fd, 'C', request.command)
+       || !writeFrame(fd, request.inline_source ? 'S' : 'F', request.inline_source ? request.source : request.file))
+    {
+        return -1;
+    }
+    char        tag;
+    std::string payload;
+    while(readFrame(fd, tag, payload, UINT32_MAX))
+    {
+        switch(tag)
+        {
+        case 'O':
+            out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+            out.flush();
+            break;
+        case 'E':
+            out.flush();
+            err.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+            break;
+        case 'X':
+            if(payload.size() != 4)
+            {
+                return -1;
+            }
+            out.flush();
+            return static_cast<int>(getWord(payload.data()));
+        default:
+            return -1;
+        }
+    }
+    return -1;
+}
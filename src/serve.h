@@ -0,0 +1,60 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <string>
+
+// The serve and client commands talk over a Unix domain socket in frames: a
+// one-byte tag, the payload's length as 4 bytes little-endian, then the
+// payload. A request is a 'C' frame naming the command followed by either
+// an 'F' frame with the path of a file the server reads or an 'S' frame
+// with the source itself. The reply is any number of 'O' (output) and 'E'
+// (error) frames, in the order they were written, then an 'X' frame with
+// the exit status as 4 bytes little-endian. A connection may carry any
+// number of requests, one after another.
+struct ServeRequest
+{
+    std::string command;
+    std::string file;   // unless inline_source
+    std::string source; // if inline_source
+    bool        inline_source = false;
+    // While the request is answered, a flag the server sets once it has run
+    // past the time limit. The handler should then stop as soon as it can.
+    const std::atomic<bool>* expired = nullptr;
+};
+
+// Answers one request, writing what it prints to out and its errors to err,
+// and returns the exit status. Output is sent back as the buffers fill, or
+// once it has waited a moment, so a long-running program streams.
+using ServeHandler = std::function<int(const ServeRequest& request, std::ostream& out, std::ostream& err)>;
+
+// Called on every worker thread for the handler that thread uses. Whatever
+// the handler keeps, such as parsed programs, belongs to that thread and is
+// destroyed on it.
+using ServeHandlerFactory = std::function<ServeHandler()>;
+
+// Listens on a socket at path, replacing a stale one, and answers requests
+// on `workers` threads, each serving one connection at a time, until
+// SIGINT or SIGTERM. Then it stops accepting, lets requests in progress
+// finish, and removes the socket. A request still running after timeout,
+// unless that is zero, has its expired flag set. Returns 0, or 1 if the
+// socket cannot be set up (reported on log, which also gets a line at start
+// and stop).
+int serve(const std::string&        path,
+          unsigned                  workers,
+          std::chrono::milliseconds timeout,
+          const ServeHandlerFactory& make_handler,
+          std::ostream&             log);
+
+// Connects to a server at path. Returns the socket, or -1.
+int connectToServer(const std::string& path);
+
+// Sends request on a connected socket and relays the reply as it arrives:
+// output to out, errors to err. Returns the exit status, or -1 if the
+// connection failed.
+int sendRequest(int fd, const ServeRequest& request, std::ostream& out, std::ostream& err);
+
+#endif // SERVE_H
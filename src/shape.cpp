@@ -0,0 +1,47 @@
+#include "shape.h"
+#include <atomic>
+
+namespace
+{
+// Shared by every thread, so that ids stay unique however objects move. 64
+// bits, so that even a server creating shapes for years never wraps around
+// to an id a stale cache entry still holds.
+std::atomic<std::uint64_t> next_shape_id{1};
+} // namespace
+
+Shape::Shape() : id(next_shape_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+int Shape::find(std::uint32_t name) const
+{
+    for(const Shape* shape = this; shape->parent; shape = shape->parent)
+    {
+        if(shape->symbol == name)
+        {
+            return static_cast<int>(shape->count) - 1;
+        }
+    }
+    return -1;
+}
+
+Shape* Shape::add(std::uint32_t name)
+{
+    for(auto& [transition, child]: transitions)
+    {
+        if(transition == name)
+        {
+            return child.get();
+        }
+    }
+    auto child    = std::make_unique<Shape>();
+    child->parent = this;
+    child->symbol = name;
+    child->count  = count + 1;
+    transitions.emplace_back(name, std::move(child));
+    return transitions.back().second.get();
+}
+
+void InlineCache::add(const Entry& entry)
+{
+    entries[replace] = entry;
+    replace          = static_cast<std::uint8_t>((replace + 1) % ways);
+}
@@ -0,0 +1,74 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct ObjClosure;
+
+// The layout of an instance: which field lives in which slot. Instances
+// that gained the same fields in the same order share a shape, so a
+// property site can remember "shape 7 keeps x in slot 1" and skip the
+// lookup next time it sees shape 7.
+//
+// Each class owns a tree of shapes. The root has no fields, and adding a
+// field moves an instance to the child for that name, created on first
+// use. Ids are never reused, even after the class is freed, so a cache
+// entry for a dead shape can never match again.
+struct Shape
+{
+    std::uint64_t id;
+    Shape*        parent = nullptr;
+    std::uint32_t symbol = 0; // the field this shape adds to its parent
+    std::uint32_t count  = 0; // fields, the last in slot count - 1
+    std::vector<std::pair<std::uint32_t, std::unique_ptr<Shape>>> transitions;
+
+    Shape();
+
+    // The slot of the field whose name has symbol id name, or -1.
+    int find(std::uint32_t name) const;
+
+    // This shape with the field name added last.
+    Shape* add(std::uint32_t name);
+};
+
+// Per-site memory of the shapes a property access has seen, so that a hit
+// costs a compare and an array load. Up to `ways` shapes are remembered
+// (monomorphic sites use the first); past that, entries are replaced in
+// turn.
+struct InlineCache
+{
+    static constexpr int ways = 4;
+
+    struct Entry
+    {
+        std::uint64_t shape = 0; // id; 0 never matches
+        // The field's slot, or -1 when the name is a method.
+        std::int32_t slot   = -1;
+        ObjClosure*  method = nullptr;
+        // For stores, the shape after the store: the same one for a field
+        // that exists, the child when it adds one.
+        Shape* next = nullptr;
+    };
+
+    Entry        entries[ways];
+    std::uint8_t replace = 0;
+
+    const Entry* find(std::uint64_t shape) const
+    {
+        for(const Entry& entry: entries)
+        {
+            if(entry.shape == shape)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void add(const Entry& entry);
+};
+
+#endif // SHAPE_H
@@ -0,0 +1,75 @@
+#include "source.h"
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::~SourceBuffer()
+{
+    release();
+}
+
+bool SourceBuffer::open(const std::string& filename)
+{
+    release();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr != MAP_FAILED)
+        {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            data   = static_cast<const char*>(addr);
+            size   = st.st_size;
+            mapped = true;
+            close(fd);
+            return checkSize();
+        }
+    }
+
+    char buf[1 << 16];
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        owned.append(buf, n);
+    }
+    close(fd);
+    if(n < 0)
+    {
+        owned.clear();
+        return false;
+    }
+    data = owned.data();
+    size = owned.size();
+    return checkSize();
+}
+
+// Token offsets are 32-bit, so larger inputs are rejected.
+bool SourceBuffer::checkSize()
+{
+    if(size > UINT32_MAX)
+    {
+        release();
+        return false;
+    }
+    return true;
+}
+
+void SourceBuffer::release()
+{
+    if(mapped)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+    data   = nullptr;
+    size   = 0;
+    mapped = false;
+    owned.clear();
+}
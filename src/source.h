@@ -0,0 +1,39 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole source file. Regular files are memory-mapped;
+// anything that cannot be mapped (pipes, empty files) is read once into an
+// owned buffer. Tokens index into text(), so the buffer has to stay alive for
+// as long as they are in use.
+class SourceBuffer
+{
+public:
+    SourceBuffer() = default;
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&)            = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    // Returns false and leaves the buffer empty if the file cannot be read.
+    bool open(const std::string& filename);
+
+    std::string_view text() const
+    {
+        return {data, size};
+    }
+
+private:
+    void release();
+    bool checkSize();
+
+    const char* data   = nullptr;
+    std::size_t size   = 0;
+    bool        mapped = false;
+    std::string owned;
+};
+
+#endif // SOURCE_H
@@ -0,0 +1,58 @@
+#include "stream.h"
+#include <cerrno>
+#include <unistd.h>
+
+TokenStream::TokenStream(int fd, std::size_t chunk_size)
+    : fd(fd), chunk_size(chunk_size), consumed(0), eof(false), done(false), read_error(false)
+{
+}
+
+bool TokenStream::next(std::vector<Token>& tokens, std::string_view& window)
+{
+    tokens.clear();
+    if(done)
+    {
+        return false;
+    }
+    // Keep reading until at least one token is complete or the input ends;
+    // a single token (a long string literal) may span several chunks.
+    while(tokens.empty() && !done)
+    {
+        // Drop what was already lexed, keeping the unfinished tail.
+        buffer.erase(0, consumed);
+        consumed = 0;
+        if(!eof && !fill())
+        {
+            eof = true;
+        }
+        consumed = tokenizer.tokenizeChunk(buffer, eof, tokens);
+        done     = eof;
+    }
+    window = buffer;
+    return true;
+}
+
+int TokenStream::status() const
+{
+    return read_error ? 1 : tokenizer.status();
+}
+
+// Appends one chunk to the buffer; false at end of input.
+bool TokenStream::fill()
+{
+    std::size_t old_size = buffer.size();
+    buffer.resize(old_size + chunk_size);
+    ssize_t n;
+    do
+    {
+        n = read(fd, buffer.data() + old_size, chunk_size);
+    } while(n < 0 && errno == EINTR);
+    if(n <= 0)
+    {
+        read_error = n < 0;
+        buffer.resize(old_size);
+        return false;
+    }
+    buffer.resize(old_size + n);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tokenize.h"
+
+// Lexes a file descriptor in fixed-size chunks so that input of any size is
+// tokenized in bounded memory. Only the current chunk plus the unfinished
+// token at its end (typically a few bytes; a whole literal if a string spans
+// chunks) is held at a time.
+class TokenStream
+{
+public:
+    static constexpr std::size_t default_chunk_size = 1 << 20;
+
+    explicit TokenStream(int fd, std::size_t chunk_size = default_chunk_size);
+
+    // Replaces tokens with the next batch and window with the text they
+    // index into. Both stay valid until the following call. Returns false
+    // once the batch ending in EOF has been handed out.
+    bool next(std::vector<Token>& tokens, std::string_view& window);
+
+    // See Tokenizer::internSymbols.
+    void internSymbols(StringTable& table)
+    {
+        tokenizer.internSymbols(table);
+    }
+
+    // 0, or 65 if a lexical error was reported; 1 if reading failed.
+    int status() const;
+
+private:
+    bool fill();
+
+    int         fd;
+    std::size_t chunk_size;
+    std::string buffer;
+    std::size_t consumed;
+    bool        eof;
+    bool        done;
+    bool        read_error;
+    Tokenizer   tokenizer;
+};
+
+#endif // STREAM_H
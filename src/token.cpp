@@ -0,0 +1,119 @@
+#include "token.h"
+
+const char* tokenTypeName(TokenType type)
+{
+    switch(type)
+    {
+        case TokenType::LEFT_PAREN: return "LEFT_PAREN";
+        case TokenType::RIGHT_PAREN: return "RIGHT_PAREN";
+        case TokenType::LEFT_BRACE: return "LEFT_BRACE";
+        case TokenType::RIGHT_BRACE: return "RIGHT_BRACE";
+        case TokenType::COMMA: return "COMMA";
+        case TokenType::DOT: return "DOT";
+        case TokenType::MINUS: return "MINUS";
+        case TokenType::PLUS: return "PLUS";
+        case TokenType::SEMICOLON: return "SEMICOLON";
+        case TokenType::SLASH: return "SLASH";
+        case TokenType::STAR: return "STAR";
+        case TokenType::BANG: return "BANG";
+        case TokenType::BANG_EQUAL: return "BANG_EQUAL";
+        case TokenType::EQUAL: return "EQUAL";
+        case TokenType::EQUAL_EQUAL: return "EQUAL_EQUAL";
+        case TokenType::GREATER: return "GREATER";
+        case TokenType::GREATER_EQUAL: return "GREATER_EQUAL";
+        case TokenType::LESS: return "LESS";
+        case TokenType::LESS_EQUAL: return "LESS_EQUAL";
+        case TokenType::IDENTIFIER: return "IDENTIFIER";
+        case TokenType::STRING: return "STRING";
+        case TokenType::NUMBER: return "NUMBER";
+        case TokenType::AND: return "AND";
+        case TokenType::CLASS: return "CLASS";
+        case TokenType::ELSE: return "ELSE";
+        case TokenType::FALSE: return "FALSE";
+        case TokenType::FUN: return "FUN";
+        case TokenType::FOR: return "FOR";
+        case TokenType::IF: return "IF";
+        case TokenType::NIL: return "NIL";
+        case TokenType::OR: return "OR";
+        case TokenType::PRINT: return "PRINT";
+        case TokenType::RETURN: return "RETURN";
+        case TokenType::SUPER: return "SUPER";
+        case TokenType::THIS: return "THIS";
+        case TokenType::TRUE: return "TRUE";
+        case TokenType::VAR: return "VAR";
+        case TokenType::WHILE: return "WHILE";
+        case TokenType::END_OF_FILE: return "EOF";
+    }
+    return "UNKNOWN";
+}
+
+std::string_view tokenTypeSpelling(TokenType type)
+{
+    switch(type)
+    {
+        case TokenType::LEFT_PAREN: return "(";
+        case TokenType::RIGHT_PAREN: return ")";
+        case TokenType::LEFT_BRACE: return "{";
+        case TokenType::RIGHT_BRACE: return "}";
+        case TokenType::COMMA: return ",";
+        case TokenType::DOT: return ".";
+        case TokenType::MINUS: return "-";
+        case TokenType::PLUS: return "+";
+        case TokenType::SEMICOLON: return ";";
+        case TokenType::SLASH: return "/";
+        case TokenType::STAR: return "*";
+        case TokenType::BANG: return "!";
+        case TokenType::BANG_EQUAL: return "!=";
+        case TokenType::EQUAL: return "=";
+        case TokenType::EQUAL_EQUAL: return "==";
+        case TokenType::GREATER: return ">";
+        case TokenType::GREATER_EQUAL: return ">=";
+        case TokenType::LESS: return "<";
+        case TokenType::LESS_EQUAL: return "<=";
+        case TokenType::AND: return "and";
+        case TokenType::CLASS: return "class";
+        case TokenType::ELSE: return "else";
+        case TokenType::FALSE: return "false";
+        case TokenType::FUN: return "fun";
+        case TokenType::FOR: return "for";
+        case TokenType::IF: return "if";
+        case TokenType::NIL: return "nil";
+        case TokenType::OR: return "or";
+        case TokenType::PRINT: return "print";
+        case TokenType::RETURN: return "return";
+        case TokenType::SUPER: return "super";
+        case TokenType::THIS: return "this";
+        case TokenType::TRUE: return "true";
+        case TokenType::VAR: return "var";
+        case TokenType::WHILE: return "while";
+        default: return "";
+    }
+}
+
+std::string numberLiteral(std::string_view lexeme)
+{
+    size_t foundat = lexeme.find('.');
+    if(foundat == std::string_view::npos)
+    {
+        return std::string(lexeme) + ".0";
+    }
+    size_t i = lexeme.size() - 1;
+    while(i > foundat + 1 && lexeme[i] == '0')
+    {
+        i--;
+    }
+    return std::string(lexeme.substr(0, i + 1));
+}
+
+std::string Token::literal(std::string_view source) const
+{
+    if(token_type == TokenType::NUMBER)
+    {
+        return numberLiteral(lexeme(source));
+    }
+    if(token_type == TokenType::STRING)
+    {
+        return std::string(source.substr(offset + 1, length - 2));
+    }
+    return "null";
+}
@@ -0,0 +1,103 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class TokenType : std::uint8_t
+{
+    LEFT_PAREN,
+    RIGHT_PAREN,
+    LEFT_BRACE,
+    RIGHT_BRACE,
+    COMMA,
+    DOT,
+    MINUS,
+    PLUS,
+    SEMICOLON,
+    SLASH,
+    STAR,
+    BANG,
+    BANG_EQUAL,
+    EQUAL,
+    EQUAL_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    IDENTIFIER,
+    STRING,
+    NUMBER,
+    AND,
+    CLASS,
+    ELSE,
+    FALSE,
+    FUN,
+    FOR,
+    IF,
+    NIL,
+    OR,
+    PRINT,
+    RETURN,
+    SUPER,
+    THIS,
+    TRUE,
+    VAR,
+    WHILE,
+    END_OF_FILE
+};
+
+inline constexpr std::size_t token_type_count = static_cast<std::size_t>(TokenType::END_OF_FILE) + 1;
+
+// Name printed by the tokenize command, e.g. "LEFT_PAREN" or "EOF".
+const char* tokenTypeName(TokenType type);
+
+// Fixed source spelling of punctuation and keyword tokens, e.g. "+" or "while".
+// Empty for identifiers, literals and EOF.
+std::string_view tokenTypeSpelling(TokenType type);
+
+// Canonical literal text of a number lexeme: "42" -> "42.0", "1.50" -> "1.5".
+std::string numberLiteral(std::string_view lexeme);
+
+// A token is a typed span of the source buffer; the text itself stays in the
+// buffer, which must outlive every token that refers to it.
+//
+// Identifiers and string literals lexed with a StringTable attached also
+// carry the id of their interned text (the contents, for strings). It fits
+// in what would otherwise be padding; 0 means none was recorded.
+class Token
+{
+public:
+    static constexpr std::uint32_t max_symbol = (1u << 24) - 1;
+
+    TokenType     token_type;
+    std::uint32_t symbol : 24;
+    std::uint32_t offset;
+    std::uint32_t length;
+    int           line;
+
+    Token(TokenType type, std::uint32_t offset, std::uint32_t length, int line, std::uint32_t symbol = 0)
+        : token_type(type), symbol(symbol), offset(offset), length(length), line(line)
+    {
+    }
+
+    std::string_view lexeme(std::string_view source) const
+    {
+        return source.substr(offset, length);
+    }
+
+    // Literal column of the tokenize output: the number value, the string
+    // contents without quotes, or "null".
+    std::string literal(std::string_view source) const;
+
+    std::string_view spelling() const
+    {
+        return tokenTypeSpelling(token_type);
+    }
+};
+
+static_assert(sizeof(Token) == 16, "tokens are meant to stay compact");
+
+#endif // TOKEN_H
@@ -1,334 +1,214 @@
 #include "tokenize.h"
+#include "intern.h"
+#include "lexer_tables.h"
+#include "scan.h"
 #include <iostream>
-#include <sstream>
-#include <algorithm>
 #include <string>
 
-const std::vector<std::string> reserved_words{"and",
-                                              "class",
-                                              "else",
-                                              "false",
-                                              "for",
-                                              "fun",
-                                              "if",
-                                              "nil",
-                                              "or",
-                                              "print",
-                                              "return",
-                                              "super",
-                                              "this",
-                                              "true",
-                                              "var",
-                                              "while"};
-
 Tokenizer::Tokenizer()
-    : quote_index(-1), number_index(-1), literal_index(-1), line_num(1), retVal(0)
+    : tokens(nullptr),
+      deferred(nullptr),
+      symbols(nullptr),
+      start(0),
+      current(0),
+      line_num(1),
+      retVal(0),
+      final_chunk(true),
+      unterminated(false)
 {
-    token_map = {{'(', "LEFT_PAREN "},
-                 {')', "RIGHT_PAREN "},
-                 {'{', "LEFT_BRACE "},
-                 {'}', "RIGHT_BRACE "},
-                 {',', "COMMA "},
-                 {'.', "DOT "},
-                 {'-', "MINUS "},
-                 {'+', "PLUS "},
-                 {';', "SEMICOLON "},
-                 {'*', "STAR "},
-                 {'!', "BANG "},
-                 {'=', "EQUAL "},
-                 {'<', "LESS "},
-                 {'>', "GREATER "},
-                 {'/', "SLASH "}};
 }
 
-void Tokenizer::tokenize(const std::string        &file_contents,
-                         int                      &ret,
-                         std::vector<std::string> &toks)
+// Scans the whole buffer in a single pass, appending tokens that point back
+// into it. Lexical errors are reported on stderr and reflected in ret.
+void Tokenizer::tokenize(std::string_view    file_contents,
+                         int                &ret,
+                         std::vector<Token> &toks)
 {
-    if(!file_contents.empty())
-    {
-        std::istringstream stream(file_contents);
-        std::string        line, line1 = "";
-        bool terminated = true;
-        while(std::getline(stream, line))
-        {
-            bool odd_quotes = std::count(line.begin(), line.end(), '\"') % 2 == 1;
-            if (terminated && odd_quotes) {
-                line1 = line + "\n";
-                terminated = false;
-            }
-            else if(terminated && !odd_quotes) {
-                processLine(line);
-                line = "";
-            }
-            else if(!terminated && odd_quotes) {
-                line1 += line + "\n";
-                terminated = true;
-                processLine(line1);
-                line = "";
-                line1 = "";
-            }
-            else {
-                line1 += line + "\n";
-            }
-            ++line_num;
-        }
-        if(!line1.empty())
-        {
-            --line_num;
-            processLine(line1);
-        }
-    }
-    tokens.emplace_back("EOF  null");
-    toks = tokens;
-    // printTokens();
+    // Typical scripts average well over four bytes per token; reserving up
+    // front avoids repeated reallocation and copying of the token array.
+    toks.reserve(file_contents.size() / 4 + 1);
+    tokenizeChunk(file_contents, true, toks);
     ret = retVal;
 }
 
-void Tokenizer::processLine(const std::string &line)
+size_t Tokenizer::tokenizeChunk(std::string_view window, bool final, std::vector<Token> &toks)
 {
-    for(int i = 0; i < line.size(); ++i)
-    {
-        if(line[i] == '/' && i && line[i - 1] == '/')
+    source      = window;
+    tokens      = &toks;
+    final_chunk = final;
+    current     = 0;
+    while(true)
+    {
+        // Most whitespace is one space between tokens, which is cheaper to
+        // step over than to hand to the kernel.
+        if(!isAtEnd() && charInfo(source[current]).cls == CharClass::WHITESPACE)
+        {
+            line_num += source[current++] == '\n';
+            if(!isAtEnd() && charInfo(source[current]).cls == CharClass::WHITESPACE)
+            {
+                current = scan::skipWhitespace(source.data(), current, source.size(), line_num);
+            }
+        }
+        if(isAtEnd())
         {
-            tokens.pop_back();
-            return;
+            break;
         }
-        if(line[i] == '\n')
+        start                = current;
+        size_t mark          = toks.size();
+        int    line_at_start = line_num;
+        scanToken();
+        // Anything that looked at the last byte (or past it) may continue in
+        // the next chunk: undo it and leave it for the next call.
+        if(!final && current + 1 >= source.size() &&
+           charInfo(source[start]).cls != CharClass::INVALID)
         {
-            return;
+            toks.erase(toks.begin() + mark, toks.end());
+            line_num = line_at_start;
+            current  = start;
+            break;
         }
-        processCharacter(line[i], i, line);
     }
+    if(final)
+    {
+        toks.emplace_back(TokenType::END_OF_FILE, source.size(), 0, line_num);
+    }
+    tokens = nullptr;
+    source = {};
+    return current;
 }
 
-void Tokenizer::processCharacter(char ch, int &index, const std::string &line)
+void Tokenizer::scanToken()
 {
-    if(ch == '%' || ch == '#' || ch == '@' || ch == '$')
-    {
-        retVal = 65;
-        std::cerr << "[line " << line_num << "] Error: Unexpected character: " << ch
-                  << std::endl;
-    }
-    else if(ch == '"' && quote_index == -1)
-    {
-        handleQuote(ch, index, line);
-    }
-    else if((ch >= '0' && ch <= '9') || number_index != -1)
-    {
-        handleNumber(ch, index, line);
-    }
-    else if(ch == '\t' || ch == ' ')
-    {
-        return;
-    }
-    else if(token_map.find(ch) != token_map.end())
-    {
-        handleToken(ch, index, line);
-    }
-    else
-    {
-        handleLiteral(ch, index, line);
+    char            ch   = source[current++];
+    const CharInfo &info = charInfo(ch);
+    switch(info.cls)
+    {
+        case CharClass::SINGLE:
+            addToken(info.single);
+            break;
+        case CharClass::EQUAL_PAIR:
+            addToken(match('=') ? info.paired : info.single);
+            break;
+        case CharClass::SLASH:
+            if(match('/'))
+            {
+                handleComment();
+            }
+            else
+            {
+                addToken(TokenType::SLASH);
+            }
+            break;
+        case CharClass::QUOTE:
+            handleQuote();
+            break;
+        case CharClass::DIGIT:
+            handleNumber();
+            break;
+        case CharClass::ALPHA:
+            handleLiteral();
+            break;
+        case CharClass::WHITESPACE:
+            line_num += ch == '\n';
+            break;
+        case CharClass::INVALID:
+            error(std::string("Unexpected character: ") + ch);
+            break;
     }
 }
 
-void Tokenizer::handleQuote(char ch, int &index, const std::string &line)
+void Tokenizer::handleComment()
 {
-    while(index < line.size())
-    {
-        ch = line[index];
-        if(quote_index == -1)
-        {
-            quote_index = index;
-        }
-        else if(ch == '"')
-        {
-            tokens.push_back("STRING \"" + quote + "\" " + quote);
-            quote_index = -1;
-            quote.clear();
-            return;
-        }
-        else
-        {
-            quote += ch;
-        }
-        ++index;
-    }
-    if(index == line.size() && quote_index != -1)
-    {
-        retVal = 65;
-        std::cerr << "[line " << line_num << "] Error: Unterminated string." << std::endl;
-    }
+    current = scan::findNewline(source.data(), current, source.size());
 }
 
-void Tokenizer::handleNumber(char ch, int &index, const std::string &line)
+void Tokenizer::handleQuote()
 {
-    while(index < line.size())
+    current = scan::findQuote(source.data(), current, source.size(), line_num);
+    if(isAtEnd())
     {
-        ch                = line[index];
-        bool isDigitorDot = (ch >= '0' && ch <= '9') || ch == '.';
-        if(number_index == -1)
-        {
-            number_index = index;
-            number += ch;
-        }
-        else if(!isDigitorDot)
-        {
-            finalizeNumber();
-            if(index < line.size() && index > 0)
-            {
-                --index;
-            }
-            return;
-        }
-        else
+        if(final_chunk)
         {
-            number += ch;
+            unterminated = true;
+            error("Unterminated string.");
         }
-        ++index;
-    }
-    if(index == line.size() && number_index != -1)
-    {
-        finalizeNumber();
+        return;
     }
+    ++current; // closing quote
+    addToken(TokenType::STRING);
 }
 
-void Tokenizer::handleToken(char ch, int &index, const std::string &line)
+void Tokenizer::handleNumber()
 {
-    if(token_map.find(ch) != token_map.end())
+    current = scan::skipDigits(source.data(), current, source.size());
+    if(peek() == '.' && charInfo(peekNext()).cls == CharClass::DIGIT)
     {
-        if(ch == '=' && index && line[index - 1] == '=' && !tokens.empty() &&
-           tokens.back() == "EQUAL = null")
-        {
-            tokens.pop_back();
-            tokens.emplace_back("EQUAL_EQUAL == null");
-        }
-        else if(ch == '=' && index && line[index - 1] == '!' && !tokens.empty() &&
-                tokens.back() == "BANG ! null")
-        {
-            tokens.pop_back();
-            tokens.emplace_back("BANG_EQUAL != null");
-        }
-        else if(ch == '=' && index && line[index - 1] == '<' && !tokens.empty() &&
-                tokens.back() == "LESS < null")
-        {
-            tokens.pop_back();
-            tokens.emplace_back("LESS_EQUAL <= null");
-        }
-        else if(ch == '=' && index && line[index - 1] == '>' && !tokens.empty() &&
-                tokens.back() == "GREATER > null")
-        {
-            tokens.pop_back();
-            tokens.emplace_back("GREATER_EQUAL >= null");
-        }
-        else if(ch == '/' && index && line[index - 1] == '/' && !tokens.empty() &&
-                tokens.back() == "SLASH / null")
-        {
-            tokens.pop_back();
-            return;
-        }
-        else
-        {
-            tokens.push_back(token_map[ch] + ch + " null");
-        }
-    }
-    else
-    {
-        std::cerr << "[line " << line_num << "] Error: Unexpected character: " << ch
-                  << std::endl;
+        current = scan::skipDigits(source.data(), current + 1, source.size());
     }
+    addToken(TokenType::NUMBER);
 }
 
-bool Tokenizer::isreserved(const std::string &literal)
+void Tokenizer::handleLiteral()
 {
-    for(const std::string &word: reserved_words)
+    current = scan::skipIdentifier(source.data(), current, source.size());
+    addToken(identifierType(source.data() + start, current - start));
+}
+
+void Tokenizer::addToken(TokenType type)
+{
+    std::uint32_t symbol = 0;
+    // Skip tokens that tokenizeChunk is about to roll back.
+    if(symbols && (type == TokenType::IDENTIFIER || type == TokenType::STRING) &&
+       (final_chunk || current + 1 < source.size()))
     {
-        if(literal == word)
+        std::string_view text = source.substr(start, current - start);
+        if(type == TokenType::STRING)
         {
-            return true;
+            text = text.substr(1, text.size() - 2);
         }
+        symbol = symbols->symbol(text);
+        symbol = symbol <= Token::max_symbol ? symbol : 0;
     }
-    return false;
+    tokens->emplace_back(type, start, current - start, line_num, symbol);
 }
 
-void Tokenizer::finalizeLiteral(std::string &literal)
+bool Tokenizer::match(char expected)
 {
-    std::string identifier = "IDENTIFIER";
-    if(isreserved(literal))
+    if(isAtEnd() || source[current] != expected)
     {
-        identifier = literal;
-        std::transform(identifier.begin(), identifier.end(), identifier.begin(), ::toupper);
+        return false;
     }
-    tokens.push_back(identifier + " " + literal + " null");
-    literal_index = -1;
-    literal.clear();
+    ++current;
+    return true;
 }
 
-void Tokenizer::handleLiteral(char ch, int &index, const std::string &line)
+char Tokenizer::peek() const
 {
-    while(index < line.size())
-    {
-        ch = line[index];
-        bool isAlphaNumeric =
-            ch != ' ' && ch != '\t' && token_map.find(ch) == token_map.end();
-        if(literal_index == -1)
-        {
-            literal_index = index;
-            literal += ch;
-        }
-        else
-        {
-            if(!isAlphaNumeric)
-            {
-                finalizeLiteral(literal);
-                if(index < line.size() && index > 0)
-                {
-                    --index;
-                }
-                return;
-            }
-            else
-            {
-                literal += ch;
-            }
-        }
-        ++index;
-    }
-    if(index == line.size() && literal_index != -1)
-    {
-        finalizeLiteral(literal);
-    }
+    return isAtEnd() ? '\0' : source[current];
 }
 
-void Tokenizer::finalizeNumber()
+char Tokenizer::peekNext() const
 {
-    std::string numberstr = number;
-    getnumstr(number, numberstr);
-    tokens.push_back("NUMBER " + number + " " + numberstr);
-    number_index = -1;
-    number.clear();
+    return current + 1 >= source.size() ? '\0' : source[current + 1];
 }
 
-void Tokenizer::printTokens() const
+bool Tokenizer::isAtEnd() const
 {
-    for(const std::string &token: tokens)
-    {
-        std::cout << token << std::endl;
-    }
+    return current >= source.size();
 }
 
-void Tokenizer::getnumstr(std::string &number, std::string &numberstr)
+void Tokenizer::error(const std::string &message)
 {
-    size_t foundat = number.find('.');
-    if(foundat == std::string::npos)
+    retVal = 65;
+    if(deferred)
     {
-        numberstr = number + ".0";
+        deferred->push_back({line_num, message});
         return;
     }
-    int i = number.size() - 1;
-    while(i > foundat + 1 && number[i] == '0')
-    {
-        i--;
-    }
-    numberstr = number.substr(0, i + 1);
+    report({line_num, message}, std::cerr);
+}
+
+void Tokenizer::report(const LexError &error, std::ostream &err)
+{
+    err << "[line " << error.line << "] Error: " << error.message << '\n';
 }
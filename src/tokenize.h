@@ -1,42 +1,97 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include "token.h"
 
+class StringTable;
+
+struct LexError
+{
+    int         line;
+    std::string message;
+};
+
+// Tokenizer state is per instance, so independent instances may lex
+// different buffers concurrently.
 class Tokenizer
 {
   public:
     Tokenizer();
-    void tokenize(const std::string        &file_contents,
-                  int                      &ret,
-                  std::vector<std::string> &toks);
+    void tokenize(std::string_view    file_contents,
+                  int                &ret,
+                  std::vector<Token> &toks);
+
+    // Incremental interface for input that arrives in pieces. Appends the
+    // tokens that lie entirely inside window to toks and returns the offset
+    // where the first token that may continue past the window starts; the
+    // caller passes the bytes from there on again, followed by more input,
+    // on the next call. Line numbers and the error status carry over between
+    // calls. On the last call (final == true) everything is consumed and EOF
+    // is appended. Token offsets are relative to the window they came from.
+    size_t tokenizeChunk(std::string_view window, bool final, std::vector<Token> &toks);
+
+    int status() const
+    {
+        return retVal;
+    }
+
+    // Collect errors in sink instead of printing them, for callers that lex
+    // pieces out of order and report afterwards.
+    void deferErrors(std::vector<LexError> &sink)
+    {
+        deferred = &sink;
+    }
+
+    // Writes error the way the lexer reports it, for errors that were
+    // deferred.
+    static void report(const LexError &error, std::ostream &err);
+
+    // Intern identifiers and string contents into table as they are lexed,
+    // recording the ids in Token::symbol.
+    void internSymbols(StringTable &table)
+    {
+        symbols = &table;
+    }
+
+    // Current line: 1 + the newlines consumed so far.
+    int line() const
+    {
+        return line_num;
+    }
+
+    // Whether the input ended inside a string literal.
+    bool endedInString() const
+    {
+        return unterminated;
+    }
 
   private:
-    void processLine(const std::string &line);
-    void processCharacter(char ch, int &index, const std::string &line);
-    void handleLiteral(char ch, int &index, const std::string &line);
-    void handleQuote(char ch, int &index, const std::string &line);
-    void handleNumber(char ch, int &index, const std::string &line);
-    void handleToken(char ch, int &index, const std::string &line);
-    void finalizeNumber();
-    bool isreserved(const std::string &literal);
-    void finalizeLiteral(std::string &literal);
-    void printTokens() const;
-    void getnumstr(std::string &number, std::string &numberstr);
-    void handlenewline(char ch, int& index, const std::string& line);
-
-    std::vector<std::string>    tokens;
-    std::map<char, std::string> token_map;
-    int                         quote_index;
-    std::string                 quote;
-    int                         number_index;
-    std::string                 number;
-    int                         literal_index;
-    std::string                 literal;
-    int                         line_num;
-    int                         retVal;
+    void scanToken();
+    void handleLiteral();
+    void handleQuote();
+    void handleNumber();
+    void handleComment();
+    void addToken(TokenType type);
+    bool match(char expected);
+    char peek() const;
+    char peekNext() const;
+    bool isAtEnd() const;
+    void error(const std::string &message);
+
+    std::vector<Token>    *tokens;
+    std::vector<LexError> *deferred;
+    StringTable           *symbols;
+    std::string_view       source;
+    size_t                 start;
+    size_t                 current;
+    int                    line_num;
+    int                    retVal;
+    bool                   final_chunk;
+    bool                   unterminated;
 };
 
 #endif // TOKENIZER_H
@@ -0,0 +1,299 @@
+#include "value.h"
+#include "intern.h"
+#include <array>
+#include <charconv>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+ObjString* ObjString::create(std::string_view text)
+{
+    return StringTable::current().intern(text);
+}
+
+ObjString* ObjString::concat(const ObjString* left, const ObjString* right)
+{
+    return StringTable::current().intern(left->view(), right->view());
+}
+
+void ObjString::destroy(ObjString* string)
+{
+    StringTable::current().remove(string);
+    ::operator delete(string);
+}
+
+// Strings up to this length are concatenated eagerly: copying them is
+// cheaper than a rope node and a later flatten.
+constexpr std::size_t eager_concat_limit = 64;
+
+ObjRope* ObjRope::create(Value left, Value right)
+{
+    std::size_t length = left.stringLength() + right.stringLength();
+    if(length > UINT32_MAX)
+    {
+        throw std::runtime_error("String too long.");
+    }
+    return new ObjRope{{1, ObjType::ROPE}, static_cast<std::uint32_t>(length), std::move(left), std::move(right)};
+}
+
+void ObjRope::destroy(ObjRope* rope)
+{
+    std::vector<ObjRope*> pending{rope};
+    while(!pending.empty())
+    {
+        ObjRope* next = pending.back();
+        pending.pop_back();
+        for(Value* side: {&next->left, &next->right})
+        {
+            // Detach child ropes and free the ones that die with this one
+            // here, so their own destructors never recurse.
+            if(side->isRope())
+            {
+                ObjRope* child = static_cast<ObjRope*>(side->object());
+                side->bits     = Value::QNAN | Value::TAG_NIL;
+                if(--child->refcount == 0)
+                {
+                    pending.push_back(child);
+                }
+            }
+        }
+        ObjString* flat = const_cast<ObjString*>(next->flat);
+        if(flat && --flat->refcount == 0)
+        {
+            ObjString::destroy(flat);
+        }
+        delete next;
+    }
+}
+
+const ObjString* flattenRope(const ObjRope* rope)
+{
+    if(rope->flat)
+    {
+        return rope->flat;
+    }
+    std::string               text;
+    std::vector<const Value*> pending{&rope->right, &rope->left};
+    text.reserve(rope->length);
+    while(!pending.empty())
+    {
+        const Value* next = pending.back();
+        pending.pop_back();
+        if(!next->isRope())
+        {
+            text += next->asString()->view();
+            continue;
+        }
+        const ObjRope* inner = next->asRope();
+        if(inner->flat)
+        {
+            text += inner->flat->view();
+            continue;
+        }
+        pending.push_back(&inner->right);
+        pending.push_back(&inner->left);
+    }
+    rope->flat = ObjString::create(text);
+    // The sides are no longer needed; dropping them frees the chain below.
+    ObjRope* self = const_cast<ObjRope*>(rope);
+    self->left    = Value::nil();
+    self->right   = Value::nil();
+    return rope->flat;
+}
+
+Value concatenate(const Value& left, const Value& right)
+{
+    if(!left.isRope() && !right.isRope() && left.stringLength() + right.stringLength() <= eager_concat_limit)
+    {
+        return Value::adopt(ObjString::concat(left.asString(), right.asString()));
+    }
+    return Value::adopt(ObjRope::create(left, right));
+}
+
+// Strings are interned, so once flat they compare by identity, as does
+// everything else but numbers (where 0 == -0 and NaN is unequal to itself).
+bool valuesEqual(const Value& left, const Value& right)
+{
+    if(left.isNumber() && right.isNumber())
+    {
+        return left.asNumber() == right.asNumber();
+    }
+    if(left.isString() && right.isString())
+    {
+        return left.asString() == right.asString();
+    }
+    return left.raw() == right.raw();
+}
+
+BinaryOp binaryOpFor(TokenType type)
+{
+    switch(type)
+    {
+        case TokenType::PLUS: return BinaryOp::ADD;
+        case TokenType::MINUS: return BinaryOp::SUBTRACT;
+        case TokenType::STAR: return BinaryOp::MULTIPLY;
+        case TokenType::SLASH: return BinaryOp::DIVIDE;
+        case TokenType::EQUAL_EQUAL: return BinaryOp::EQUAL;
+        case TokenType::BANG_EQUAL: return BinaryOp::NOT_EQUAL;
+        case TokenType::GREATER: return BinaryOp::GREATER;
+        case TokenType::GREATER_EQUAL: return BinaryOp::GREATER_EQUAL;
+        case TokenType::LESS: return BinaryOp::LESS;
+        case TokenType::LESS_EQUAL: return BinaryOp::LESS_EQUAL;
+        default: throw std::runtime_error("Unknown binary operator.");
+    }
+}
+
+namespace
+{
+// One kernel per operator and operand kind pair. Each knows both operand
+// types up front, so its body is a single operation or a single error.
+using BinaryKernel = Value (*)(const Value&, const Value&);
+
+template <BinaryOp op>
+Value typeError(const Value&, const Value&)
+{
+    throw std::runtime_error(op == BinaryOp::ADD ? "Operands must be two numbers or two strings."
+                                                 : "Operands must be numbers.");
+}
+
+template <BinaryOp op>
+Value numberKernel(const Value& left, const Value& right)
+{
+    double a = left.asNumber();
+    double b = right.asNumber();
+    switch(op)
+    {
+        case BinaryOp::ADD: return Value::number(a + b);
+        case BinaryOp::SUBTRACT: return Value::number(a - b);
+        case BinaryOp::MULTIPLY: return Value::number(a * b);
+        case BinaryOp::DIVIDE: return Value::number(a / b);
+        case BinaryOp::EQUAL: return Value::boolean(a == b);
+        case BinaryOp::NOT_EQUAL: return Value::boolean(a != b);
+        case BinaryOp::GREATER: return Value::boolean(a > b);
+        case BinaryOp::GREATER_EQUAL: return Value::boolean(a >= b);
+        case BinaryOp::LESS: return Value::boolean(a < b);
+        case BinaryOp::LESS_EQUAL: return Value::boolean(a <= b);
+    }
+    return Value::nil();
+}
+
+template <BinaryOp op>
+Value stringKernel(const Value& left, const Value& right)
+{
+    if constexpr(op == BinaryOp::ADD)
+    {
+        return concatenate(left, right);
+    }
+    else if constexpr(op == BinaryOp::EQUAL || op == BinaryOp::NOT_EQUAL)
+    {
+        // Interned: equal strings are the same object.
+        return Value::boolean((left.asString() == right.asString()) == (op == BinaryOp::EQUAL));
+    }
+    else
+    {
+        return typeError<op>(left, right);
+    }
+}
+
+// bool x bool, nil x nil and every mixed pair: only equality is defined, and
+// since neither side is a number or a string, equal bits mean equal values.
+template <BinaryOp op>
+Value identityKernel(const Value& left, const Value& right)
+{
+    if constexpr(op == BinaryOp::EQUAL || op == BinaryOp::NOT_EQUAL)
+    {
+        return Value::boolean((left.raw() == right.raw()) == (op == BinaryOp::EQUAL));
+    }
+    else
+    {
+        return typeError<op>(left, right);
+    }
+}
+
+template <BinaryOp op>
+constexpr BinaryKernel selectKernel(ValueKind left, ValueKind right)
+{
+    if(left == right && left == ValueKind::NUMBER)
+    {
+        return numberKernel<op>;
+    }
+    if(left == right && left == ValueKind::STRING)
+    {
+        return stringKernel<op>;
+    }
+    return identityKernel<op>;
+}
+
+using KernelTable =
+    std::array<std::array<std::array<BinaryKernel, value_kind_count>, value_kind_count>, binary_op_count>;
+
+template <std::size_t... ops>
+constexpr KernelTable makeKernelTable(std::index_sequence<ops...>)
+{
+    KernelTable table{};
+    for(std::size_t l = 0; l < value_kind_count; ++l)
+    {
+        for(std::size_t r = 0; r < value_kind_count; ++r)
+        {
+            ((table[ops][l][r] = selectKernel<static_cast<BinaryOp>(ops)>(static_cast<ValueKind>(l),
+                                                                          static_cast<ValueKind>(r))),
+             ...);
+        }
+    }
+    return table;
+}
+
+constexpr KernelTable kernel_table = makeKernelTable(std::make_index_sequence<binary_op_count>{});
+} // namespace
+
+Value binaryOperation(BinaryOp op, const Value& left, const Value& right)
+{
+    return kernel_table[static_cast<std::size_t>(op)][static_cast<std::size_t>(left.kind())]
+                       [static_cast<std::size_t>(right.kind())](left, right);
+}
+
+Value unaryOperation(TokenType op, const Value& right)
+{
+    if(op == TokenType::BANG)
+    {
+        return Value::boolean(!right.isTruthy());
+    }
+    if(right.isNumber())
+    {
+        return Value::number(-right.asNumber());
+    }
+    throw std::runtime_error("Operand must be a number.");
+}
+
+std::string numberLiteral(double number)
+{
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof buffer, number);
+    std::string_view text(buffer, end - buffer);
+    if(text.find_first_of(".en") != std::string_view::npos)
+    {
+        return std::string(text);
+    }
+    return std::string(text) + ".0";
+}
+
+void printValue(std::ostream& out, const Value& value)
+{
+    if(value.isNumber())
+    {
+        // Same layout as the stream's default %g, but with the fewest digits
+        // that read back as the same double rather than six.
+        char buffer[32];
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof buffer, value.asNumber(), std::chars_format::general);
+        out.write(buffer, end - buffer);
+    }
+    else if(value.isBool())
+        out << (value.asBool() ? "true" : "false");
+    else if(value.isNil())
+        out << "nil";
+    else if(value.isObject())
+        printObject(out, value.asObject());
+    else
+        out << value.asString()->view();
+}
@@ -0,0 +1,388 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "token.h"
+
+enum class ObjType : std::uint8_t
+{
+    STRING,
+    ROPE,
+    FUNCTION,
+    CLOSURE,
+    NATIVE,
+    UPVALUE,
+    CLASS,
+    INSTANCE,
+    BOUND_METHOD
+};
+
+// Header shared by the heap objects a Value can point to.
+struct Obj
+{
+    std::uint32_t refcount;
+    ObjType       type;
+};
+
+// Frees an object other than a string or rope (see heap.h) once its last
+// reference has gone.
+void destroyHeapObject(Obj* object);
+
+// Writes a function, class or other non-string object the way print shows
+// it.
+void printObject(std::ostream& out, const Obj* object);
+
+// Immutable, reference-counted string. The characters follow the header in
+// the same allocation. Strings are interned (see StringTable), so equal
+// strings are the same object.
+struct ObjString : Obj
+{
+    std::uint32_t length;
+    std::uint32_t hash;
+    std::uint32_t symbol; // StringTable symbol id, or 0
+
+    const char* chars() const
+    {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+    std::string_view view() const
+    {
+        return {chars(), length};
+    }
+
+    // Both return the interned string, holding one reference.
+    static ObjString* create(std::string_view text);
+    static ObjString* concat(const ObjString* left, const ObjString* right);
+
+    static void destroy(ObjString* string);
+};
+
+struct ObjRope;
+
+// The interned string a rope spells, built on first use.
+const ObjString* flattenRope(const ObjRope* rope);
+
+// Dynamic type of a value, dense so that it can index dispatch tables.
+enum class ValueKind : std::uint8_t
+{
+    NUMBER,
+    BOOL,
+    NIL,
+    STRING,
+    OBJECT // functions and other heap objects that are not strings
+};
+
+inline constexpr std::size_t value_kind_count = 5;
+
+// A runtime value in 64 bits using NaN boxing. Any bit pattern that is not a
+// quiet NaN with all of QNAN's bits set is a double. Inside that NaN space the
+// low bits tag nil, false and true, and the sign bit marks a pointer to an
+// ObjString held in the low 48 bits; with bit 0 also set it is an ObjRope
+// instead. Both are strings to the language. With bit 1 set instead it is any
+// other object, whose header says what it is. Arithmetic results that are NaN
+// are canonicalised so they can never be mistaken for a tagged value.
+//
+// Copying an object value adds a reference; destroying one drops it.
+class Value
+{
+public:
+    Value() : bits(QNAN | TAG_NIL) {}
+
+    static Value number(double d)
+    {
+        Value v;
+        if(d != d)
+        {
+            v.bits = CANONICAL_NAN;
+        }
+        else
+        {
+            std::memcpy(&v.bits, &d, sizeof d);
+        }
+        return v;
+    }
+    static Value boolean(bool b)
+    {
+        Value v;
+        v.bits = b ? QNAN | TAG_TRUE : QNAN | TAG_FALSE;
+        return v;
+    }
+    static Value nil()
+    {
+        return Value();
+    }
+    // Takes over the caller's reference to string.
+    static Value adopt(ObjString* string)
+    {
+        Value v;
+        v.bits = SIGN_BIT | QNAN | reinterpret_cast<std::uintptr_t>(string);
+        return v;
+    }
+    static Value adopt(ObjRope* rope)
+    {
+        Value v;
+        v.bits = SIGN_BIT | QNAN | reinterpret_cast<std::uintptr_t>(rope) | ROPE_BIT;
+        return v;
+    }
+    // Adds a reference to string.
+    static Value share(ObjString* string)
+    {
+        ++string->refcount;
+        return adopt(string);
+    }
+    static Value string(std::string_view text)
+    {
+        return adopt(ObjString::create(text));
+    }
+    // Takes over the caller's reference to an object that is not a string.
+    static Value adoptObject(Obj* object)
+    {
+        Value v;
+        v.bits = SIGN_BIT | QNAN | reinterpret_cast<std::uintptr_t>(object) | OBJECT_BIT;
+        return v;
+    }
+
+    Value(const Value& other) : bits(other.bits)
+    {
+        retain();
+    }
+    Value(Value&& other) noexcept : bits(other.bits)
+    {
+        other.bits = QNAN | TAG_NIL;
+    }
+    Value& operator=(const Value& other)
+    {
+        if(bits != other.bits)
+        {
+            Value copy(other);
+            std::swap(bits, copy.bits);
+        }
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept
+    {
+        std::swap(bits, other.bits);
+        return *this;
+    }
+    ~Value()
+    {
+        release();
+    }
+
+    bool isNumber() const
+    {
+        return (bits & QNAN) != QNAN;
+    }
+    bool isBool() const
+    {
+        return (bits | 1) == (QNAN | TAG_TRUE);
+    }
+    bool isNil() const
+    {
+        return bits == (QNAN | TAG_NIL);
+    }
+    bool isString() const
+    {
+        return (bits & (QNAN | SIGN_BIT | OBJECT_BIT)) == (QNAN | SIGN_BIT);
+    }
+    bool isObject() const
+    {
+        return (bits & (QNAN | SIGN_BIT | OBJECT_BIT)) == (QNAN | SIGN_BIT | OBJECT_BIT);
+    }
+    // isObject() and the header says type.
+    bool isObject(ObjType type) const
+    {
+        return isObject() && object()->type == type;
+    }
+
+    double asNumber() const
+    {
+        double d;
+        std::memcpy(&d, &bits, sizeof d);
+        return d;
+    }
+    bool asBool() const
+    {
+        return bits == (QNAN | TAG_TRUE);
+    }
+    bool isRope() const
+    {
+        return (bits & (QNAN | SIGN_BIT | ROPE_BIT)) == (QNAN | SIGN_BIT | ROPE_BIT);
+    }
+
+    // The characters of a string value; flattens a rope on first use.
+    const ObjString* asString() const
+    {
+        if(bits & ROPE_BIT)
+        {
+            return flattenRope(reinterpret_cast<const ObjRope*>(bits & ~(SIGN_BIT | QNAN | ROPE_BIT)));
+        }
+        return reinterpret_cast<const ObjString*>(bits & ~(SIGN_BIT | QNAN));
+    }
+
+    const ObjRope* asRope() const
+    {
+        return reinterpret_cast<const ObjRope*>(object());
+    }
+
+    Obj* asObject() const
+    {
+        return object();
+    }
+
+    // Length of a string value, without flattening it.
+    std::size_t stringLength() const;
+
+    ValueKind kind() const
+    {
+        if(isNumber())
+        {
+            return ValueKind::NUMBER;
+        }
+        if(isString())
+        {
+            return ValueKind::STRING;
+        }
+        if(isObject())
+        {
+            return ValueKind::OBJECT;
+        }
+        return isNil() ? ValueKind::NIL : ValueKind::BOOL;
+    }
+
+    // Everything but nil and false is truthy.
+    bool isTruthy() const
+    {
+        return bits != (QNAN | TAG_NIL) && bits != (QNAN | TAG_FALSE);
+    }
+
+    std::uint64_t raw() const
+    {
+        return bits;
+    }
+
+private:
+    static constexpr std::uint64_t SIGN_BIT      = 0x8000000000000000ull;
+    static constexpr std::uint64_t QNAN          = 0x7ffc000000000000ull;
+    static constexpr std::uint64_t CANONICAL_NAN = 0x7ff8000000000000ull;
+    static constexpr std::uint64_t TAG_NIL       = 1;
+    static constexpr std::uint64_t TAG_FALSE     = 2;
+    static constexpr std::uint64_t TAG_TRUE      = 3;
+    static constexpr std::uint64_t ROPE_BIT      = 1;
+    static constexpr std::uint64_t OBJECT_BIT    = 2;
+
+    friend struct ObjRope;
+
+    Obj* object() const
+    {
+        return reinterpret_cast<Obj*>(bits & ~(SIGN_BIT | QNAN | ROPE_BIT | OBJECT_BIT));
+    }
+    bool isHeap() const
+    {
+        return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+    }
+    void retain() const
+    {
+        if(isHeap())
+        {
+            ++object()->refcount;
+        }
+    }
+    void release()
+    {
+        if(isHeap() && --object()->refcount == 0)
+        {
+            destroyObject();
+        }
+    }
+    void destroyObject();
+
+    std::uint64_t bits;
+};
+
+static_assert(sizeof(Value) == 8, "values must stay register-sized");
+
+// The concatenation of two strings. + builds one in constant time instead of
+// copying both sides, so a chain of n concatenations costs O(total length)
+// rather than O(n * total length). The characters are produced, and
+// interned, only when something reads them: printing or comparing. After
+// that the rope holds just the flat string.
+struct ObjRope : Obj
+{
+    std::uint32_t            length;
+    Value                    left;
+    Value                    right;
+    mutable const ObjString* flat = nullptr; // holds a reference once set
+
+    // Returns a rope holding one reference.
+    static ObjRope* create(Value left, Value right);
+
+    // Iterative, so that releasing a long chain cannot overflow the stack.
+    static void destroy(ObjRope* rope);
+};
+
+inline std::size_t Value::stringLength() const
+{
+    return isRope() ? asRope()->length : asString()->length;
+}
+
+inline void Value::destroyObject()
+{
+    if(bits & ROPE_BIT)
+    {
+        ObjRope::destroy(static_cast<ObjRope*>(object()));
+    }
+    else if(bits & OBJECT_BIT)
+    {
+        destroyHeapObject(object());
+    }
+    else
+    {
+        ObjString::destroy(static_cast<ObjString*>(object()));
+    }
+}
+
+// s + t for two string values: a new string when both are short and flat,
+// otherwise a rope.
+Value concatenate(const Value& left, const Value& right);
+
+// Binary operators, resolved from their token once when the tree is built.
+enum class BinaryOp : std::uint8_t
+{
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL
+};
+
+inline constexpr std::size_t binary_op_count = 10;
+
+// Throws std::runtime_error for tokens that are not binary operators.
+BinaryOp binaryOpFor(TokenType type);
+
+// Operator semantics shared by every execution engine, so that they agree on
+// results and error messages. Errors are thrown as std::runtime_error.
+Value binaryOperation(BinaryOp op, const Value& left, const Value& right);
+Value unaryOperation(TokenType op, const Value& right);
+bool  valuesEqual(const Value& left, const Value& right);
+
+// Literal text of a computed number in the style of numberLiteral for
+// lexemes: shortest round-trip digits, with ".0" added to integers.
+std::string numberLiteral(double number);
+
+// Writes a value the way print and evaluate show it.
+void printValue(std::ostream& out, const Value& value);
+
+#endif // VALUE_H
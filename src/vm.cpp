@@ -0,0 +1,284 @@
+#include "vm.h"
+#include "class.h"
+#include <stdexcept>
+
+void VM::run(const Chunk& chunk)
+{
+    Value* frame = env.stackBase();
+    if(env.stackEnd() - frame < chunk.frame_size + chunk.max_stack)
+    {
+        Environment::stackOverflow();
+    }
+    const std::uint8_t* ip          = chunk.code.data();
+    const Value*        constants   = chunk.constants.data();
+    InlineCache*        caches      = chunk.caches.data();
+    Value*              sp          = frame + chunk.frame_size;
+    ObjClosure*         closure     = nullptr; // at top level
+    int                 frame_count = 0;       // suspended callers
+
+// Reads a u16 or u24 operand.
+#define READ_U16() (ip += 2, ip[-2] | (ip[-1] << 8))
+#define READ_U24() (ip += 3, ip[-3] | (ip[-2] << 8) | (ip[-1] << 16))
+
+// Enters target with its frame starting at base, which holds the callee or
+// receiver, then the arguments.
+#define PUSH_FRAME(target, base)                                                                          \
+    {                                                                                                     \
+        ObjFunction* function = (target)->function;                                                       \
+        if(frame_count + 1 == Environment::max_frames ||                                                  \
+           env.stackEnd() - (base) < function->chunk.frame_size + function->chunk.max_stack)              \
+        {                                                                                                 \
+            Environment::stackOverflow();                                                                 \
+        }                                                                                                 \
+        env.checkInterrupt();                                                                             \
+        frames[frame_count++] = {closure, ip, frame, constants, caches};                                  \
+        closure               = (target);                                                                 \
+        frame                 = (base);                                                                   \
+        ip                    = function->chunk.code.data();                                              \
+        constants             = function->chunk.constants.data();                                         \
+        caches                = function->chunk.caches.data();                                            \
+        sp                    = frame + function->chunk.frame_size;                                       \
+    }
+
+// Both operands are on top of the stack; the result replaces the left one.
+#define NUMERIC_BINARY(op, wrap, expr)                                                 \
+    {                                                                                  \
+        Value& l = sp[-2];                                                             \
+        Value& r = sp[-1];                                                             \
+        if(l.isNumber() && r.isNumber())                                               \
+        {                                                                              \
+            double a = l.asNumber();                                                   \
+            double b = r.asNumber();                                                   \
+            l        = Value::wrap(expr);                                              \
+        }                                                                              \
+        else                                                                           \
+        {                                                                              \
+            l = binaryOperation(op, l, r);                                             \
+        }                                                                              \
+        --sp;                                                                          \
+        break;                                                                         \
+    }
+
+    for(;;)
+    {
+        switch(static_cast<OpCode>(*ip++))
+        {
+            case OpCode::CONSTANT:
+                *sp++ = constants[*ip++];
+                break;
+            case OpCode::CONSTANT_LONG:
+                *sp++ = constants[READ_U24()];
+                break;
+            case OpCode::ADD: NUMERIC_BINARY(BinaryOp::ADD, number, a + b)
+            case OpCode::SUBTRACT: NUMERIC_BINARY(BinaryOp::SUBTRACT, number, a - b)
+            case OpCode::MULTIPLY: NUMERIC_BINARY(BinaryOp::MULTIPLY, number, a * b)
+            case OpCode::DIVIDE: NUMERIC_BINARY(BinaryOp::DIVIDE, number, a / b)
+            case OpCode::GREATER: NUMERIC_BINARY(BinaryOp::GREATER, boolean, a > b)
+            case OpCode::GREATER_EQUAL: NUMERIC_BINARY(BinaryOp::GREATER_EQUAL, boolean, a >= b)
+            case OpCode::LESS: NUMERIC_BINARY(BinaryOp::LESS, boolean, a < b)
+            case OpCode::LESS_EQUAL: NUMERIC_BINARY(BinaryOp::LESS_EQUAL, boolean, a <= b)
+            case OpCode::EQUAL:
+                sp[-2] = Value::boolean(valuesEqual(sp[-2], sp[-1]));
+                --sp;
+                break;
+            case OpCode::NOT_EQUAL:
+                sp[-2] = Value::boolean(!valuesEqual(sp[-2], sp[-1]));
+                --sp;
+                break;
+            case OpCode::NEGATE:
+                if(sp[-1].isNumber())
+                {
+                    sp[-1] = Value::number(-sp[-1].asNumber());
+                }
+                else
+                {
+                    sp[-1] = unaryOperation(TokenType::MINUS, sp[-1]);
+                }
+                break;
+            case OpCode::NOT:
+                sp[-1] = Value::boolean(!sp[-1].isTruthy());
+                break;
+            case OpCode::PRINT:
+                printValue(env.out, *--sp);
+                env.out << '\n';
+                break;
+            case OpCode::POP:
+                --sp;
+                break;
+            case OpCode::NIL:
+                *sp++ = Value::nil();
+                break;
+            case OpCode::DEFINE_GLOBAL:
+                env.defineGlobal(READ_U24(), std::move(*--sp));
+                break;
+            case OpCode::GET_GLOBAL:
+                *sp++ = env.global(READ_U24());
+                break;
+            case OpCode::SET_GLOBAL:
+                env.assignGlobal(READ_U24(), sp[-1]);
+                break;
+            case OpCode::DEFINE_LOCAL:
+                frame[*ip++] = std::move(*--sp);
+                break;
+            case OpCode::GET_LOCAL:
+                *sp++ = frame[*ip++];
+                break;
+            case OpCode::SET_LOCAL:
+                frame[*ip++] = sp[-1];
+                break;
+            case OpCode::GET_UPVALUE:
+                *sp++ = *closure->upvalues()[*ip++]->location;
+                break;
+            case OpCode::SET_UPVALUE:
+                *closure->upvalues()[*ip++]->location = sp[-1];
+                break;
+            case OpCode::CLOSE_UPVALUES:
+                env.closeUpvalues(frame + *ip++);
+                break;
+            case OpCode::JUMP:
+            {
+                int offset = READ_U16();
+                ip += offset;
+                break;
+            }
+            case OpCode::JUMP_IF_FALSE:
+            {
+                int offset = READ_U16();
+                if(!sp[-1].isTruthy())
+                {
+                    ip += offset;
+                }
+                break;
+            }
+            case OpCode::JUMP_IF_TRUE:
+            {
+                int offset = READ_U16();
+                if(sp[-1].isTruthy())
+                {
+                    ip += offset;
+                }
+                break;
+            }
+            case OpCode::POP_JUMP_IF_FALSE:
+            {
+                int offset = READ_U16();
+                if(!(--sp)->isTruthy())
+                {
+                    ip += offset;
+                }
+                break;
+            }
+            case OpCode::LOOP:
+            {
+                int offset = READ_U16();
+                ip -= offset;
+                env.checkInterrupt();
+                break;
+            }
+            case OpCode::CALL:
+            {
+                int         argc = *ip++;
+                Value*      base = sp - argc - 1;
+                ObjClosure* target;
+                if(base->isObject(ObjType::CLOSURE))
+                {
+                    target = static_cast<ObjClosure*>(base->asObject());
+                    if(argc != target->function->arity)
+                    {
+                        arityError(target->function->arity, argc);
+                    }
+                }
+                else if(!(target = prepareCall(base, argc)))
+                {
+                    sp = base + 1;
+                    break;
+                }
+                // The callee and arguments become the first slots of the new
+                // frame.
+                PUSH_FRAME(target, base)
+                break;
+            }
+            case OpCode::INVOKE:
+            {
+                std::uint32_t symbol = READ_U24();
+                int           argc   = *ip++;
+                Value*        base   = sp - argc - 1;
+                ObjClosure*   target = prepareInvoke(base, argc, symbol, caches[READ_U16()]);
+                if(!target)
+                {
+                    sp = base + 1;
+                    break;
+                }
+                PUSH_FRAME(target, base)
+                break;
+            }
+            case OpCode::CLOSURE:
+            {
+                auto*       function = static_cast<ObjFunction*>(constants[READ_U24()].asObject());
+                ObjClosure* made     = ObjClosure::create(function);
+                for(int i = 0; i < function->upvalue_count; ++i)
+                {
+                    bool        is_local = *ip++;
+                    int         index    = *ip++;
+                    ObjUpvalue* upvalue  = is_local ? env.captureUpvalue(frame + index) : closure->upvalues()[index];
+                    ++upvalue->refcount;
+                    made->upvalues()[i] = upvalue;
+                }
+                *sp++ = Value::adoptObject(made);
+                break;
+            }
+            case OpCode::CLASS:
+                *sp++ = Value::adoptObject(ObjClass::create(constants[READ_U24()]));
+                break;
+            case OpCode::INHERIT:
+                inherit(static_cast<ObjClass*>(sp[-2].asObject()), sp[-1]);
+                --sp;
+                break;
+            case OpCode::METHOD:
+                static_cast<ObjClass*>(sp[-2].asObject())->defineMethod(READ_U24(), std::move(sp[-1]));
+                --sp;
+                break;
+            case OpCode::GET_PROPERTY:
+            {
+                std::uint32_t symbol = READ_U24();
+                sp[-1]               = getProperty(sp[-1], symbol, caches[READ_U16()]);
+                break;
+            }
+            case OpCode::SET_PROPERTY:
+            {
+                std::uint32_t symbol = READ_U24();
+                setProperty(sp[-2], symbol, sp[-1], caches[READ_U16()]);
+                sp[-2] = std::move(sp[-1]);
+                --sp;
+                break;
+            }
+            case OpCode::GET_SUPER:
+                sp[-2] = getSuperMethod(sp[-1], sp[-2], READ_U24());
+                --sp;
+                break;
+            case OpCode::RETURN:
+            {
+                if(frame_count == 0)
+                {
+                    return;
+                }
+                // The result replaces the callee at the bottom of the frame.
+                Value result = std::move(sp[-1]);
+                env.closeUpvalues(frame);
+                *frame            = std::move(result);
+                sp                = frame + 1;
+                const CallFrame& caller = frames[--frame_count];
+                closure           = caller.closure;
+                ip                = caller.ip;
+                frame             = caller.slots;
+                constants         = caller.constants;
+                caches            = caller.caches;
+                break;
+            }
+        }
+    }
+#undef PUSH_FRAME
+#undef NUMERIC_BINARY
+#undef READ_U16
+#undef READ_U24
+}
@@ -0,0 +1,37 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstdint>
+#include <memory>
+#include "chunk.h"
+#include "environment.h"
+
+// Stack machine that executes a Chunk. Runtime errors are thrown as
+// std::runtime_error with the same messages as the tree walker. The value
+// stack and globals are env's; program output goes to env.out. Each call
+// frame's locals occupy the bottom frame_size slots of its part of the
+// stack, starting with the callee and arguments where the caller pushed
+// them.
+class VM
+{
+public:
+    explicit VM(Environment& env) : env(env), frames(new CallFrame[Environment::max_frames]) {}
+
+    void run(const Chunk& chunk);
+
+private:
+    // A suspended caller.
+    struct CallFrame
+    {
+        ObjClosure*         closure;
+        const std::uint8_t* ip;
+        Value*              slots;
+        const Value*        constants;
+        InlineCache*        caches;
+    };
+
+    Environment&                 env;
+    std::unique_ptr<CallFrame[]> frames;
+};
+
+#endif // VM_H
@@ -0,0 +1,96 @@
+#!/bin/sh
+# Differential test: every engine and lexing path must produce the expected
+# output of each program in the corpus, byte for byte.
+#
+#   tests/differential.sh [--update] <interpreter> [corpus directory]
+#
+# Each corpus/<command>_<name>.lox is run with <command> (tokenize, parse,
+# evaluate or run), once as it is and once under every mode below that
+# applies to that command. Standard output, standard error and the exit
+# status of every run must match <command>_<name>.expected, which holds the
+# output, a "--- stderr" line, the errors and a "--- exit N" line. --stream
+# runs declarations as they are parsed, so it keeps the output printed
+# before a syntax error and is skipped where a run is expected to exit 65.
+# --update rewrites the expected files from the plain runs instead; check
+# the diff before committing them. Prints each mismatch with a diff and
+# exits 1 if there was any.
+
+tokenize_modes="--stream --jobs=4"
+parse_modes="--jobs=4"
+evaluate_modes="--engine=vm --engine=closure -O0 --jobs=4"
+run_modes="--engine=vm --engine=closure -O0 --jobs=4 --stream"
+
+update=
+if [ "$1" = --update ]; then
+    update=1
+    shift
+fi
+interpreter=${1:?usage: differential.sh [--update] <interpreter> [corpus directory]}
+corpus=${2:-$(dirname "$0")/corpus}
+# --jit is only there in builds with the JIT tier.
+if "$interpreter" run --jit /dev/null >/dev/null 2>&1; then
+    run_modes="$run_modes --jit"
+fi
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+checked=0
+failed=0
+
+# transcript <file> <output> <command and options...>
+transcript() {
+    file=$1
+    output=$2
+    shift 2
+    "$@" "$file" >"$work/out" 2>"$work/err"
+    status=$?
+    {
+        cat "$work/out"
+        echo "--- stderr"
+        cat "$work/err"
+        echo "--- exit $status"
+    } >"$output"
+}
+
+for file in "$corpus"/*.lox; do
+    name=$(basename "$file" .lox)
+    command=${name%%_*}
+    expected=${file%.lox}.expected
+    case $command in
+        tokenize) modes=$tokenize_modes ;;
+        parse) modes=$parse_modes ;;
+        evaluate) modes=$evaluate_modes ;;
+        run) modes=$run_modes ;;
+        *) echo "skipping $name: unknown command"; continue ;;
+    esac
+    if [ -n "$update" ]; then
+        transcript "$file" "$expected" "$interpreter" "$command"
+        continue
+    fi
+    if [ ! -f "$expected" ]; then
+        echo "FAIL $name: no $(basename "$expected")"
+        failed=$((failed + 1))
+        continue
+    fi
+    for mode in default $modes; do
+        if [ "$mode" = --stream ] && [ "$command" = run ] && grep -qx -- "--- exit 65" "$expected"; then
+            continue
+        fi
+        if [ "$mode" = default ]; then
+            transcript "$file" "$work/actual" "$interpreter" "$command"
+        else
+            transcript "$file" "$work/actual" "$interpreter" "$command" "$mode"
+        fi
+        checked=$((checked + 1))
+        if ! cmp -s "$expected" "$work/actual"; then
+            echo "FAIL $name $mode"
+            diff "$expected" "$work/actual" | head -20
+            failed=$((failed + 1))
+        fi
+    done
+done
+
+if [ -z "$update" ]; then
+    echo "$checked comparisons, $failed failed"
+fi
+[ "$failed" -eq 0 ]